@@ -0,0 +1,202 @@
+// Aggregates (see aggregate.h) against the driver loop they replace: one
+// CompiledExpression::evaluate() call per term, summed left to right.
+//   range  sum(i, 1, n, 1 / i^2)
+//   array  sum(price * qty * (1 + tax)) over bound arrays
+// Reports ns per term each way, on one thread and on all of them. Checks that every
+// pool size gives the same bits, that the pairwise sums are within a few ulps of a
+// long double reference, and that min, max, prod and misuse behave. Exits non-zero on
+// a failed check.
+//   ./build/calculator_aggregate_bench [terms]     (default 4000000)
+#include "aggregate.h"
+#include "bench_common.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+bool same(double a, double b) {
+    return std::memcmp(&a, &b, sizeof a) == 0;
+}
+
+// Relative error of `value` against `reference`, in units of the last place.
+double ulps(double value, long double reference) {
+    const double ulp = std::nextafter(static_cast<double>(reference), INFINITY) - static_cast<double>(reference);
+    return static_cast<double>(std::fabs(static_cast<long double>(value) - reference) / ulp);
+}
+
+// Evaluates `expression` on pools of several sizes; false unless all agree exactly.
+bool deterministic(const AggregateExpression& expression, std::span<const std::span<const double>> values,
+                   double& result) {
+    result = expression.evaluate(values);
+    for (unsigned threads : {2u, 3u, 8u}) {
+        ThreadPool pool(threads);
+        const double on_pool = expression.evaluate(values, pool);
+        if (!same(on_pool, result)) {
+            std::cerr << std::setprecision(17) << threads << " threads: " << on_pool << ", one thread: " << result
+                      << "\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename F>
+bool throws(F&& body, const std::string& expected) {
+    try {
+        body();
+    } catch (const std::runtime_error& e) {
+        if (std::string(e.what()).find(expected) != std::string::npos) {
+            return true;
+        }
+        std::cerr << "threw '" << e.what() << "', expected '" << expected << "'\n";
+        return false;
+    }
+    std::cerr << "did not throw '" << expected << "'\n";
+    return false;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const std::size_t terms = argc > 1 ? static_cast<std::size_t>(std::atol(argv[1])) : 4'000'000;
+    ThreadPool all_cores;
+    std::cout << std::fixed << std::setprecision(3) << terms << " terms, " << all_cores.size() << " threads\n"
+              << std::setw(8) << "" << std::setw(14) << "driver ns" << std::setw(14) << "1 thread ns"
+              << std::setw(14) << "all ns" << std::setw(14) << "driver ulps" << std::setw(15) << "pairwise ulps" << "\n";
+    bool ok = true;
+
+    // Over a range. The driver binds i and calls evaluate() once per term.
+    {
+        const CompiledExpression term = parse_expression("1 / i^2");
+        double driver = 0.0;
+        const double driver_ns = measure_ns_per_op(terms, [&, i = 0.0]() mutable {
+            i += 1.0;
+            driver += term.evaluate(std::span<const double>(&i, 1));
+        });
+        const AggregateExpression aggregate = parse_aggregate("sum(i, 1, n, 1 / i^2)");
+        const double n = static_cast<double>(terms);
+        const std::span<const double> values[] = {{&n, 1}};
+        double result = 0.0;
+        ok &= deterministic(aggregate, values, result);
+        const double single_ns = measure_ns_per_op(1, [&] { do_not_optimize(aggregate.evaluate(values)); }) / n;
+        const double all_ns = measure_ns_per_op(1, [&] { do_not_optimize(aggregate.evaluate(values, all_cores)); }) / n;
+
+        long double reference = 0.0L;
+        for (std::size_t i = terms; i >= 1; --i) {
+            reference += 1.0L / (static_cast<long double>(i) * static_cast<long double>(i));
+        }
+        const double error = ulps(result, reference);
+        std::cout << std::setw(8) << "range" << std::setw(14) << driver_ns << std::setw(14) << single_ns
+                  << std::setw(14) << all_ns << std::setw(14) << ulps(driver, reference) << std::setw(14) << error
+                  << "\n";
+        if (error > 4.0) {
+            std::cerr << "range: pairwise sum is " << error << " ulps off\n";
+            ok = false;
+        }
+    }
+
+    // Over bound arrays, with a scalar repeated across them.
+    {
+        std::mt19937_64 rng(24);
+        std::uniform_real_distribution<double> price_of(0.5, 200.0);
+        std::vector<double> price(terms);
+        std::vector<double> qty(terms);
+        for (std::size_t i = 0; i < terms; ++i) {
+            price[i] = price_of(rng);
+            qty[i] = static_cast<double>(rng() % 40 + 1);
+        }
+        const double tax = 0.0825;
+
+        const CompiledExpression row = parse_expression("price * qty * (1 + tax)");
+        double driver = 0.0;
+        const double driver_ns = measure_ns_per_op(terms, [&, i = std::size_t{0}]() mutable {
+            const double bindings[] = {price[i], qty[i], tax};
+            driver += row.evaluate(bindings);
+            ++i;
+        });
+        const AggregateExpression aggregate = parse_aggregate("sum(price * qty * (1 + tax))");
+        const std::span<const double> values[] = {price, qty, {&tax, 1}};
+        double result = 0.0;
+        ok &= deterministic(aggregate, values, result);
+        const double n = static_cast<double>(terms);
+        const double single_ns = measure_ns_per_op(1, [&] { do_not_optimize(aggregate.evaluate(values)); }) / n;
+        const double all_ns = measure_ns_per_op(1, [&] { do_not_optimize(aggregate.evaluate(values, all_cores)); }) / n;
+
+        long double reference = 0.0L;
+        for (std::size_t i = 0; i < terms; ++i) {
+            reference += static_cast<long double>(price[i] * qty[i] * (1 + tax));
+        }
+        const double error = ulps(result, reference);
+        std::cout << std::setw(8) << "array" << std::setw(14) << driver_ns << std::setw(14) << single_ns
+                  << std::setw(14) << all_ns << std::setw(14) << ulps(driver, reference) << std::setw(14) << error
+                  << "\n";
+        if (error > 4.0) {
+            std::cerr << "array: pairwise sum is " << error << " ulps off\n";
+            ok = false;
+        }
+
+        // min and max are exact; mixed with the built-ins and arithmetic outside.
+        double lowest = INFINITY;
+        double highest = -INFINITY;
+        for (double p : price) {
+            lowest = std::fmin(lowest, p);
+            highest = std::fmax(highest, p);
+        }
+        const AggregateExpression spread = parse_aggregate("max(price) - min(price) + max(1, 2) * 0");
+        if (!same(spread.evaluate(values, all_cores), highest - lowest)) {
+            std::cerr << "max(price) - min(price) is wrong\n";
+            ok = false;
+        }
+        const std::vector<double> short_qty(terms / 2, 1.0);
+        const std::span<const double> mismatched[] = {price, short_qty};
+        const AggregateExpression total = parse_aggregate("sum(price * qty)");
+        ok &= throws([&] { (void)total.evaluate(mismatched); }, "same length");
+        ok &= throws([&] { (void)parse_aggregate("price + sum(qty)").evaluate(values); }, "is an array");
+    }
+
+    // Exact cases: 20! and an empty range.
+    ThreadPool pool;
+    const double twenty = 20.0;
+    if (parse_aggregate("prod(k, 1, n, k)").evaluate(std::span<const double>(&twenty, 1), pool) !=
+            2432902008176640000.0 ||
+        parse_aggregate("sum(i, 1, 0, i) + prod(i, 1, 0, i)").evaluate(std::span<const double>{}, pool) != 1.0) {
+        std::cerr << "prod or empty range is wrong\n";
+        ok = false;
+    }
+    ok &= throws([&] { (void)parse_aggregate("sum(i, 1, 3, 1 / (i - 2))").evaluate({}); }, "Division by zero");
+    ok &= !try_parse_aggregate("sum(i, 1, 3, max(j, 1, i, j))").has_value();
+    ok &= throws([&] { (void)parse_aggregate("sum(i, 2^1024, 2^1024, i)").evaluate({}); }, "finite whole numbers");
+    ok &= throws([&] { (void)parse_aggregate("sum(i, 1, 2^1024, i)").evaluate({}); }, "finite");
+
+    // Aggregates with different numbers of inputs, one after another on the same
+    // threads' scratch columns: a repeated scalar must not be read back stale.
+    const double y = 2.0;
+    const std::span<const double> y_value[] = {{&y, 1}};
+    const AggregateExpression scaled = parse_aggregate("sum(i, 1, 10, i * y)");
+    const AggregateExpression plain = parse_aggregate("sum(i, 1, 10, i)");
+    const AggregateExpression mixed = parse_aggregate("sum(i, 1, 10, i * y) + sum(i, 1, 10, i) + sum(i, 1, 10, i * y)");
+    for (ThreadPool* on : {static_cast<ThreadPool*>(nullptr), &pool}) {
+        const double first = on ? scaled.evaluate(y_value, *on) : scaled.evaluate(y_value);
+        const double second = on ? plain.evaluate(y_value, *on) : plain.evaluate(y_value);
+        const double third = on ? scaled.evaluate(y_value, *on) : scaled.evaluate(y_value);
+        const double all = on ? mixed.evaluate(y_value, *on) : mixed.evaluate(y_value);
+        if (first != 110.0 || second != 55.0 || third != 110.0 || all != 275.0) {
+            std::cerr << "aggregates in sequence: " << first << ", " << second << ", " << third << ", " << all
+                      << "; expected 110, 55, 110, 275\n";
+            ok = false;
+        }
+    }
+
+    if (!ok) {
+        return 1;
+    }
+    std::cout << "checks passed\n";
+    return 0;
+}
@@ -0,0 +1,23 @@
+#include "allocation_counter.h"
+
+#include <cstdlib>
+#include <new>
+
+std::size_t allocations = 0;
+std::size_t frees = 0;
+
+void* operator new(std::size_t size) {
+    ++allocations;
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept {
+    frees += p != nullptr;
+    std::free(p);
+}
+void operator delete(void* p, std::size_t) noexcept {
+    frees += p != nullptr;
+    std::free(p);
+}
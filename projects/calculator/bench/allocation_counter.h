@@ -0,0 +1,12 @@
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+
+#include <cstddef>
+
+// Heap allocations and frees made through the global operator new and delete, which
+// allocation_counter.cpp replaces for the benchmarks that link it. Plain counters:
+// read them around single-threaded work.
+extern std::size_t allocations;
+extern std::size_t frees;
+
+#endif // ALLOCATION_COUNTER_H
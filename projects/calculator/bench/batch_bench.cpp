@@ -0,0 +1,72 @@
+// Columnar batch evaluation: rows/sec for each kernel set from 1K to 100M rows, with
+// per-row CompiledExpression::evaluate() as the baseline.
+//   ./build/calculator_batch_bench [max_rows]     (default 100000000)
+#include "batch.h"
+#include "bench_common.h"
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+int main(int argc, char** argv) {
+    std::size_t max_rows = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 100'000'000;
+    const std::string source = "x * 2.5 + y / 3 - x * y + (x - 1) / (y + 0.5)";
+    CompiledExpression expression = parse_expression(source);
+
+    std::cout << "expression: " << source << "\n"
+              << "detected:   " << to_string(detect_simd_level()) << "\n\n"
+              << std::setw(12) << "rows" << std::setw(14) << "per-row"
+              << std::setw(14) << "scalar" << std::setw(14) << "sse2" << std::setw(14) << "avx2"
+              << "   (Mrows/s)\n";
+
+    std::mt19937_64 rng(42);
+    std::uniform_real_distribution<double> dist(1.0, 2.0);
+    std::vector<double> x, y, out, reference;
+
+    for (std::size_t rows = 1'000; rows <= max_rows; rows *= 10) {
+        x.resize(rows);
+        y.resize(rows);
+        for (std::size_t i = 0; i < rows; ++i) {
+            x[i] = dist(rng);
+            y[i] = dist(rng);
+        }
+        out.assign(rows, 0.0);
+        std::span<const double> columns[] = {x, y};
+
+        std::cout << std::setw(12) << rows;
+        // The per-row loop is the slow path we are replacing; cap it to keep runs short.
+        if (rows <= 10'000'000) {
+            reference.resize(rows);
+            double s = seconds_per_call([&] {
+                double row[2];
+                for (std::size_t i = 0; i < rows; ++i) {
+                    row[0] = x[i];
+                    row[1] = y[i];
+                    reference[i] = expression.evaluate(row);
+                }
+            });
+            std::cout << std::setw(14) << std::fixed << std::setprecision(1) << rows / s / 1e6;
+        } else {
+            reference.clear();
+            std::cout << std::setw(14) << "-";
+        }
+
+        for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2}) {
+            if (level > detect_simd_level()) {
+                std::cout << std::setw(14) << "n/a";
+                continue;
+            }
+            double s = seconds_per_call([&] { evaluate_batch(expression, columns, out, level); });
+            if (!reference.empty() && out != reference) {
+                std::cerr << "\nmismatch against per-row evaluation at " << to_string(level) << "\n";
+                return 1;
+            }
+            std::cout << std::setw(14) << std::fixed << std::setprecision(1) << rows / s / 1e6;
+        }
+        std::cout << "\n";
+    }
+    return 0;
+}
@@ -0,0 +1,63 @@
+#ifndef BENCH_COMMON_H
+#define BENCH_COMMON_H
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+
+// Keeps the optimizer from discarding a benchmarked result.
+inline void do_not_optimize(double value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// Runs `body` `iterations` times and returns the mean wall-clock cost in nanoseconds.
+template <typename F>
+double measure_ns_per_op(std::size_t iterations, F&& body) {
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < iterations; ++i) {
+        body();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / static_cast<double>(iterations);
+}
+
+// Repeats `body` until at least ~200 ms have elapsed; returns seconds per call.
+template <typename F>
+double seconds_per_call(F&& body) {
+    std::size_t calls = 0;
+    auto start = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed{};
+    do {
+        body();
+        ++calls;
+        elapsed = std::chrono::steady_clock::now() - start;
+    } while (elapsed.count() < 0.2);
+    return elapsed.count() / static_cast<double>(calls);
+}
+
+// Left-deep chain "1 + 2 * 3 - 4 / 5 ..." with `terms` literals. Divisors are never zero.
+inline std::string make_deep_expression(std::size_t terms) {
+    static const char ops[] = {'+', '*', '-', '/'};
+    std::string expression = "1";
+    for (std::size_t i = 1; i < terms; ++i) {
+        expression += ' ';
+        expression += ops[i % 4];
+        expression += ' ';
+        expression += std::to_string(i % 9 + 1);
+    }
+    return expression;
+}
+
+// Fully parenthesised balanced tree of the given depth (2^depth literals). Division only
+// appears directly above a literal, so no divisor can evaluate to zero.
+inline std::string make_wide_expression(std::size_t depth, std::size_t seed = 0) {
+    static const char ops[] = {'+', '-', '*'};
+    if (depth == 0) {
+        return std::to_string(seed % 9 + 1) + ".5";
+    }
+    char op = (depth == 1 && seed % 2 == 1) ? '/' : ops[(seed + depth) % 3];
+    return "(" + make_wide_expression(depth - 1, seed * 2 + 1) + ' ' + op + ' ' +
+           make_wide_expression(depth - 1, seed * 2 + 2) + ")";
+}
+
+#endif // BENCH_COMMON_H
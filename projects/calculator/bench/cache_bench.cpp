@@ -0,0 +1,105 @@
+// String-to-result throughput with and without the expression cache, on a workload
+// that repeats a few thousand distinct formulas. Checks that normalization keeps the
+// blanks that change a line's meaning. Exits non-zero on a failed check.
+//   ./build/calculator_cache_bench [lines]     (default 1000000)
+#include "bench_common.h"
+#include "expression_cache.h"
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::vector<std::string> make_formulas(std::size_t count, std::mt19937_64& rng) {
+    static const char ops[] = {'+', '-', '*'};
+    std::uniform_int_distribution<int> literal(1, 99);
+    std::uniform_int_distribution<int> op(0, 2);
+    std::vector<std::string> formulas;
+    for (std::size_t i = 0; i < count; ++i) {
+        std::string f = "(" + std::to_string(literal(rng));
+        for (int term = 0; term < 8; ++term) {
+            f += ' ';
+            f += ops[op(rng)];
+            f += ' ';
+            f += std::to_string(literal(rng)) + "." + std::to_string(literal(rng));
+        }
+        f += ") / " + std::to_string(literal(rng));
+        formulas.push_back(std::move(f));
+    }
+    return formulas;
+}
+
+// Pairs that differ only in blanks the lexer cares about must get different keys;
+// the second of each is an error, so a shared entry would hand it the first's value.
+bool check_normalize() {
+    bool ok = true;
+    std::string key;
+    ExpressionCache::normalize(" 2 *  ( x + 1 ) ", key);
+    if (key != "2*(x+1)") {
+        std::cerr << "normalize gave '" << key << "'\n";
+        ok = false;
+    }
+    for (const char* spaced : {"1e -5", "1e- 5", "2.5E +3", "x y"}) {
+        ExpressionCache cache;
+        const std::string packed = [&] {
+            std::string s = spaced;
+            std::erase(s, ' ');
+            return s;
+        }();
+        (void)cache.try_evaluate_exact(packed, std::vector<double>(2, 1.0));
+        if (cache.try_evaluate_exact(spaced, std::vector<double>(2, 1.0))) {
+            std::cerr << "'" << spaced << "' was served from the entry for '" << packed << "'\n";
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const std::size_t lines = argc > 1 ? static_cast<std::size_t>(std::atol(argv[1])) : 1'000'000;
+    const bool ok = check_normalize();
+    std::mt19937_64 rng(7);
+    const std::vector<std::string> formulas = make_formulas(4000, rng);
+    std::vector<std::size_t> stream(lines);
+    std::uniform_int_distribution<std::size_t> pick(0, formulas.size() - 1);
+    for (auto& i : stream) {
+        i = pick(rng);
+    }
+
+    auto time_stream = [&](auto&& eval) {
+        std::size_t n = 0;
+        return measure_ns_per_op(1, [&] {
+            for (std::size_t i : stream) {
+                do_not_optimize(eval(formulas[i]));
+                ++n;
+            }
+        }) / static_cast<double>(stream.size());
+    };
+
+    double uncached_ns = time_stream([](const std::string& s) { return parse_expression(s).evaluate(); });
+    std::cout << std::left << std::setw(22) << "configuration" << std::right << std::setw(12) << "ns/line"
+              << std::setw(12) << "hits" << std::setw(12) << "misses" << std::setw(12) << "evictions"
+              << std::setw(12) << "entries" << "\n";
+    std::cout << std::left << std::setw(22) << "parse every line" << std::right << std::setw(12) << std::fixed
+              << std::setprecision(1) << uncached_ns << "\n";
+
+    for (std::size_t limit : {std::size_t{64} << 20, std::size_t{1} << 20, std::size_t{256} << 10}) {
+        ExpressionCache cache(limit);
+        double cached_ns = time_stream([&](const std::string& s) { return cache.evaluate(s); });
+        const CacheStats& stats = cache.get_stats();
+        std::cout << std::left << std::setw(22) << ("cache, " + std::to_string(limit >> 10) + " KiB") << std::right
+                  << std::setw(12) << cached_ns << std::setw(12) << stats.hits << std::setw(12) << stats.misses
+                  << std::setw(12) << stats.evictions << std::setw(12) << cache.size() << "\n";
+    }
+    if (!ok) {
+        return 1;
+    }
+    std::cout << "checks passed\n";
+    return 0;
+}
@@ -0,0 +1,257 @@
+// The calculator's regression suite: random expression corpora of controlled depth and
+// width, timed phase by phase, with a JSON report on stdout for tools to diff:
+//   lex               tokenize() into a warm token buffer
+//   parse             parse_tokens() on those tokens into a warm Ast
+//   build             simplify() and compile a parsed tree into a CompiledExpression
+//   evaluate_tree     Node::evaluate() on the parsed tree
+//   evaluate          CompiledExpression::evaluate(), past the JIT threshold
+//   destroy           ~CompiledExpression()
+//   parse_expression  the whole of lex + parse + build, as callers use it
+// Each phase reports ns and heap allocations (and frees) per expression. A shape DxW is
+// a tree D levels of parentheses deep, each level a chain of W terms, so about W^D
+// leaves. Exits non-zero if warm lexing or parsing allocates or the tree and compiled
+// evaluators disagree.
+//   ./build/calculator_bench [expressions] [seed] [DxW ...]     (defaults 200, 21, a fixed set of shapes)
+#include "allocation_counter.h"
+#include "bench_common.h"
+#include "calculator.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Each phase runs over its corpus until it has taken at least this long.
+constexpr double kMinNanoseconds = 50e6;
+constexpr std::size_t kNumVariables = 8;
+
+struct Shape {
+    std::size_t depth;
+    std::size_t width;
+};
+
+struct PhaseResult {
+    const char* name;
+    double ns_per_op;
+    double allocations_per_op;
+    double frees_per_op;
+};
+
+// One level of the tree: `width` terms joined by + - * /. Below the top level every
+// term is a nested level, in parentheses, under abs() or negated; at the bottom terms
+// are decimal literals or variables. A divisor is always a nonzero literal, so no
+// expression divides by zero.
+std::string make_level(std::mt19937_64& rng, std::size_t depth, std::size_t width) {
+    static const char ops[] = {'+', '-', '*', '/'};
+    auto literal = [&rng] { return std::to_string(rng() % 9 + 1) + "." + std::to_string(rng() % 100); };
+    std::string out;
+    for (std::size_t i = 0; i < width; ++i) {
+        char op = ops[rng() % 4];
+        if (i > 0) {
+            out += ' ';
+            out += op;
+            out += ' ';
+        }
+        if (i > 0 && op == '/') {
+            out += literal();
+        } else if (depth > 1) {
+            static const char* const wrappers[][2] = {{"(", ")"}, {"abs(", ")"}, {"-(", ")"}};
+            const auto& wrapper = wrappers[rng() % 3];
+            out += wrapper[0] + make_level(rng, depth - 1, width) + wrapper[1];
+        } else if (rng() % 2 == 0) {
+            out += literal();
+        } else {
+            out += "x" + std::to_string(rng() % kNumVariables);
+        }
+    }
+    return out;
+}
+
+// Runs `body` (one pass over the corpus, `ops` expressions) until kMinNanoseconds
+// have passed, after an untimed warm-up. `setup` runs untimed before every pass.
+template <typename Setup, typename Body>
+PhaseResult measure(const char* name, std::size_t ops, Setup&& setup, Body&& body) {
+    setup();
+    body();
+    double nanoseconds = 0.0;
+    std::size_t rounds = 0;
+    std::size_t allocated = 0;
+    std::size_t freed = 0;
+    while (nanoseconds < kMinNanoseconds || rounds < 3) {
+        setup();
+        const std::size_t allocations_before = allocations;
+        const std::size_t frees_before = frees;
+        const auto start = std::chrono::steady_clock::now();
+        body();
+        nanoseconds += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        allocated += allocations - allocations_before;
+        freed += frees - frees_before;
+        ++rounds;
+    }
+    const double total = static_cast<double>(rounds * ops);
+    return {name, nanoseconds / total, static_cast<double>(allocated) / total, static_cast<double>(freed) / total};
+}
+
+template <typename Body>
+PhaseResult measure(const char* name, std::size_t ops, Body&& body) {
+    return measure(name, ops, [] {}, body);
+}
+
+bool same(double a, double b) {
+    return std::memcmp(&a, &b, sizeof a) == 0;
+}
+
+// Runs every phase over one corpus and prints its JSON object; false on a failed check.
+bool run_corpus(const Shape& shape, std::size_t count, std::mt19937_64& rng, bool first) {
+    std::vector<std::string> sources(count);
+    std::size_t bytes = 0;
+    for (std::string& source : sources) {
+        source = make_level(rng, shape.depth, shape.width);
+        bytes += source.size();
+    }
+    double bindings[kNumVariables];
+    for (std::size_t i = 0; i < kNumVariables; ++i) {
+        bindings[i] = 1.25 + static_cast<double>(i);
+    }
+
+    // Inputs for the phases that start part way: tokens, parsed trees, and compiled
+    // expressions. Every tree binds all eight variables, whichever it mentions, since
+    // slots follow first appearance.
+    std::vector<std::vector<Token>> lexed(count);
+    std::vector<Ast> parsed(count);
+    std::size_t nodes = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+        tokenize(sources[i], lexed[i]);
+        if (Error error = parse_tokens(sources[i], lexed[i], parsed[i])) {
+            std::cerr << "'" << sources[i] << "': " << describe(error) << "\n";
+            return false;
+        }
+        nodes += parsed[i].size();
+    }
+
+    std::vector<Token> tokens;
+    Ast ast;
+    std::vector<CompiledExpression> built;
+    built.reserve(count);
+    double sink = 0.0;
+    std::vector<PhaseResult> phases;
+
+    phases.push_back(measure("lex", count, [&] {
+        for (const std::string& source : sources) {
+            tokenize(source, tokens);
+            sink += static_cast<double>(tokens.size());
+        }
+    }));
+    phases.push_back(measure("parse", count, [&] {
+        for (std::size_t i = 0; i < count; ++i) {
+            sink += static_cast<double>(parse_tokens(sources[i], lexed[i], ast).offset);
+        }
+    }));
+    auto build_all = [&] {
+        for (const Ast& tree : parsed) {
+            OptimizerStats stats;
+            Ast simplified = simplify(tree, stats);
+            built.emplace_back(std::move(simplified), stats);
+        }
+    };
+    phases.push_back(measure("build", count, [&] { built.clear(); }, build_all));
+    phases.push_back(measure("evaluate_tree", count, [&] {
+        for (const Ast& tree : parsed) {
+            sink += tree.root().evaluate(bindings);
+        }
+    }));
+
+    // Past the JIT threshold, so the steady state is measured, not the compilation.
+    for (std::size_t i = 0; i < count; ++i) {
+        const double expected = parsed[i].root().evaluate(bindings);
+        for (std::uint64_t n = 0; n <= kJitThreshold; ++n) {
+            const double actual = built[i].evaluate(bindings);
+            if (!same(actual, expected)) {
+                std::cerr << "'" << sources[i] << "': compiled " << actual << ", tree " << expected << "\n";
+                return false;
+            }
+        }
+    }
+    phases.push_back(measure("evaluate", count, [&] {
+        for (const CompiledExpression& expression : built) {
+            sink += expression.evaluate(bindings);
+        }
+    }));
+    phases.push_back(measure("destroy", count, [&] {
+        built.clear();
+        build_all();
+    }, [&] { built.clear(); }));
+    phases.push_back(measure("parse_expression", count, [&] { built.clear(); }, [&] {
+        for (const std::string& source : sources) {
+            built.push_back(parse_expression(source));
+        }
+    }));
+    do_not_optimize(sink);
+
+    std::printf("%s\n    {\"shape\": \"%zux%zu\", \"depth\": %zu, \"width\": %zu, \"expressions\": %zu, "
+                "\"bytes_per_expression\": %.1f, \"nodes_per_expression\": %.1f,\n     \"phases\": {",
+                first ? "" : ",", shape.depth, shape.width, shape.depth, shape.width, count,
+                static_cast<double>(bytes) / static_cast<double>(count),
+                static_cast<double>(nodes) / static_cast<double>(count));
+    for (std::size_t i = 0; i < phases.size(); ++i) {
+        const PhaseResult& phase = phases[i];
+        std::printf("%s\n       \"%s\": {\"ns_per_op\": %.1f, \"allocations_per_op\": %.3f, \"frees_per_op\": %.3f}",
+                    i == 0 ? "" : ",", phase.name, phase.ns_per_op, phase.allocations_per_op, phase.frees_per_op);
+    }
+    std::printf("}}");
+    std::fflush(stdout);
+
+    std::cerr << shape.depth << "x" << shape.width << ": " << static_cast<double>(nodes) / static_cast<double>(count)
+              << " nodes/expression, parse_expression " << phases.back().ns_per_op << " ns\n";
+    if (phases[0].allocations_per_op != 0.0 || phases[1].allocations_per_op != 0.0) {
+        std::cerr << shape.depth << "x" << shape.width << ": warm lexing or parsing allocates\n";
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const std::size_t count = argc > 1 ? static_cast<std::size_t>(std::atol(argv[1])) : 200;
+    const unsigned long seed = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 21;
+    std::vector<Shape> shapes;
+    for (int i = 3; i < argc; ++i) {
+        Shape shape{};
+        if (std::sscanf(argv[i], "%zux%zu", &shape.depth, &shape.width) != 2 || shape.depth == 0 || shape.width == 0) {
+            std::cerr << "Expected a shape like 3x4, got '" << argv[i] << "'\n";
+            return 2;
+        }
+        shapes.push_back(shape);
+    }
+    if (shapes.empty()) {
+        shapes = {{1, 4}, {1, 32}, {2, 8}, {4, 3}, {8, 2}, {3, 12}};
+    }
+
+    std::mt19937_64 rng(seed);
+    std::printf("{\"benchmark\": \"calculator\", \"compiler\": \"%s\", \"optimized\": %s, \"seed\": %lu,\n"
+                " \"corpora\": [",
+                __VERSION__,
+#ifdef __OPTIMIZE__
+                "true",
+#else
+                "false",
+#endif
+                seed);
+    bool ok = true;
+    for (std::size_t i = 0; i < shapes.size() && ok; ++i) {
+        ok = run_corpus(shapes[i], count, rng, i == 0);
+    }
+    std::printf("\n ]}\n");
+    if (!ok) {
+        return 1;
+    }
+    std::cerr << "checks passed\n";
+    return 0;
+}
@@ -0,0 +1,84 @@
+// Closure compilation versus tree walking and the bytecode VM, on deep (left-leaning
+// chain) and wide (balanced) expressions, with literals and with variables. Exits
+// non-zero if the three disagree.
+//   ./build/calculator_closure_bench [visits]     (default 20000000 node visits per measurement)
+#include "bench_common.h"
+#include "bytecode.h"
+#include "closure.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+namespace {
+
+// Replaces every other literal with x or y so operands are a mix of all three kinds.
+std::string with_variables(const std::string& expression) {
+    std::string out;
+    bool replace = false;
+    for (std::size_t i = 0; i < expression.size();) {
+        if (expression[i] >= '1' && expression[i] <= '9') {
+            std::size_t end = expression.find_first_not_of("0123456789.", i);
+            end = end == std::string::npos ? expression.size() : end;
+            out += replace ? (i % 2 ? "x" : "y") : expression.substr(i, end - i);
+            replace = !replace;
+            i = end;
+        } else {
+            out += expression[i++];
+        }
+    }
+    return out;
+}
+
+void run_case(const std::string& name, const std::string& expression, std::size_t visits) {
+    // Unshared, so every node is visited by every evaluator.
+    Ast tree = parse_tree(expression, false);
+    Node root = tree.root();
+    ClosureProgram closures(tree);
+    Program program = compile(tree);
+    VirtualMachine vm;
+    const double bindings[] = {1.5, 2.5};
+    std::span<const double> bound(bindings, tree.get_variables().size());
+
+    double expected = root.evaluate(bound);
+    double closure_result = closures.evaluate(bound);
+    double vm_result = vm.run(program, bound);
+    if ((closure_result != expected || vm_result != expected) && !std::isnan(expected)) {
+        std::cerr << name << ": result mismatch (tree " << expected << ", closures " << closure_result << ", vm "
+                  << vm_result << ")\n";
+        std::exit(1);
+    }
+
+    std::size_t iterations = std::max<std::size_t>(1, visits / tree.size());
+    double tree_ns = measure_ns_per_op(iterations, [&] { do_not_optimize(root.evaluate(bound)); });
+    double closure_ns = measure_ns_per_op(iterations, [&] { do_not_optimize(closures.evaluate(bound)); });
+    double vm_ns = measure_ns_per_op(iterations, [&] { do_not_optimize(vm.run(program, bound)); });
+
+    std::cout << std::left << std::setw(16) << name << std::right << std::setw(8) << tree.size() << std::fixed
+              << std::setprecision(1) << std::setw(12) << tree_ns << std::setw(12) << closure_ns << std::setw(12)
+              << vm_ns << std::setprecision(2) << std::setw(12) << tree_ns / closure_ns << "x" << std::setw(10)
+              << vm_ns / closure_ns << "x\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const std::size_t visits = argc > 1 ? static_cast<std::size_t>(std::atol(argv[1])) : 20'000'000;
+    std::cout << std::left << std::setw(16) << "case" << std::right << std::setw(8) << "nodes" << std::setw(12)
+              << "tree ns" << std::setw(12) << "closure ns" << std::setw(12) << "vm ns" << std::setw(13)
+              << "vs tree" << std::setw(11) << "vs vm\n";
+    for (std::size_t terms : {8, 64, 1024, 8192}) {
+        std::string expression = make_deep_expression(terms);
+        run_case("deep/" + std::to_string(terms), expression, visits);
+        run_case("deep-var/" + std::to_string(terms), with_variables(expression), visits);
+    }
+    for (std::size_t depth : {3, 6, 10, 13}) {
+        std::string expression = make_wide_expression(depth);
+        run_case("wide/" + std::to_string(depth), expression, visits);
+        run_case("wide-var/" + std::to_string(depth), with_variables(expression), visits);
+    }
+    return 0;
+}
@@ -0,0 +1,62 @@
+// Hash-consing on redundancy-heavy input: E(k) = ((E*E + E) / (E + 2)) with
+// E(0) = (a+b), so the source (and the plain tree) grows 4x per level while the
+// shared DAG grows by a constant.
+//   ./build/calculator_cse_bench
+#include "bench_common.h"
+#include "calculator.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+namespace {
+
+std::string make_redundant_expression(int levels) {
+    std::string e = "(a+b)";
+    for (int k = 0; k < levels; ++k) {
+        e = "((" + e + "*" + e + " + " + e + ") / (" + e + " + 2))";
+    }
+    return e;
+}
+
+} // namespace
+
+int main() {
+    const double bindings[] = {0.25, 0.5};
+    std::cout << std::setw(6) << "level" << std::setw(10) << "chars"
+              << std::setw(10) << "tree" << std::setw(8) << "dag" << std::setw(10) << "deduped"
+              << std::setw(14) << "parse tree us" << std::setw(13) << "parse dag us"
+              << std::setw(13) << "eval tree ns" << std::setw(12) << "eval dag ns" << "\n";
+
+    for (int level = 1; level <= 7; ++level) {
+        std::string source = make_redundant_expression(level);
+        std::size_t iterations = std::max<std::size_t>(1, 2'000'000 / source.size());
+
+        double parse_tree_us = measure_ns_per_op(iterations, [&] { do_not_optimize(parse_tree(source, false).size()); }) / 1e3;
+        double parse_dag_us = measure_ns_per_op(iterations, [&] { do_not_optimize(parse_tree(source, true).size()); }) / 1e3;
+
+        Ast plain = parse_tree(source, false);
+        Ast shared = parse_tree(source, true);
+        CompiledExpression tree_expression(plain);
+        CompiledExpression dag_expression(shared);
+
+        double expected = tree_expression.evaluate(bindings);
+        if (dag_expression.evaluate(bindings) != expected || shared.root().evaluate(bindings) != expected) {
+            std::cerr << "level " << level << ": shared evaluation differs from tree evaluation\n";
+            return 1;
+        }
+
+        std::size_t eval_iterations = std::max<std::size_t>(1, 20'000'000 / plain.size());
+        double eval_tree_ns = measure_ns_per_op(eval_iterations, [&] { do_not_optimize(tree_expression.evaluate(bindings)); });
+        double eval_dag_ns = measure_ns_per_op(eval_iterations, [&] { do_not_optimize(dag_expression.evaluate(bindings)); });
+
+        std::cout << std::setw(6) << level << std::setw(10) << source.size()
+                  << std::setw(10) << plain.size() << std::setw(8) << shared.size()
+                  << std::setw(10) << shared.get_deduplicated() << std::fixed << std::setprecision(1)
+                  << std::setw(14) << parse_tree_us << std::setw(13) << parse_dag_us
+                  << std::setw(13) << eval_tree_ns << std::setw(12) << eval_dag_ns << "\n";
+    }
+    return 0;
+}
@@ -0,0 +1,182 @@
+// CSV column mode (see csv_file.h) against the loop it replaces: std::getline per
+// row, fields split with find(','), std::stod, one CompiledExpression::evaluate() per
+// row. Writes a synthetic orders file, computes `price * qty - fee` over it each way
+// and reports input GB/s, with run_csv_file() on one thread and on all of them. Checks
+// that every way writes the same bytes and that awkward input (quotes, CRLF, blank
+// and bad rows) comes out as documented. Exits non-zero on a failed check.
+//   ./build/calculator_csv_bench [rows] [path]     (defaults 2000000, /tmp/calculator_orders.csv)
+#include "calculator.h"
+#include "csv_file.h"
+
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr const char* kExpression = "price * qty - fee";
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Orders with the columns the expression uses first; the quoted region, which may
+// hold a comma, comes after them so the getline loop can split naively.
+std::size_t write_orders(const std::string& path, std::size_t rows) {
+    static const char* const regions[] = {"north", "\"south, coastal\"", "east", "\"west \"\"annex\"\"\""};
+    std::mt19937_64 rng(25);
+    std::ofstream file(path, std::ios::binary);
+    std::string text = "id,price,qty,fee,region,note\n";
+    char number[32];
+    for (std::size_t row = 0; row < rows; ++row) {
+        text += std::to_string(row + 1);
+        text += ',';
+        text.append(number, std::to_chars(number, number + sizeof number, static_cast<double>(rng() % 100000) / 100).ptr);
+        text += ',';
+        text += std::to_string(rng() % 50 + 1);
+        text += ',';
+        text.append(number, std::to_chars(number, number + sizeof number, static_cast<double>(rng() % 1000) / 8).ptr);
+        text += ',';
+        text += regions[rng() % 4];
+        text += ",standard delivery\n";
+        if (text.size() > (1u << 20)) {
+            file << text;
+            text.clear();
+        }
+    }
+    file << text;
+    return static_cast<std::size_t>(file.tellp());
+}
+
+// The getline loop, appending what run_csv_file() writes for well-formed input.
+std::string getline_loop(const std::string& path) {
+    std::ifstream file(path);
+    std::string line;
+    std::getline(file, line);   // header: id,price,qty,fee,...
+    const CompiledExpression expression = parse_expression(kExpression);
+    std::vector<double> bindings(expression.num_slots());
+    const std::uint32_t slots[] = {expression.slot("price"), expression.slot("qty"), expression.slot("fee")};
+    std::string out;
+    char buffer[32];
+    while (std::getline(file, line)) {
+        std::size_t start = line.find(',') + 1;
+        for (std::uint32_t slot : slots) {
+            const std::size_t comma = line.find(',', start);
+            bindings[slot] = std::stod(line.substr(start, comma - start));
+            start = comma + 1;
+        }
+        out.append(buffer, std::to_chars(buffer, buffer + sizeof buffer, expression.evaluate(bindings)).ptr);
+        out += '\n';
+    }
+    return out;
+}
+
+std::string run_to_string(const CsvFileOptions& options, std::size_t& failures) {
+    std::FILE* out = std::tmpfile();
+    failures = run_csv_file(options, out);
+    std::string text(static_cast<std::size_t>(std::ftell(out)), '\0');
+    std::rewind(out);
+    const std::size_t read = std::fread(text.data(), 1, text.size(), out);
+    std::fclose(out);
+    text.resize(read);
+    return text;
+}
+
+bool check_awkward_input() {
+    const std::string text = "id,\"name, full\",price,qty,fee\r\n"
+                             "1,\"a, b\",2.5,4,1\r\n"
+                             "2,x,3,abc,1\n"
+                             "\n"
+                             "3,\"q \"\"z\"\"\",1e3, 2 ,\"+5\"\n"
+                             "4,y,7\n"
+                             "5,z,1,2,3";
+    const std::string expected = "9\n"
+                                 "Error: Column 'qty' is not a number\n"
+                                 "\n"
+                                 "1995\n"
+                                 "Error: Column 'qty' is missing\n"
+                                 "-1\n";
+    std::string out;
+    const std::size_t failures = evaluate_csv(text, kExpression, out);
+    std::string divided;
+    const std::size_t division_failures = evaluate_csv(text, "price / (qty - 2)", divided);
+    if (out != expected || failures != 2 || division_failures != 4 ||
+        divided.find("Error: Division by zero at offset 6\n") == std::string::npos) {
+        std::cerr << "awkward input gave:\n" << out << divided;
+        return false;
+    }
+
+    // An unbalanced quote fails its own row only; whole numbers stay exact past 2^53,
+    // as in --batch.
+    const std::string unbalanced = "a,b\n1,2\n3,\"4\n5,6\n7,\"8";
+    const std::string big = "x,y\n9007199254740993,3\n-0,1\n7,2\n";
+    std::string quotes;
+    std::string exact;
+    const std::size_t quote_failures = evaluate_csv(unbalanced, "a + b", quotes);
+    (void)evaluate_csv(big, "x * 1", exact);
+    (void)evaluate_csv(big, "x / y", exact);
+    if (quotes != "3\nError: Unterminated quote\n11\nError: Unterminated quote\n" || quote_failures != 2 ||
+        exact != "9007199254740993\n-0\n7\n3002399751580331\n-0\n3.5\n") {
+        std::cerr << "quotes or integers gave:\n" << quotes << exact;
+        return false;
+    }
+    try {
+        std::string ignored;
+        (void)evaluate_csv(text, "price * tax", ignored);
+    } catch (const std::runtime_error& e) {
+        return true;
+    }
+    std::cerr << "an unknown column was accepted\n";
+    return false;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const std::size_t rows = argc > 1 ? static_cast<std::size_t>(std::atol(argv[1])) : 2'000'000;
+    const std::string path = argc > 2 ? argv[2] : "/tmp/calculator_orders.csv";
+    const auto bytes = static_cast<double>(write_orders(path, rows));
+    const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    std::cout << std::fixed << std::setprecision(3) << rows << " rows, " << bytes / 1e6 << " MB, '" << kExpression
+              << "'\n";
+
+    bool ok = check_awkward_input();
+
+    auto start = std::chrono::steady_clock::now();
+    const std::string expected = getline_loop(path);
+    const double getline_seconds = seconds_since(start);
+
+    double seconds[2] = {};
+    const unsigned threads[2] = {1, 0};
+    for (int i = 0; i < 2; ++i) {
+        std::size_t failures = 0;
+        start = std::chrono::steady_clock::now();
+        const std::string output = run_to_string({path, kExpression, threads[i]}, failures);
+        seconds[i] = seconds_since(start);
+        if (output != expected || failures != 0) {
+            std::cerr << "run_csv_file on " << (threads[i] == 0 ? cores : 1) << " thread(s) disagrees with getline\n";
+            ok = false;
+        }
+    }
+
+    std::cout << "  getline + stod + evaluate        " << std::setw(8) << bytes / getline_seconds / 1e9 << " GB/s\n"
+              << "  run_csv_file, 1 thread           " << std::setw(8) << bytes / seconds[0] / 1e9 << " GB/s  ("
+              << std::setprecision(1) << getline_seconds / seconds[0] << "x)\n"
+              << std::setprecision(3) << "  run_csv_file, " << std::setw(2) << cores << " threads         "
+              << std::setw(8) << bytes / seconds[1] / 1e9 << " GB/s  (" << std::setprecision(1)
+              << getline_seconds / seconds[1] << "x)\n";
+    std::remove(path.c_str());
+    if (!ok) {
+        return 1;
+    }
+    std::cout << "checks passed\n";
+    return 0;
+}
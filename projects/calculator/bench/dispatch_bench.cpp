@@ -0,0 +1,218 @@
+// Open (virtual) versus closed (tagged union) node representations on random mixed-
+// operator trees of 10 to 10^6 nodes:
+//   virtual   - heap-allocated Node subclasses with a virtual evaluate(), the shape the
+//               calculator had before the arena (rebuilt here as the baseline)
+//   variant   - std::variant<NumberNode, OperationNode, VariableNode, CallNode> in a
+//               vector, children by index, evaluated with std::visit
+//   arena     - the calculator's AstNode tagged union, evaluated with a switch
+//   bytecode  - the register VM, for reference
+// Exits non-zero if they disagree, on these trees or on a chain a million terms deep.
+//   ./build/calculator_dispatch_bench [nodes]     (default 20000000 timed per size and way)
+#include "bench_common.h"
+#include "calculator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <variant>
+#include <vector>
+
+namespace {
+
+// --- Open hierarchy: one heap object and one indirect call per node. ---
+struct VirtualNode {
+    virtual ~VirtualNode() = default;
+    [[nodiscard]] virtual double evaluate(const double* bindings) const = 0;
+};
+
+struct VirtualNumber final : VirtualNode {
+    explicit VirtualNumber(double value) : value(value) {}
+    double evaluate(const double*) const override { return value; }
+    double value;
+};
+
+struct VirtualVariable final : VirtualNode {
+    explicit VirtualVariable(std::uint32_t slot) : slot(slot) {}
+    double evaluate(const double* bindings) const override { return bindings[slot]; }
+    std::uint32_t slot;
+};
+
+struct VirtualOperation final : VirtualNode {
+    VirtualOperation(char op, std::unique_ptr<VirtualNode> left, std::unique_ptr<VirtualNode> right)
+        : op(op), left(std::move(left)), right(std::move(right)) {}
+    double evaluate(const double* bindings) const override {
+        return apply_operator(op, left->evaluate(bindings), right->evaluate(bindings));
+    }
+    char op;
+    std::unique_ptr<VirtualNode> left;
+    std::unique_ptr<VirtualNode> right;
+};
+
+struct VirtualNegate final : VirtualNode {
+    explicit VirtualNegate(std::unique_ptr<VirtualNode> operand) : operand(std::move(operand)) {}
+    double evaluate(const double* bindings) const override { return -operand->evaluate(bindings); }
+    std::unique_ptr<VirtualNode> operand;
+};
+
+struct VirtualCall final : VirtualNode {
+    VirtualCall(std::uint32_t builtin, std::unique_ptr<VirtualNode> first, std::unique_ptr<VirtualNode> second)
+        : fn(get_builtin(builtin).scalar), first(std::move(first)), second(std::move(second)) {}
+    double evaluate(const double* bindings) const override {
+        double x = first->evaluate(bindings);
+        return fn(x, second ? second->evaluate(bindings) : x);
+    }
+    double (*fn)(double, double);
+    std::unique_ptr<VirtualNode> first;
+    std::unique_ptr<VirtualNode> second;
+};
+
+std::unique_ptr<VirtualNode> to_virtual(const Ast& ast, std::uint32_t index) {
+    const AstNode& node = ast[index];
+    switch (node.kind) {
+        case NodeKind::Number: return std::make_unique<VirtualNumber>(node.value);
+        case NodeKind::Integer: return std::make_unique<VirtualNumber>(static_cast<double>(node.integer));
+        case NodeKind::Variable: return std::make_unique<VirtualVariable>(node.slot);
+        case NodeKind::Operation:
+            return std::make_unique<VirtualOperation>(node.op, to_virtual(ast, node.left), to_virtual(ast, node.right));
+        case NodeKind::Negate: return std::make_unique<VirtualNegate>(to_virtual(ast, node.left));
+        case NodeKind::Call:
+            return std::make_unique<VirtualCall>(node.slot, to_virtual(ast, node.left),
+                                                 node.right == node.left ? nullptr : to_virtual(ast, node.right));
+    }
+    return nullptr;
+}
+
+// --- Closed set as a std::variant, children by index. ---
+struct NumberNode { double value; };
+struct VariableNode { std::uint32_t slot; };
+struct OperationNode { char op; std::uint32_t left, right; };
+struct CallNode { std::uint32_t builtin, first, second; bool unary; };
+struct NegateNode { std::uint32_t operand; };
+using VariantNode = std::variant<NumberNode, VariableNode, OperationNode, CallNode, NegateNode>;
+
+struct VariantTree {
+    std::vector<VariantNode> nodes;
+    std::uint32_t root = 0;
+
+    double evaluate(std::uint32_t index, const double* bindings) const {
+        return std::visit(
+            [&](const auto& node) -> double {
+                using T = std::decay_t<decltype(node)>;
+                if constexpr (std::is_same_v<T, NumberNode>) {
+                    return node.value;
+                } else if constexpr (std::is_same_v<T, VariableNode>) {
+                    return bindings[node.slot];
+                } else if constexpr (std::is_same_v<T, OperationNode>) {
+                    return apply_operator(node.op, evaluate(node.left, bindings), evaluate(node.right, bindings));
+                } else if constexpr (std::is_same_v<T, NegateNode>) {
+                    return -evaluate(node.operand, bindings);
+                } else {
+                    double x = evaluate(node.first, bindings);
+                    return get_builtin(node.builtin).scalar(x, node.unary ? x : evaluate(node.second, bindings));
+                }
+            },
+            nodes[index]);
+    }
+};
+
+VariantTree to_variant(const Ast& ast) {
+    VariantTree tree;
+    tree.nodes.reserve(ast.size());
+    for (const AstNode& node : ast.get_nodes()) {
+        switch (node.kind) {
+            case NodeKind::Number: tree.nodes.emplace_back(NumberNode{node.value}); break;
+            case NodeKind::Integer: tree.nodes.emplace_back(NumberNode{static_cast<double>(node.integer)}); break;
+            case NodeKind::Variable: tree.nodes.emplace_back(VariableNode{node.slot}); break;
+            case NodeKind::Operation: tree.nodes.emplace_back(OperationNode{node.op, node.left, node.right}); break;
+            case NodeKind::Negate: tree.nodes.emplace_back(NegateNode{node.left}); break;
+            case NodeKind::Call:
+                tree.nodes.emplace_back(CallNode{node.slot, node.left, node.right, node.right == node.left});
+                break;
+        }
+    }
+    tree.root = ast.get_root();
+    return tree;
+}
+
+// Random tree with exactly `size` nodes (size odd for a full binary shape; a unary
+// node absorbs any remainder). Division only ever has a nonzero literal on its right.
+std::uint32_t build_random(Ast& ast, std::size_t size, std::mt19937_64& rng) {
+    std::uniform_int_distribution<int> pick(0, 99);
+    if (size == 1) {
+        return pick(rng) < 50 ? ast.add_number(1.0 + pick(rng) / 64.0)
+                              : ast.add_variable(pick(rng) < 50 ? "x" : "y");
+    }
+    if (size == 2 || pick(rng) < 5) {
+        std::uint32_t operand = build_random(ast, size - 1, rng);
+        return pick(rng) < 50 ? ast.add_negate(operand) : ast.add_call(static_cast<std::uint32_t>(find_builtin("abs")), operand, operand);
+    }
+    std::size_t left_size = 1 + 2 * std::uniform_int_distribution<std::size_t>(0, (size - 3) / 2)(rng);
+    std::uint32_t left = build_random(ast, left_size, rng);
+    int which = pick(rng) % 4;
+    if (which == 3) {
+        std::uint32_t right = ast.add_number(1.0 + pick(rng) / 64.0);
+        // Keep the node count exact by spending the rest of the budget on the left.
+        return size - left_size - 1 == 1 ? ast.add_operation('/', left, right)
+                                         : ast.add_operation('+', left, build_random(ast, size - left_size - 1, rng));
+    }
+    static const char ops[] = {'+', '-', '*'};
+    return ast.add_operation(ops[which], left, build_random(ast, size - left_size - 1, rng));
+}
+
+bool same(double a, double b) {
+    return std::memcmp(&a, &b, sizeof a) == 0 || (std::isnan(a) && std::isnan(b));
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const std::size_t nodes = argc > 1 ? static_cast<std::size_t>(std::atol(argv[1])) : 20'000'000;
+    std::mt19937_64 rng(11);
+    const double bindings[] = {0.75, 1.25};
+
+    std::cout << std::setw(10) << "nodes" << std::setw(14) << "virtual ns" << std::setw(14) << "variant ns"
+              << std::setw(14) << "arena ns" << std::setw(14) << "bytecode ns" << std::setw(18) << "virtual/arena\n";
+
+    for (std::size_t size : {11, 101, 1'001, 10'001, 100'001, 1'000'001}) {
+        Ast ast(false);
+        ast.reserve(size);
+        ast.set_root(build_random(ast, size, rng));
+
+        std::unique_ptr<VirtualNode> open_tree = to_virtual(ast, ast.get_root());
+        VariantTree variant_tree = to_variant(ast);
+        CompiledExpression compiled(ast);
+        Node root = ast.root();
+
+        double expected = open_tree->evaluate(bindings);
+        if (!same(variant_tree.evaluate(variant_tree.root, bindings), expected) ||
+            !same(root.evaluate(bindings), expected) || !same(compiled.evaluate(bindings), expected)) {
+            std::cerr << size << " nodes: representations disagree\n";
+            return 1;
+        }
+
+        std::size_t iterations = std::max<std::size_t>(3, nodes / size);
+        double virtual_ns = measure_ns_per_op(iterations, [&] { do_not_optimize(open_tree->evaluate(bindings)); });
+        double variant_ns = measure_ns_per_op(iterations, [&] {
+            do_not_optimize(variant_tree.evaluate(variant_tree.root, bindings));
+        });
+        double arena_ns = measure_ns_per_op(iterations, [&] { do_not_optimize(root.evaluate(bindings)); });
+        double vm_ns = measure_ns_per_op(iterations, [&] { do_not_optimize(compiled.evaluate(bindings)); });
+
+        std::cout << std::setw(10) << ast.size() << std::fixed << std::setprecision(0) << std::setw(14) << virtual_ns
+                  << std::setw(14) << variant_ns << std::setw(14) << arena_ns << std::setw(14) << vm_ns
+                  << std::setprecision(2) << std::setw(16) << virtual_ns / arena_ns << "x\n";
+    }
+
+    // A flat chain is as deep as it is long; the switch must not recurse that far.
+    const Ast chain = parse_tree(make_deep_expression(1'000'000), false);
+    if (!same(chain.root().evaluate(bindings), CompiledExpression(chain).evaluate(bindings))) {
+        std::cerr << "1000000-term chain: tree and bytecode disagree\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,184 @@
+// Error-heavy input: throughput of ExpressionCache over lines of which a given share
+// fail (syntax errors, unbound variables, division by zero), through the throwing
+// evaluate_exact() with a try/catch per line, the same plus the stack trace the REPL
+// used to print on every error, and the exception-free try_evaluate_exact(). Checks
+// that both paths agree on every line, that errors carry the right code and offset,
+// and that the Result path does not allocate once warm. Exits non-zero on a mismatch.
+//   ./build/calculator_error_bench [lines] [iterations]     (defaults 1000, 200)
+#include <string>
+#include "stack_trace.cpp"
+#include "allocation_counter.h"
+#include "bench_common.h"
+#include "expression_cache.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <vector>
+
+namespace {
+
+// `error_percent` of the lines fail, in equal parts each way.
+std::vector<std::string> make_lines(std::size_t count, int error_percent, std::mt19937_64& rng) {
+    std::vector<std::string> lines;
+    for (std::size_t i = 0; i < count; ++i) {
+        std::string a = std::to_string(rng() % 1000);
+        std::string b = std::to_string(rng() % 100 + 1);
+        if (static_cast<int>(rng() % 100) >= error_percent) {
+            lines.push_back("(" + a + " * 1.5 + sqrt(" + b + ")) / " + b + " - 3^2");
+            continue;
+        }
+        switch (rng() % 4) {
+            case 0: lines.push_back("(" + a + " * 1.5 + sqrt(" + b + ")) / (" + b + " - " + b + ")"); break;
+            case 1: lines.push_back("(" + a + " * 1.5 + sqrt(" + b + ")) / rate"); break;
+            case 2: lines.push_back("(" + a + " * 1.5 + sqrt(" + b + ") / " + b); break;
+            default: lines.push_back(a + " * * " + b); break;
+        }
+    }
+    return lines;
+}
+
+// What a front end prints for a line, either way (less the error message).
+std::string answer_with_exceptions(ExpressionCache& cache, const std::string& line) {
+    std::string out;
+    try {
+        append_result(out, cache.evaluate_exact(line));
+    } catch (const std::exception&) {
+        out = "Error";
+    }
+    return out;
+}
+
+std::string answer_with_result(ExpressionCache& cache, const std::string& line) {
+    std::string out;
+    if (Result<ExactValue> result = cache.try_evaluate_exact(line)) {
+        append_result(out, *result);
+    } else {
+        out = "Error";
+    }
+    return out;
+}
+
+// The measured loops: what a front end does before formatting its answer.
+std::size_t run_with_exceptions(ExpressionCache& cache, const std::vector<std::string>& lines, bool trace) {
+    std::size_t sink = 0;
+    for (const std::string& line : lines) {
+        try {
+            sink += cache.evaluate_exact(line).is_integer;
+        } catch (const std::exception& e) {
+            sink += std::string_view(e.what()).size();
+            if (trace) {
+                print_stack_trace();
+            }
+        }
+    }
+    return sink;
+}
+
+std::size_t run_with_results(ExpressionCache& cache, const std::vector<std::string>& lines) {
+    std::size_t sink = 0;
+    for (const std::string& line : lines) {
+        if (Result<ExactValue> result = cache.try_evaluate_exact(line)) {
+            sink += result->is_integer;
+        } else {
+            sink += static_cast<std::size_t>(result.error().code);
+        }
+    }
+    return sink;
+}
+
+bool check_error(ExpressionCache& cache, std::string_view line, ErrorCode code, std::uint32_t offset) {
+    Result<ExactValue> result = cache.try_evaluate_exact(line);
+    if (result || result.error().code != code || result.error().offset != offset) {
+        std::cerr << "'" << line << "': got " << (result ? "a value" : describe(result.error())) << ", expected "
+                  << describe({code, offset}) << "\n";
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const std::size_t count = argc > 1 ? static_cast<std::size_t>(std::atol(argv[1])) : 1000;
+    const std::size_t iterations = argc > 2 ? static_cast<std::size_t>(std::atol(argv[2])) : 200;
+
+    // Offsets point at the '/' with the zero divisor, the first unbound variable, or
+    // the token the parser stopped at; the cache's normalization must not shift them.
+    ExpressionCache cache;
+    bool ok = check_error(cache, "1 / (2 - 2)", ErrorCode::DivisionByZero, 2) &&
+              check_error(cache, "1/(2-2)", ErrorCode::DivisionByZero, 1) &&
+              check_error(cache, "x / 2 + 3 / (x - x)", ErrorCode::UnboundVariable, 0) &&
+              check_error(cache, "4 / 2 + 3 / (1 - 1) / 0", ErrorCode::DivisionByZero, 10) &&
+              check_error(cache, "2 * (rate + tax)", ErrorCode::UnboundVariable, 5) &&
+              check_error(cache, "(1 + 2", ErrorCode::ExpectedClosingParen, 6) &&
+              check_error(cache, "3 * * 4", ErrorCode::ExpectedOperand, 4) &&
+              check_error(cache, "sqrt(1, 2)", ErrorCode::WrongArgumentCount, 0);
+    const double bound[] = {4.0};
+    Result<ExactValue> bound_division = cache.try_evaluate_exact("x / (x - 4)", bound);
+    if (bound_division || bound_division.error().code != ErrorCode::DivisionByZero ||
+        bound_division.error().offset != 2) {
+        std::cerr << "'x / (x - 4)' with x = 4: expected Division by zero at offset 2\n";
+        ok = false;
+    }
+    if (!ok) {
+        return 1;
+    }
+
+    // Stack traces go to a discarded stream: only producing them is measured.
+    std::ostringstream discarded;
+    std::streambuf* stderr_buffer = std::cerr.rdbuf(discarded.rdbuf());
+    std::mt19937_64 rng(20);
+    const std::size_t traced_iterations = std::max<std::size_t>(1, iterations / 100);
+    std::cout << count << " distinct lines, each evaluated " << iterations << " times (with stack traces: "
+              << traced_iterations << " times), ns/line\n"
+              << std::setw(8) << "errors" << std::setw(14) << "exceptions" << std::setw(14) << "+ traces"
+              << std::setw(14) << "Result" << std::setw(14) << "speedup" << std::setw(14) << "allocs/line\n"
+              << std::fixed;
+    for (int error_percent : {0, 10, 50, 100}) {
+        const std::vector<std::string> lines = make_lines(count, error_percent, rng);
+        ExpressionCache throwing;
+        ExpressionCache traced;
+        ExpressionCache returning;
+        // Warm every cache, and check that both paths agree line by line.
+        for (const std::string& line : lines) {
+            std::string expected = answer_with_exceptions(throwing, line);
+            (void)answer_with_exceptions(traced, line);
+            if (answer_with_result(returning, line) != expected) {
+                std::cerr.rdbuf(stderr_buffer);
+                std::cerr << "'" << line << "': the paths disagree\n";
+                return 1;
+            }
+        }
+
+        std::size_t sink = 0;
+        const double lines_run = static_cast<double>(count * iterations);
+        double exceptions = measure_ns_per_op(iterations, [&] { sink += run_with_exceptions(throwing, lines, false); }) /
+                            static_cast<double>(count);
+        double traces = measure_ns_per_op(traced_iterations, [&] {
+            sink += run_with_exceptions(traced, lines, true);
+            discarded.str({});
+        }) / static_cast<double>(count);
+        const std::size_t before = allocations;
+        double results = measure_ns_per_op(iterations, [&] { sink += run_with_results(returning, lines); }) /
+                         static_cast<double>(count);
+        const double result_allocations = static_cast<double>(allocations - before) / lines_run;
+        do_not_optimize(static_cast<double>(sink));
+
+        std::cout << std::setw(7) << error_percent << "%" << std::setprecision(0) << std::setw(14) << exceptions
+                  << std::setw(14) << traces << std::setw(14) << results
+                  << std::setprecision(1) << std::setw(13) << exceptions / results << "x" << std::setprecision(3)
+                  << std::setw(13) << result_allocations << "\n";
+        if (result_allocations != 0.0) {
+            std::cerr.rdbuf(stderr_buffer);
+            std::cerr << "the Result path allocates\n";
+            return 1;
+        }
+    }
+    std::cerr.rdbuf(stderr_buffer);
+    std::cout << "checks passed\n";
+    return 0;
+}
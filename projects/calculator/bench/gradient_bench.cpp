@@ -0,0 +1,159 @@
+// Gradients: finite differences (N + 1 evaluations) against forward-mode automatic
+// differentiation, one dual-number pass per variable and one tangent-vector pass for
+// the whole gradient at each SIMD level. The objective has N variables:
+//   f(x) = sum_i w_i (x_i - c_i)^2 + sin(x_i x_{i+1})      (indices wrap around)
+// whose gradient is also computed by hand to check the results.
+//   ./build/calculator_gradient_bench [variables]     (default 64)
+#include "bench_common.h"
+#include "calculator.h"
+#include "gradient.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+double weight(std::size_t i) { return 0.5 + static_cast<double>(i % 7) * 0.25; }
+double center(std::size_t i) { return static_cast<double>(i % 5) - 2.0; }
+
+std::string make_objective(std::size_t n) {
+    std::string source;
+    for (std::size_t i = 0; i < n; ++i) {
+        std::string x = "x" + std::to_string(i);
+        std::string next = "x" + std::to_string((i + 1) % n);
+        source += (i == 0 ? "" : " + ") + std::to_string(weight(i)) + " * (" + x + " - " +
+                  std::to_string(center(i)) + ")^2 + sin(" + x + " * " + next + ")";
+    }
+    return source;
+}
+
+// Largest error relative to max(1, |expected|).
+double max_error(const std::vector<double>& actual, const std::vector<double>& expected) {
+    double worst = 0.0;
+    for (std::size_t i = 0; i < expected.size(); ++i) {
+        worst = std::max(worst, std::abs(actual[i] - expected[i]) / std::max(1.0, std::abs(expected[i])));
+    }
+    return worst;
+}
+
+bool expect_gradient(const char* source, std::vector<double> bindings, std::vector<double> expected) {
+    CompiledExpression expression = parse_expression(source);
+    std::vector<double> gradient(expected.size());
+    (void)expression.evaluate_gradient(bindings, gradient);
+    for (std::size_t i = 0; i < expected.size(); ++i) {
+        if (!(gradient[i] == expected[i])) {
+            std::cerr << source << ": d/d" << expression.get_variables()[i] << " is " << gradient[i] << ", expected "
+                      << expected[i] << "\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const std::size_t n = argc > 1 ? static_cast<std::size_t>(std::atoi(argv[1])) : 64;
+    CompiledExpression objective = parse_expression(make_objective(n));
+    const Ast& ast = objective.get_ast();
+
+    // Bindings in slot order, which is x0, x1, ... by first appearance.
+    std::vector<double> x(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        x[i] = std::sin(static_cast<double>(i) * 1.7) * 1.5;
+    }
+    std::vector<double> expected(n);
+    for (std::size_t j = 0; j < n; ++j) {
+        double next = x[(j + 1) % n];
+        double previous = x[(j + n - 1) % n];
+        expected[j] = 2.0 * weight(j) * (x[j] - center(j)) + std::cos(x[j] * next) * next +
+                      std::cos(previous * x[j]) * previous;
+    }
+
+    std::cout << n << " variables, " << ast.size() << " nodes\n";
+    const std::size_t iterations = std::max<std::size_t>(20, 200000 / (ast.size() * n / 8 + 1));
+
+    // Forward differences, the way an optimizer without derivatives gets a gradient.
+    std::vector<double> finite(n);
+    const double step = 1e-7;
+    double finite_ns = measure_ns_per_op(iterations, [&] {
+        std::vector<double> shifted = x;
+        const double base = objective.evaluate(shifted);
+        for (std::size_t i = 0; i < n; ++i) {
+            shifted[i] += step;
+            finite[i] = (objective.evaluate(shifted) - base) / step;
+            shifted[i] = x[i];
+        }
+    });
+    std::cout << "finite differences: " << std::fixed << std::setprecision(0) << std::setw(10) << finite_ns
+              << " ns/gradient, max error " << std::scientific << std::setprecision(2)
+              << max_error(finite, expected) << "\n";
+
+    // Dual numbers: one pass per partial derivative.
+    std::vector<double> dual(n);
+    std::vector<Dual> seeds(n);
+    double dual_ns = measure_ns_per_op(iterations, [&] {
+        for (std::size_t i = 0; i < n; ++i) {
+            seeds[i] = {x[i], 0.0};
+        }
+        for (std::size_t i = 0; i < n; ++i) {
+            seeds[i].tangent = 1.0;
+            dual[i] = ast.root().evaluate(seeds).tangent;
+            seeds[i].tangent = 0.0;
+        }
+    });
+    std::cout << "dual numbers:       " << std::fixed << std::setprecision(0) << std::setw(10) << dual_ns
+              << " ns/gradient, max error " << std::scientific << std::setprecision(2)
+              << max_error(dual, expected) << "\n";
+    if (max_error(dual, expected) > 1e-12) {
+        std::cerr << "dual-number derivatives disagree with the analytic gradient\n";
+        return 1;
+    }
+
+    // Tangent vectors: the whole gradient in one pass, SIMD across the lanes.
+    const double value = objective.evaluate(x);
+    for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2}) {
+        if (level > detect_simd_level()) {
+            continue;
+        }
+        std::vector<double> gradient(n);
+        double result = 0.0;
+        double ns = measure_ns_per_op(iterations, [&] {
+            result = evaluate_gradient(ast, ast.get_root(), x, gradient, level);
+            do_not_optimize(result);
+        });
+        std::cout << "gradient (" << std::setw(6) << to_string(level) << "):  " << std::fixed << std::setprecision(0)
+                  << std::setw(10) << ns << " ns/gradient, max error " << std::scientific << std::setprecision(2)
+                  << max_error(gradient, expected) << std::fixed << std::setprecision(1) << "  ("
+                  << finite_ns / ns << "x faster than finite differences)\n";
+        if (result != value || gradient != dual) {
+            std::cerr << "gradient at " << to_string(level) << " differs from the value or the dual passes\n";
+            return 1;
+        }
+    }
+
+    // Derivatives where the operations are not smooth, and errors.
+    bool ok = expect_gradient("x^2 + y^3", {-1.0, 2.0}, {-2.0, 12.0}) &&
+              expect_gradient("x^y", {2.0, 3.0}, {12.0, 8.0 * std::log(2.0)}) &&
+              expect_gradient("x * x / y", {3.0, 2.0}, {3.0, -2.25}) &&
+              expect_gradient("abs(x) + min(x, y) + max(x, 2)", {-1.0, -1.0}, {-1.0, 1.0}) &&
+              expect_gradient("sqrt(x) + exp(y) + log(x)", {4.0, 0.0}, {0.5, 1.0}) &&
+              expect_gradient("-cos(x) * 2 + 3", {0.0}, {0.0});
+    try {
+        std::vector<double> gradient(2);
+        (void)parse_expression("x / (y - 1)").evaluate_gradient(std::vector<double>{1.0, 1.0}, gradient);
+        std::cerr << "division by zero was not reported\n";
+        ok = false;
+    } catch (const std::runtime_error&) {
+    }
+    if (!ok) {
+        return 1;
+    }
+    std::cout << "checks passed\n";
+    return 0;
+}
@@ -0,0 +1,103 @@
+// Exact int64 path versus the all-double path on integer-only formulas.
+//   double    - the double bytecode program on the double VM
+//   int64     - the integer program on IntegerMachine (overflow-checked)
+//   evaluate  - CompiledExpression::evaluate(), which tries int64 and falls back
+//   fallback  - evaluate() with a fractional binding, so every call falls back
+//   ./build/calculator_integer_bench [instructions]     (default 20000000 timed per case and way)
+#include "bench_common.h"
+#include "calculator.h"
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+namespace {
+
+// "x + 3 * y - 5 * x + ..." with `terms` terms: a long chain whose values stay small.
+std::string make_integer_chain(std::size_t terms) {
+    static const char ops[] = {'+', '-'};
+    std::string expression = "x";
+    for (std::size_t i = 1; i < terms; ++i) {
+        expression += ' ';
+        expression += ops[i % 2];
+        expression += ' ';
+        expression += std::to_string(i % 9 + 1);
+        expression += i % 3 == 0 ? " * y" : i % 3 == 1 ? " * x" : "";
+    }
+    return expression;
+}
+
+// Balanced tree of + and -, with products just above the leaves.
+std::string make_integer_tree(std::size_t depth, std::size_t seed = 0) {
+    if (depth == 0) {
+        return seed % 3 == 0 ? "x" : seed % 3 == 1 ? "y" : std::to_string(seed % 9 + 1);
+    }
+    char op = depth == 1 ? '*' : (seed + depth) % 2 ? '-' : '+';
+    return "(" + make_integer_tree(depth - 1, seed * 2 + 1) + ' ' + op + ' ' +
+           make_integer_tree(depth - 1, seed * 2 + 2) + ")";
+}
+
+void run_case(const std::string& name, const std::string& source, std::size_t instructions) {
+    CompiledExpression expression = parse_expression(source);
+    if (!expression.get_integer_program()) {
+        std::cerr << name << ": expected an integer program\n";
+        std::exit(1);
+    }
+    const Program& program = expression.get_program();
+    const IntegerProgram& integer_program = *expression.get_integer_program();
+    VirtualMachine vm;
+    IntegerMachine machine;
+    const double bindings[] = {7.0, -3.0};
+    const double fractional[] = {7.5, -3.0};
+
+    auto exact = machine.run(integer_program, bindings);
+    if (!exact || static_cast<double>(*exact) != vm.run(program, bindings)) {
+        std::cerr << name << ": int64 and double paths disagree\n";
+        std::exit(1);
+    }
+
+    std::size_t iterations = std::max<std::size_t>(1, instructions / (program.code.size() + 1));
+    double double_ns = measure_ns_per_op(iterations, [&] { do_not_optimize(vm.run(program, bindings)); });
+    double int_ns = measure_ns_per_op(iterations, [&] {
+        do_not_optimize(static_cast<double>(*machine.run(integer_program, bindings)));
+    });
+    double evaluate_ns = measure_ns_per_op(iterations, [&] { do_not_optimize(expression.evaluate(bindings)); });
+    double fallback_ns = measure_ns_per_op(iterations, [&] { do_not_optimize(expression.evaluate(fractional)); });
+
+    std::cout << std::left << std::setw(12) << name << std::right << std::setw(8) << program.code.size()
+              << std::fixed << std::setprecision(1) << std::setw(12) << double_ns << std::setw(12) << int_ns
+              << std::setw(12) << evaluate_ns << std::setw(12) << fallback_ns << std::setprecision(2)
+              << std::setw(10) << double_ns / int_ns << "x\n";
+}
+
+// Above 2^53 the double path rounds at every step; the int64 path does not.
+bool check_exactness() {
+    CompiledExpression expression = parse_expression("(x + 1) - x");
+    const double bindings[] = {9007199254740992.0};  // 2^53
+    ExactValue result = expression.evaluate_exact(bindings);
+    VirtualMachine vm;
+    std::cout << "exactness: (x + 1) - x at x = 2^53: int64 " << result.integer << ", double "
+              << std::defaultfloat << vm.run(expression.get_program(), bindings) << "\n";
+    return result.is_integer && result.integer == 1;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const std::size_t instructions = argc > 1 ? static_cast<std::size_t>(std::atol(argv[1])) : 20'000'000;
+    std::cout << std::left << std::setw(12) << "case" << std::right << std::setw(8) << "ops" << std::setw(12)
+              << "double ns" << std::setw(12) << "int64 ns" << std::setw(12) << "evaluate ns" << std::setw(12)
+              << "fallback ns" << std::setw(11) << "speedup\n";
+    for (std::size_t terms : {4, 16, 256, 4096}) {
+        run_case("chain/" + std::to_string(terms), make_integer_chain(terms), instructions);
+    }
+    for (std::size_t depth : {3, 6, 10, 13}) {
+        run_case("tree/" + std::to_string(depth), make_integer_tree(depth), instructions);
+    }
+    if (!check_exactness()) {
+        std::cerr << "int64 path is not exact\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,142 @@
+// Native code versus the interpreters, plus a differential check of the JIT against
+// the bytecode VM on random expression trees.
+//   ./build/calculator_jit_bench [random_trees]
+#include "bench_common.h"
+#include "calculator.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <type_traits>
+
+namespace {
+
+// Random expression over x, y, z with every operator and a few built-ins. Small
+// literals (including 0) make division by zero, NaN and infinities reachable.
+std::string random_expression(std::mt19937_64& rng, int depth) {
+    std::uniform_int_distribution<int> pick(0, 99);
+    int choice = pick(rng);
+    if (depth == 0 || choice < 25) {
+        static const char* leaves[] = {"x", "y", "z", "0", "1", "2", "0.5", "3.25", "1e300"};
+        return leaves[pick(rng) % 9];
+    }
+    if (choice < 32) {
+        return "-" + random_expression(rng, depth - 1);
+    }
+    if (choice < 40) {
+        static const char* unary[] = {"sqrt", "exp", "log", "abs", "sin", "cos"};
+        return std::string(unary[pick(rng) % 6]) + "(" + random_expression(rng, depth - 1) + ")";
+    }
+    if (choice < 45) {
+        static const char* binary[] = {"pow", "min", "max"};
+        return std::string(binary[pick(rng) % 3]) + "(" + random_expression(rng, depth - 1) + ", " +
+               random_expression(rng, depth - 1) + ")";
+    }
+    static const char ops[] = {'+', '-', '*', '/', '^'};
+    return "(" + random_expression(rng, depth - 1) + ' ' + ops[pick(rng) % 5] + ' ' +
+           random_expression(rng, depth - 1) + ")";
+}
+
+bool same_outcome(const Program& program, const JitFunction& native, std::span<const double> bindings) {
+    VirtualMachine vm;
+    double expected = 0.0;
+    double actual = 0.0;
+    bool vm_threw = false;
+    bool jit_threw = false;
+    try { expected = vm.run(program, bindings); } catch (const std::runtime_error&) { vm_threw = true; }
+    try { actual = native.run(bindings); } catch (const std::runtime_error&) { jit_threw = true; }
+    if (vm_threw || jit_threw) {
+        return vm_threw == jit_threw;
+    }
+    return std::memcmp(&expected, &actual, sizeof expected) == 0 || (std::isnan(expected) && std::isnan(actual));
+}
+
+// JIT against VM on `count` random trees, unshared and hash-consed + simplified.
+bool differential_check(std::size_t count) {
+    std::mt19937_64 rng(14);
+    std::uniform_real_distribution<double> value(-4.0, 4.0);
+    for (std::size_t i = 0; i < count; ++i) {
+        std::string source = random_expression(rng, 1 + static_cast<int>(i % 8));
+        Program unshared = compile(parse_tree(source, false));
+        Program shared = parse_expression(source).get_program();
+        JitFunction native_unshared(unshared);
+        JitFunction native_shared(shared);
+        for (int round = 0; round < 4; ++round) {
+            const double bindings[] = {value(rng), round == 0 ? 0.0 : value(rng), value(rng)};
+            if (!same_outcome(unshared, native_unshared, bindings) || !same_outcome(shared, native_shared, bindings)) {
+                std::cerr << "JIT and interpreter disagree on " << source << " at x=" << bindings[0]
+                          << " y=" << bindings[1] << " z=" << bindings[2] << "\n";
+                return false;
+            }
+        }
+    }
+    std::cout << "differential check: " << count << " random trees, JIT matches the interpreter\n";
+    return true;
+}
+
+template <typename HandWritten>
+void run_case(const std::string& name, const std::string& source, HandWritten hand_written) {
+    CompiledExpression expression = parse_expression(source);
+    const Program& program = expression.get_program();
+    JitFunction native(program);
+    VirtualMachine vm;
+    const double bindings[] = {1.25, -0.5, 3.0};
+    std::span<const double> bound(bindings, expression.num_slots());
+
+    std::size_t iterations = std::max<std::size_t>(1000, 20'000'000 / (program.code.size() + 1));
+    double vm_ns = measure_ns_per_op(iterations, [&] { do_not_optimize(vm.run(program, bound)); });
+    double jit_ns = measure_ns_per_op(iterations, [&] { do_not_optimize(native.run(bound)); });
+    // Cold: the first kJitThreshold evaluations run interpreted, then native code.
+    double evaluate_ns = measure_ns_per_op(iterations, [&] { do_not_optimize(expression.evaluate(bound)); });
+    double cpp_ns = 0.0;
+    if constexpr (!std::is_same_v<HandWritten, std::nullptr_t>) {
+        cpp_ns = measure_ns_per_op(iterations, [&] { do_not_optimize(hand_written(bindings)); });
+    }
+    if (!expression.get_native() && !expression.get_integer_program()) {
+        std::cerr << name << ": expression never became hot\n";
+        std::exit(1);
+    }
+
+    std::cout << std::left << std::setw(12) << name << std::right << std::setw(6) << program.code.size() << std::fixed
+              << std::setprecision(1) << std::setw(10) << vm_ns << std::setw(10) << jit_ns << std::setw(12)
+              << evaluate_ns << std::setw(10) << cpp_ns << std::setw(10) << native.code_size() << "\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::size_t trees = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 20000;
+    if (!differential_check(trees)) {
+        return 1;
+    }
+
+    std::cout << std::left << std::setw(12) << "case" << std::right << std::setw(6) << "ops" << std::setw(10)
+              << "vm ns" << std::setw(10) << "jit ns" << std::setw(12) << "evaluate ns" << std::setw(10) << "c++ ns"
+              << std::setw(10) << "bytes" << "\n";
+    run_case("poly", "3.5*x*x*x - 2*x*x + 0.25*x - 7", [](const double* b) {
+        double x = b[0];
+        return 3.5 * x * x * x - 2 * x * x + 0.25 * x - 7;
+    });
+    run_case("distance", "sqrt((x - y)^2 + (y - z)^2)", [](const double* b) {
+        return std::sqrt(std::pow(b[0] - b[1], 2) + std::pow(b[1] - b[2], 2));
+    });
+    run_case("rational", "(x*y + 1.5) / (z - x*y) - (x + 0.5) / (y*y + 1.5)", [](const double* b) {
+        double x = b[0], y = b[1], z = b[2];
+        double d1 = z - x * y;
+        double d2 = y * y + 1.5;
+        if (d1 == 0.0 || d2 == 0.0) throw std::runtime_error("Division by zero!");
+        return (x * y + 1.5) / d1 - (x + 0.5) / d2;
+    });
+    // No hand-written version of the long chain (c++ column is 0).
+    std::string chain = "x";
+    for (int i = 1; i < 1024; ++i) {
+        chain += i % 3 == 0 ? " - y * " : i % 3 == 1 ? " + x * " : " * 0.5 + z / ";
+        chain += std::to_string(i % 7 + 1);
+    }
+    run_case("chain/1024", chain, nullptr);
+    return 0;
+}
@@ -0,0 +1,97 @@
+// Tokenizer throughput versus the old std::string + std::stod scanning loop, plus an
+// allocation check: once buffers are warm, tokenize() and parse_tree() into a reused
+// Ast must not touch the heap. Exits non-zero if they do.
+//   ./build/calculator_lexer_bench [bytes]     (default 20000000 timed per input and way)
+#include "allocation_counter.h"
+#include "bench_common.h"
+#include "expression.h"
+#include "lexer.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+// The scanning loop parse_expression used before the tokenizer existed.
+double legacy_scan(const std::string& expression) {
+    double sum = 0.0;
+    for (std::size_t i = 0; i < expression.length(); ++i) {
+        if (isdigit(expression[i])) {
+            std::string num_str;
+            while (i < expression.length() && (isdigit(expression[i]) || expression[i] == '.')) {
+                num_str += expression[i];
+                i++;
+            }
+            i--;
+            sum += std::stod(num_str);
+        }
+    }
+    return sum;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const std::size_t bytes = argc > 1 ? static_cast<std::size_t>(std::atol(argv[1])) : 20'000'000;
+    const std::string sources[] = {
+        "2 + 3 * (4 - 1)",
+        "price * 1.0825 + shipping - discount / 100",
+        "6.02214076e23 * moles / (1.5E-3 + volume) - .5",
+        make_deep_expression(256),
+        make_wide_expression(8),
+    };
+
+    std::vector<Token> tokens;
+    Ast ast;
+    int failures = 0;
+    std::cout << std::left << std::setw(14) << "input" << std::right << std::setw(8) << "bytes"
+              << std::setw(14) << "stod MB/s" << std::setw(14) << "lexer MB/s" << std::setw(14) << "parse MB/s"
+              << std::setw(14) << "allocs/parse" << "\n";
+
+    for (const std::string& source : sources) {
+        // Warm the reusable buffers, then count.
+        tokenize(source, tokens);
+        if (Error error = parse_tree(source, ast)) {
+            std::cerr << describe(error) << "\n";
+            return 1;
+        }
+        std::size_t before = allocations;
+        constexpr int kCheckedRuns = 1000;
+        for (int i = 0; i < kCheckedRuns; ++i) {
+            tokenize(source, tokens);
+            (void)parse_tree(source, ast);
+        }
+        double allocs_per_parse = static_cast<double>(allocations - before) / kCheckedRuns;
+        if (allocs_per_parse != 0.0) {
+            ++failures;
+        }
+
+        std::size_t iterations = std::max<std::size_t>(1, bytes / source.size());
+        auto mb_per_s = [&](double ns) { return static_cast<double>(source.size()) / ns * 1e3; };
+        double stod_ns = measure_ns_per_op(iterations, [&] { do_not_optimize(legacy_scan(source)); });
+        double lex_ns = measure_ns_per_op(iterations, [&] {
+            tokenize(source, tokens);
+            do_not_optimize(static_cast<double>(tokens.size()));
+        });
+        double parse_ns = measure_ns_per_op(iterations, [&] {
+            (void)parse_tree(source, ast);
+            do_not_optimize(static_cast<double>(ast.size()));
+        });
+
+        std::cout << std::left << std::setw(14) << source.substr(0, 12) << std::right << std::setw(8) << source.size()
+                  << std::fixed << std::setprecision(1) << std::setw(14) << mb_per_s(stod_ns)
+                  << std::setw(14) << mb_per_s(lex_ns) << std::setw(14) << mb_per_s(parse_ns)
+                  << std::setw(14) << allocs_per_parse << "\n";
+    }
+
+    if (failures != 0) {
+        std::cerr << failures << " input(s) allocated on a warm parse\n";
+        return 1;
+    }
+    return 0;
+}
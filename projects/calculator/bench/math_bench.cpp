@@ -0,0 +1,180 @@
+// Built-in functions in batch mode: accuracy of each vectorized kernel against the
+// scalar libm version (max error in ulps over random and special inputs), then
+// throughput per function for every kernel set. Exits non-zero if any kernel is
+// outside its documented bound (see src/batch_math.h).
+//   ./build/calculator_math_bench [rows]     (default 1000000)
+#include "batch.h"
+#include "bench_common.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Distance between two doubles in units in the last place. Two NaNs agree; a NaN
+// against a number, or zeros of different sign, count as infinitely far apart.
+double ulp_distance(double a, double b) {
+    if (std::isnan(a) || std::isnan(b)) {
+        return std::isnan(a) && std::isnan(b) ? 0.0 : std::numeric_limits<double>::infinity();
+    }
+    if (a == 0.0 && b == 0.0 && std::signbit(a) != std::signbit(b)) {
+        return std::numeric_limits<double>::infinity();
+    }
+    // Map the bit patterns onto a line where adjacent doubles are adjacent integers.
+    auto ordered = [](double v) {
+        auto bits = std::bit_cast<std::int64_t>(v);
+        return bits < 0 ? std::numeric_limits<std::int64_t>::min() - bits : bits;
+    };
+    std::int64_t lo = std::min(ordered(a), ordered(b));
+    std::int64_t hi = std::max(ordered(a), ordered(b));
+    return static_cast<double>(static_cast<std::uint64_t>(hi) - static_cast<std::uint64_t>(lo));
+}
+
+struct Case {
+    std::string source;
+    double max_ulps = 0.0;
+    std::vector<double> x = {};
+    std::vector<double> y = {};
+};
+
+constexpr double kInf = std::numeric_limits<double>::infinity();
+constexpr double kNaN = std::numeric_limits<double>::quiet_NaN();
+const double kSpecials[] = {0.0,  -0.0, kInf, -kInf, kNaN, 1.0,  -1.0, 0.5, 2.0, -2.0, 3.0, -3.0,
+                            1e-310, -1e-310, 0x1p-1022, 0x1p-1074, std::numeric_limits<double>::max(),
+                            -std::numeric_limits<double>::max(), 709.78, -745.1, 1e6, 1e300};
+
+// Every double pattern is equally likely, so all exponents (and NaNs) show up.
+double random_bits(std::mt19937_64& rng) {
+    return std::bit_cast<double>(rng());
+}
+
+double log_uniform(std::mt19937_64& rng, double lo_exp, double hi_exp) {
+    return std::exp2(std::uniform_real_distribution<double>(lo_exp, hi_exp)(rng));
+}
+
+// `rows` inputs per function: mostly from the range each function is used on, plus
+// every pairing of special values.
+std::vector<Case> make_cases(std::size_t rows) {
+    std::mt19937_64 rng(7);
+    auto uniform = [&](double lo, double hi) { return std::uniform_real_distribution<double>(lo, hi)(rng); };
+    std::vector<Case> cases = {
+        {"sqrt(x)", 0}, {"exp(x)", 1}, {"log(x)", 1},    {"abs(x)", 0},   {"sin(x)", 1},
+        {"cos(x)", 1},  {"pow(x, y)", 1}, {"x ^ y", 1}, {"min(x, y)", 0}, {"max(x, y)", 0},
+    };
+    for (Case& c : cases) {
+        for (double a : kSpecials) {
+            for (double b : kSpecials) {
+                c.x.push_back(a);
+                c.y.push_back(b);
+            }
+        }
+        while (c.x.size() < rows) {
+            const std::size_t i = c.x.size();
+            double x = 0.0;
+            double y = 0.0;
+            if (c.source == "sqrt(x)" || c.source == "abs(x)") {
+                x = random_bits(rng);
+            } else if (c.source == "exp(x)") {
+                x = i % 2 ? uniform(-750.0, 750.0) : uniform(-1.0, 1.0);
+            } else if (c.source == "log(x)") {
+                x = i % 2 ? std::fabs(random_bits(rng)) : uniform(0.5, 2.0);
+            } else if (c.source == "sin(x)" || c.source == "cos(x)") {
+                x = i % 3 == 0 ? uniform(-1e6, 1e6) : uniform(-10.0, 10.0);
+            } else if (c.source == "min(x, y)" || c.source == "max(x, y)") {
+                x = random_bits(rng);
+                y = i % 4 ? random_bits(rng) : -x;
+            } else if (i % 3 == 0) {
+                // pow with a negative base and an integral exponent.
+                x = -log_uniform(rng, -20.0, 20.0);
+                y = std::round(uniform(-40.0, 40.0));
+            } else if (i % 3 == 1) {
+                x = uniform(0.99, 1.01);
+                y = uniform(-5e4, 5e4);
+            } else {
+                x = log_uniform(rng, -30.0, 30.0);
+                y = uniform(-30.0, 30.0);
+            }
+            c.x.push_back(x);
+            c.y.push_back(y);
+        }
+    }
+    return cases;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::size_t rows = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1'000'000;
+    std::vector<Case> cases = make_cases(rows);
+    const SimdLevel levels[] = {SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2};
+    bool ok = true;
+
+    std::cout << "detected: " << to_string(detect_simd_level()) << ", " << rows << " rows per function\n\n"
+              << std::setw(12) << "function" << std::setw(10) << "bound" << std::setw(10) << "sse2"
+              << std::setw(10) << "avx2" << "   (max ulps against libm)\n";
+    std::vector<double> reference;
+    std::vector<double> out;
+    for (const Case& c : cases) {
+        CompiledExpression expression = parse_expression(c.source);
+        std::span<const double> columns[] = {c.x, c.y};
+        reference.assign(c.x.size(), 0.0);
+        out.assign(c.x.size(), 0.0);
+        evaluate_batch(expression, columns, reference, SimdLevel::Scalar);
+
+        std::cout << std::setw(12) << c.source << std::setw(10) << c.max_ulps;
+        for (SimdLevel level : {SimdLevel::SSE2, SimdLevel::AVX2}) {
+            if (level > detect_simd_level()) {
+                std::cout << std::setw(10) << "n/a";
+                continue;
+            }
+            evaluate_batch(expression, columns, out, level);
+            double worst = 0.0;
+            std::size_t worst_row = 0;
+            for (std::size_t i = 0; i < out.size(); ++i) {
+                double d = ulp_distance(out[i], reference[i]);
+                if (d > worst) {
+                    worst = d;
+                    worst_row = i;
+                }
+            }
+            std::cout << std::setw(10) << worst;
+            if (worst > c.max_ulps) {
+                std::cerr << "\n" << c.source << " at " << to_string(level) << ": x=" << std::hexfloat << c.x[worst_row]
+                          << " y=" << c.y[worst_row] << " gives " << out[worst_row] << ", libm "
+                          << reference[worst_row] << std::defaultfloat << "\n";
+                ok = false;
+            }
+        }
+        std::cout << "\n";
+    }
+
+    std::cout << "\n" << std::setw(12) << "function" << std::setw(10) << "scalar" << std::setw(10) << "sse2"
+              << std::setw(10) << "avx2" << "   (ns/row)\n";
+    for (const Case& c : cases) {
+        CompiledExpression expression = parse_expression(c.source);
+        std::span<const double> columns[] = {c.x, c.y};
+        out.assign(c.x.size(), 0.0);
+        std::cout << std::setw(12) << c.source;
+        for (SimdLevel level : levels) {
+            if (level > detect_simd_level()) {
+                std::cout << std::setw(10) << "n/a";
+                continue;
+            }
+            double s = seconds_per_call([&] { evaluate_batch(expression, columns, out, level); });
+            do_not_optimize(out[0]);
+            std::cout << std::setw(10) << std::fixed << std::setprecision(2) << s / c.x.size() * 1e9
+                      << std::defaultfloat;
+        }
+        std::cout << "\n";
+    }
+    return ok ? 0 : 1;
+}
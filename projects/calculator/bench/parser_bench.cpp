@@ -0,0 +1,111 @@
+// Parse throughput (expressions/sec) of the Pratt parser against the two-stack
+// shunting-yard parser it replaced. The corpus sticks to the old grammar
+// (+ - * / and parentheses) so both parsers build the same trees.
+//   ./build/calculator_parser_bench [bytes]     (default 20000000 timed per input and way)
+#include "bench_common.h"
+#include "expression.h"
+#include "lexer.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+// The shunting-yard parser as it was before the Pratt rewrite (minus error handling,
+// which it never had).
+void legacy_parse(std::string_view expression, Ast& ast) {
+    thread_local std::vector<Token> tokens;
+    thread_local std::vector<std::uint32_t> values;
+    thread_local std::vector<char> ops;
+    static const OperatorPrecedence get_precedence;
+
+    tokenize(expression, tokens);
+    values.clear();
+    ops.clear();
+    ast.clear();
+    ast.reserve(tokens.size());
+
+    auto reduce = [&] {
+        char op = ops.back();
+        ops.pop_back();
+        std::uint32_t right = values.back();
+        values.pop_back();
+        std::uint32_t left = values.back();
+        values.pop_back();
+        values.push_back(ast.add_operation(op, left, right));
+    };
+    for (const Token& token : tokens) {
+        switch (token.kind) {
+            case TokenKind::Number: values.push_back(ast.add_number(token.value)); break;
+            case TokenKind::Identifier: values.push_back(ast.add_variable(token.text(expression))); break;
+            case TokenKind::LeftParen: ops.push_back('('); break;
+            case TokenKind::RightParen:
+                while (!ops.empty() && ops.back() != '(') reduce();
+                if (!ops.empty()) ops.pop_back();
+                break;
+            case TokenKind::Operator:
+                while (!ops.empty() && ops.back() != '(' && get_precedence(ops.back()) >= get_precedence(token.op)) {
+                    reduce();
+                }
+                ops.push_back(token.op);
+                break;
+            default: break;
+        }
+    }
+    while (!ops.empty()) reduce();
+    ast.set_root(values.back());
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const std::size_t bytes = argc > 1 ? static_cast<std::size_t>(std::atol(argv[1])) : 20'000'000;
+    const std::vector<std::pair<std::string, std::string>> corpus = {
+        {"small", "2 + 3 * (4 - 1)"},
+        {"pricing", "price * qty * (1 + tax_rate) - discount / 100 + shipping"},
+        {"nested", "((a + b) * (c - d)) / ((e + f) * (g - h) + 1.5e3)"},
+        {"deep/256", make_deep_expression(256)},
+        {"wide/8", make_wide_expression(8)},
+    };
+
+    std::cout << std::left << std::setw(10) << "input" << std::right << std::setw(10) << "tokens"
+              << std::setw(18) << "shunting expr/s" << std::setw(16) << "pratt expr/s" << std::setw(10) << "speedup\n";
+
+    Ast legacy_ast;
+    Ast pratt_ast;
+    std::vector<Token> tokens;
+    for (const auto& [name, source] : corpus) {
+        legacy_parse(source, legacy_ast);
+        if (Error error = parse_tree(source, pratt_ast)) {
+            std::cerr << name << ": " << describe(error) << "\n";
+            return 1;
+        }
+        const double bindings[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+        if (legacy_ast.size() != pratt_ast.size() ||
+            legacy_ast.root().evaluate(bindings) != pratt_ast.root().evaluate(bindings)) {
+            std::cerr << name << ": parsers disagree\n";
+            return 1;
+        }
+
+        std::size_t iterations = std::max<std::size_t>(1, bytes / source.size());
+        double legacy_ns = measure_ns_per_op(iterations, [&] {
+            legacy_parse(source, legacy_ast);
+            do_not_optimize(static_cast<double>(legacy_ast.get_root()));
+        });
+        double pratt_ns = measure_ns_per_op(iterations, [&] {
+            (void)parse_tree(source, pratt_ast);
+            do_not_optimize(static_cast<double>(pratt_ast.get_root()));
+        });
+
+        tokenize(source, tokens);
+        std::cout << std::left << std::setw(10) << name << std::right << std::setw(10) << tokens.size()
+                  << std::fixed << std::setprecision(0) << std::setw(18) << 1e9 / legacy_ns
+                  << std::setw(16) << 1e9 / pratt_ns << std::setprecision(2) << std::setw(9)
+                  << legacy_ns / pratt_ns << "x\n";
+    }
+    return 0;
+}
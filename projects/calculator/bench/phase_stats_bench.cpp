@@ -0,0 +1,106 @@
+// Cost of the always-on phase counters (see phase_stats.h). Times an empty scope under
+// each kind of PhaseTimer and sets that against the operations they wrap:
+// parse_expression() (a parse and a build timer), an evaluation through ExpressionCache
+// as the front ends do it, and a bare CompiledExpression::evaluate() (one evaluate
+// timer each). An empty scope in a loop waits on its own counter every iteration, so
+// this overstates the cost inside real work; the bare evaluate figure is reported as
+// that upper bound. Exits non-zero if the counters cost 2% or more of parse_expression()
+// or of a cached evaluation, or if the counts they report are off.
+//   ./build/calculator_phase_stats_bench [iterations]     (default 20000000)
+#include "bench_common.h"
+#include "expression_cache.h"
+#include "phase_stats.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main(int argc, char** argv) {
+    const std::size_t iterations = argc > 1 ? static_cast<std::size_t>(std::atol(argv[1])) : 20'000'000;
+    const std::vector<std::string> formulas = {
+        "2 + 3 * (4 - 1)",
+        "price * qty * (1 + tax_rate) - discount / 100 + shipping",
+        "sqrt(x^2 + y^2) / (abs(z) + 1)",
+    };
+    const double bindings[] = {2.5, 4.0, 0.2, 10.0, 7.5};
+
+    const std::array<PhaseSummary, kNumPhases> before = collect_phase_stats();
+    double parse_ns = 0.0;
+    double cached_ns = 0.0;
+    double evaluate_ns = 0.0;
+    std::size_t parses = 0;
+    std::size_t evaluations = 0;
+    ExpressionCache cache;
+    for (const std::string& formula : formulas) {
+        const std::size_t parse_iterations = iterations / 100;
+        parse_ns += measure_ns_per_op(parse_iterations, [&] {
+            do_not_optimize(static_cast<double>(parse_expression(formula).num_slots()));
+        });
+        parses += parse_iterations;
+
+        const CompiledExpression expression = parse_expression(formula);
+        ++parses;
+        cached_ns += measure_ns_per_op(iterations / 10, [&] {
+            do_not_optimize(cache.try_evaluate_exact(formula, bindings)->value);
+        });
+        evaluate_ns += measure_ns_per_op(iterations, [&] { do_not_optimize(expression.evaluate(bindings)); });
+        evaluations += iterations / 10 + iterations;
+    }
+    parse_ns /= static_cast<double>(formulas.size());
+    cached_ns /= static_cast<double>(formulas.size());
+    evaluate_ns /= static_cast<double>(formulas.size());
+    const std::array<PhaseSummary, kNumPhases> after = collect_phase_stats();
+    print_phase_stats(std::cout);
+
+    // The instrumentation alone, last: it adds empty occurrences to the counters.
+    // Best of three, less the cost of an empty loop iteration.
+    auto timer_cost = [iterations](auto&& body) {
+        double best = 1e9;
+        for (int round = 0; round < 3; ++round) {
+            double empty = measure_ns_per_op(iterations, [] { asm volatile(""); });
+            best = std::min(best, std::max(0.0, measure_ns_per_op(iterations, body) - empty));
+        }
+        return best;
+    };
+    double always_ns = timer_cost([] { PhaseTimer<1> timer(Phase::Parse); });
+    double parse_timer_ns = timer_cost([] { PhaseTimer<kParseSampling> timer(Phase::Parse); });
+    double evaluate_timer_ns = timer_cost([] { PhaseTimer<kEvaluateSampling> timer(Phase::Evaluate); });
+
+    const double parse_overhead = 2 * parse_timer_ns / (parse_ns - 2 * parse_timer_ns) * 100;
+    const double cached_overhead = evaluate_timer_ns / (cached_ns - evaluate_timer_ns) * 100;
+    const double evaluate_overhead = evaluate_timer_ns / (evaluate_ns - evaluate_timer_ns) * 100;
+    std::cout << "\n" << std::fixed << std::setprecision(2) << "timer, every call timed:  " << always_ns << " ns\n"
+              << "parse timer (1 in " << kParseSampling << "):   " << parse_timer_ns << " ns\n"
+              << "evaluate timer (1 in " << kEvaluateSampling << "): " << evaluate_timer_ns << " ns\n"
+              << std::left << std::setw(26) << "operation" << std::right << std::setw(10) << "ns" << std::setw(12)
+              << "overhead\n"
+              << std::left << std::setw(26) << "parse_expression" << std::right << std::setw(10) << parse_ns
+              << std::setw(10) << parse_overhead << " %\n"
+              << std::left << std::setw(26) << "cached evaluation" << std::right << std::setw(10) << cached_ns
+              << std::setw(10) << cached_overhead << " %\n"
+              << std::left << std::setw(26) << "CompiledExpression::evaluate" << std::right << std::setw(8)
+              << evaluate_ns << std::setw(10) << evaluate_overhead << " % (at most)\n";
+
+    // Cache misses parse once per formula; the counters must have seen every call.
+    const std::uint64_t expected_parses = parses + formulas.size();
+    const auto counted = [&](Phase phase) {
+        const auto p = static_cast<std::size_t>(phase);
+        return after[p].count - before[p].count;
+    };
+    if (counted(Phase::Parse) != expected_parses || counted(Phase::Build) != expected_parses ||
+        counted(Phase::Evaluate) < evaluations) {
+        std::cerr << "counted " << counted(Phase::Parse) << " parses, " << counted(Phase::Build) << " builds and "
+                  << counted(Phase::Evaluate) << " evaluations; expected " << expected_parses << ", "
+                  << expected_parses << " and at least " << evaluations << "\n";
+        return 1;
+    }
+    if (parse_overhead >= 2.0 || cached_overhead >= 2.0) {
+        std::cerr << "instrumentation costs 2% or more\n";
+        return 1;
+    }
+    std::cout << "checks passed\n";
+    return 0;
+}
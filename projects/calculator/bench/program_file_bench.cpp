@@ -0,0 +1,238 @@
+// Service start-up: compiling N formula strings from source (what a service does at
+// every start) against mapping a program file written once. Reports the time to get
+// every formula ready to evaluate both ways, the allocations made while loading and
+// evaluating from the mapping, and checks that both give bit-identical results, that
+// integer formulas stay exact past 2^53 as parse_expression() keeps them, and that
+// damaged files are rejected. Exits non-zero on any failure.
+//   ./build/calculator_program_file_bench [formulas] [path]     (defaults 500000, /tmp/calculator_programs.bin)
+#include "allocation_counter.h"
+#include "bench_common.h"
+#include "calculator.h"
+#include "program_file.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <optional>
+#include <random>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace {
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Business-rule-like formulas over a small vocabulary: a few terms of products,
+// quotients by (name + constant), powers and function calls.
+std::string make_formula(std::mt19937_64& rng) {
+    static const char* const names[] = {"price", "quantity", "tax", "discount", "rate", "base", "weight", "margin"};
+    static const char* const functions[] = {"sqrt", "exp", "log", "abs", "min", "max"};
+    auto pick = [&rng](std::size_t n) { return static_cast<std::size_t>(rng() % n); };
+    auto operand = [&] {
+        switch (pick(4)) {
+            case 0: return std::to_string(pick(100) + 1) + "." + std::to_string(pick(100));
+            case 1: return std::string(names[pick(std::size(names))]);
+            case 2: {
+                const char* f = functions[pick(std::size(functions))];
+                std::string args = names[pick(std::size(names))];
+                if (std::strcmp(f, "min") == 0 || std::strcmp(f, "max") == 0) {
+                    args += ", " + std::to_string(pick(10));
+                }
+                return std::string(f) + "(" + args + ")";
+            }
+            default: return "(" + std::string(names[pick(std::size(names))]) + " + " + std::to_string(pick(9) + 1) + ")";
+        }
+    };
+    static const char ops[] = {'+', '-', '*', '/', '*'};
+    std::string formula = operand();
+    for (std::size_t terms = pick(6) + 2; terms > 0; --terms) {
+        char op = ops[pick(std::size(ops))];
+        formula += std::string(" ") + op + " " + (op == '/' ? "(" + operand() + " + 1000)" : operand());
+    }
+    return formula;
+}
+
+// Binds the named variables of a formula from a fixed table (none are zero).
+double bound_value(std::string_view name) {
+    return static_cast<double>(name.size()) * 0.75 + static_cast<double>(name[0] % 7);
+}
+
+bool same(double a, double b) {
+    return std::memcmp(&a, &b, sizeof a) == 0;
+}
+
+// Formulas that are integer throughout must come back from the file with their
+// IntegerProgram and give what evaluate_exact() gives; the others must not have one.
+bool check_integers(const std::string& path) {
+    const std::vector<std::string> sources = {"9007199254740993", "x * (2^62 + 1)", "(x + 1) - x", "x / 2",
+                                              "x * 1.5"};
+    write_program_file(path, sources);
+    ProgramFile file(path);
+    IntegerMachine machine;
+    VirtualMachine vm;
+    bool ok = true;
+    for (double x : {1.0, 9007199254740992.0, 3.0}) {
+        const double bindings[] = {x};
+        for (std::size_t i = 0; i < sources.size(); ++i) {
+            const std::span<const double> bound(bindings, file.program(i).num_variables);
+            const ExactValue expected = parse_expression(sources[i]).evaluate_exact(bound);
+            std::optional<std::int64_t> exact;
+            if (std::optional<IntegerProgramView> integer = file.integer_program(i)) {
+                exact = machine.run(*integer, bound);
+            }
+            const bool same_value =
+                exact ? expected.is_integer && *exact == expected.integer
+                      : !expected.is_integer && same(vm.run(file.program(i), bound), expected.value);
+            if (!same_value) {
+                std::cerr << "'" << sources[i] << "' at x = " << x << " differs from evaluate_exact()\n";
+                ok = false;
+            }
+        }
+    }
+    std::remove(path.c_str());
+    return ok;
+}
+
+bool rejected(const std::string& path, const std::string& bytes, const char* what) {
+    std::ofstream(path, std::ios::binary).write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    try {
+        ProgramFile file(path);
+    } catch (const std::runtime_error& e) {
+        std::cout << "  rejected " << what << ": " << e.what() << "\n";
+        return true;
+    }
+    std::cerr << "accepted " << what << "\n";
+    return false;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const std::size_t count = argc > 1 ? static_cast<std::size_t>(std::atol(argv[1])) : 500000;
+    const std::string path = argc > 2 ? argv[2] : "/tmp/calculator_programs.bin";
+    std::mt19937_64 rng(18);
+    std::vector<std::string> sources(count);
+    for (std::string& source : sources) {
+        source = make_formula(rng);
+    }
+    std::cout << count << " formulas\n" << std::fixed << std::setprecision(1);
+
+    // Start-up today: every formula parsed, simplified and compiled.
+    auto start = std::chrono::steady_clock::now();
+    std::vector<CompiledExpression> parsed;
+    parsed.reserve(count);
+    for (const std::string& source : sources) {
+        parsed.push_back(parse_expression(source));
+    }
+    const double parse_seconds = seconds_since(start);
+    std::cout << "parse + compile: " << parse_seconds * 1e3 << " ms ("
+              << parse_seconds / static_cast<double>(count) * 1e9 << " ns/formula)\n";
+
+    start = std::chrono::steady_clock::now();
+    write_program_file(path, sources);
+    const double write_seconds = seconds_since(start);
+
+    // Start-up from the program file: map it and validate it, nothing else.
+    std::size_t before = allocations;
+    start = std::chrono::steady_clock::now();
+    ProgramFile file(path);
+    const double load_seconds = seconds_since(start);
+    const std::size_t load_allocations = allocations - before;
+    std::cout << "write once:      " << write_seconds * 1e3 << " ms, " << file.get_file_size() / 1024.0 / 1024.0
+              << " MiB (" << static_cast<double>(file.get_file_size()) / static_cast<double>(count)
+              << " bytes/formula)\n"
+              << "mmap + validate: " << load_seconds * 1e3 << " ms ("
+              << load_seconds / static_cast<double>(count) * 1e9 << " ns/formula, " << load_allocations
+              << " allocations), " << parse_seconds / load_seconds << "x faster start-up\n";
+
+    // Every formula, evaluated once from each, must agree bit for bit.
+    std::vector<double> bindings;
+    VirtualMachine vm;
+    for (std::size_t i = 0; i < count; ++i) {
+        if (file.source(i) != sources[i]) {
+            std::cerr << "formula " << i + 1 << ": source text differs\n";
+            return 1;
+        }
+        auto variables = parsed[i].get_variables();
+        bindings.clear();
+        for (std::uint32_t slot = 0; slot < variables.size(); ++slot) {
+            if (file.variable(i, slot) != variables[slot]) {
+                std::cerr << "formula " << i + 1 << ": variable " << slot << " differs\n";
+                return 1;
+            }
+            bindings.push_back(bound_value(variables[slot]));
+        }
+        if (parsed[i].get_integer_program().has_value() != file.integer_program(i).has_value()) {
+            std::cerr << "formula " << i + 1 << ": integer program " << (file.integer_program(i) ? "added" : "lost")
+                      << "\n";
+            return 1;
+        }
+        double expected = vm.run(parsed[i].get_program(), bindings);
+        double actual = vm.run(file.program(i), bindings);
+        if (!same(expected, actual)) {
+            std::cerr << "formula " << i + 1 << " (" << sources[i] << "): " << actual << ", expected " << expected
+                      << "\n";
+            return 1;
+        }
+    }
+
+    if (!check_integers(path + ".integer")) {
+        return 1;
+    }
+
+    // Evaluating from the mapping, with the VM's registers and the bindings warm.
+    double bound[8];
+    for (double& value : bound) {
+        value = 2.5;
+    }
+    before = allocations;
+    start = std::chrono::steady_clock::now();
+    double sum = 0.0;
+    for (std::size_t i = 0; i < count; ++i) {
+        sum += vm.run(file.program(i), bound);
+    }
+    do_not_optimize(sum);
+    const double evaluate_seconds = seconds_since(start);
+    const std::size_t evaluate_allocations = allocations - before;
+    std::cout << "evaluate all:    " << evaluate_seconds * 1e3 << " ms from the mapping ("
+              << evaluate_seconds / static_cast<double>(count) * 1e9 << " ns/formula, " << evaluate_allocations
+              << " allocations)\n";
+    if (load_allocations > 16 || evaluate_allocations != 0) {
+        std::cerr << "loading or evaluating allocates per formula\n";
+        return 1;
+    }
+
+    // Damaged files are reported when opened, not when evaluated.
+    std::string bytes;
+    {
+        std::ifstream in(path, std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    const std::string damaged = path + ".damaged";
+    std::string other_version = bytes;
+    other_version[8] = static_cast<char>(kProgramFileVersion + 1);
+    // The first program's first instruction follows the header (40 bytes), the entry
+    // table and its constants; pointing its dst elsewhere must be caught.
+    std::string bad_register = bytes;
+    std::uint64_t code_offset = 0;
+    std::memcpy(&code_offset, bytes.data() + 40 + 8, sizeof code_offset);
+    bad_register[code_offset + 4] ^= 0x40;
+    bool ok = rejected(damaged, bytes.substr(0, bytes.size() - 1), "a truncated file") &&
+              rejected(damaged, other_version, "another version") &&
+              rejected(damaged, bad_register, "a bad register number");
+    std::remove(damaged.c_str());
+    std::remove(path.c_str());
+    if (!ok) {
+        return 1;
+    }
+    std::cout << "checks passed\n";
+    return 0;
+}
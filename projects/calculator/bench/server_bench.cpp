@@ -0,0 +1,263 @@
+// Load generator for the socket server: `clients` connections, each keeping `depth`
+// requests in flight (pipelining), half of them newline-delimited and half
+// length-prefixed, over a working set of repeated formulas. Reports requests/s and
+// p50/p99/p999 latency (send to answer), without pipelining and with it. Every answer
+// is checked against a local evaluation; exits non-zero on a wrong or missing one.
+// Without a socket argument the server runs in-process, on its own thread.
+//   ./build/calculator_server_bench [clients] [depth] [seconds] [socket]     (defaults 8, 32, 2)
+#include "calculator.h"
+#include "expression_cache.h"
+#include "server.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// The working set: distinct formulas that clients send again and again, including a
+// few that fail.
+struct Workload {
+    std::vector<std::string> line_requests;
+    std::vector<std::string> framed_requests;
+    std::vector<std::string> answers;   // without framing or newline
+};
+
+std::string encode_framed(std::string_view text) {
+    std::string out(1, kFramedMarker);
+    auto length = static_cast<std::uint32_t>(text.size());
+    out.append(reinterpret_cast<const char*>(&length), sizeof length);
+    out += text;
+    return out;
+}
+
+Workload make_workload(std::size_t count) {
+    Workload workload;
+    std::mt19937_64 rng(19);
+    ExpressionCache cache;
+    for (std::size_t i = 0; i < count; ++i) {
+        std::string formula = i % 50 == 49 ? std::to_string(i) + " / (3 - 3)"
+                                           : "(" + std::to_string(rng() % 1000) + " * 1.5 + sqrt(" +
+                                                 std::to_string(rng() % 100) + ")) / " + std::to_string(i % 7 + 1) +
+                                                 " - " + std::to_string(rng() % 37) + "^2";
+        std::string answer;
+        if (Result<ExactValue> result = cache.try_evaluate_exact(formula)) {
+            append_result(answer, *result);
+        } else {
+            answer = "Error: " + describe(result.error());
+        }
+        workload.line_requests.push_back(formula + "\n");
+        workload.framed_requests.push_back(encode_framed(formula));
+        workload.answers.push_back(std::move(answer));
+    }
+    return workload;
+}
+
+int connect_to(const std::string& path) {
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.c_str(), std::min(path.size() + 1, sizeof address.sun_path - 1));
+    if (fd < 0 || ::connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof address) != 0) {
+        throw std::runtime_error("Cannot connect to '" + path + "'");
+    }
+    return fd;
+}
+
+void send_all(int fd, const std::string& data) {
+    for (std::size_t sent = 0; sent < data.size();) {
+        ssize_t n = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) {
+            throw std::runtime_error("send failed");
+        }
+        sent += static_cast<std::size_t>(n);
+    }
+}
+
+// One connection: keeps `depth` requests in flight until `deadline`, then drains.
+// Returns the latency of every answered request, in nanoseconds.
+std::vector<std::uint32_t> run_client(const std::string& path, const Workload& workload, bool framed,
+                                      std::size_t depth, Clock::time_point deadline, unsigned seed,
+                                      std::atomic<bool>& failed) {
+    std::vector<std::uint32_t> latencies;
+    const int fd = connect_to(path);
+    std::mt19937 rng(seed);
+    // In-flight requests, oldest first, as a ring: which formula and when it was sent.
+    std::vector<std::size_t> formula(depth);
+    std::vector<Clock::time_point> sent_at(depth);
+    std::size_t head = 0;
+    std::size_t in_flight = 0;
+    std::string outgoing;
+    auto enqueue = [&](Clock::time_point now) {
+        std::size_t f = rng() % workload.answers.size();
+        std::size_t slot = (head + in_flight) % depth;
+        formula[slot] = f;
+        sent_at[slot] = now;
+        ++in_flight;
+        outgoing += framed ? workload.framed_requests[f] : workload.line_requests[f];
+    };
+
+    for (std::size_t i = 0; i < depth; ++i) {
+        enqueue(Clock::now());
+    }
+    send_all(fd, outgoing);
+    outgoing.clear();
+
+    std::string input;
+    char buffer[64 << 10];
+    while (in_flight > 0 && !failed) {
+        ssize_t n = ::recv(fd, buffer, sizeof buffer, 0);
+        if (n <= 0) {
+            std::cerr << "connection closed with " << in_flight << " requests in flight\n";
+            failed = true;
+            break;
+        }
+        input.append(buffer, static_cast<std::size_t>(n));
+        const Clock::time_point now = Clock::now();
+
+        std::size_t consumed = 0;
+        for (;;) {
+            std::string_view rest = std::string_view(input).substr(consumed);
+            std::string_view answer;
+            if (framed) {
+                std::uint32_t length = 0;
+                if (rest.size() < 1 + sizeof length) {
+                    break;
+                }
+                std::memcpy(&length, rest.data() + 1, sizeof length);
+                if (rest.size() < 1 + sizeof length + length) {
+                    break;
+                }
+                answer = rest.substr(1 + sizeof length, length);
+                consumed += 1 + sizeof length + length;
+            } else {
+                std::size_t newline = rest.find('\n');
+                if (newline == std::string_view::npos) {
+                    break;
+                }
+                answer = rest.substr(0, newline);
+                consumed += newline + 1;
+            }
+            if (in_flight == 0 || answer != workload.answers[formula[head]]) {
+                std::cerr << "wrong answer '" << answer << "'\n";
+                failed = true;
+                break;
+            }
+            latencies.push_back(static_cast<std::uint32_t>(
+                std::min<std::int64_t>(UINT32_MAX, std::chrono::nanoseconds(now - sent_at[head]).count())));
+            head = (head + 1) % depth;
+            --in_flight;
+            if (now < deadline) {
+                enqueue(now);
+            }
+        }
+        input.erase(0, consumed);
+        if (!outgoing.empty()) {
+            send_all(fd, outgoing);
+            outgoing.clear();
+        }
+    }
+    ::close(fd);
+    return latencies;
+}
+
+double percentile(const std::vector<std::uint32_t>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    auto index = static_cast<std::size_t>(p * static_cast<double>(sorted.size() - 1));
+    return static_cast<double>(sorted[index]) / 1e3;
+}
+
+// Runs one load configuration; false if any answer was wrong.
+bool run_load(const std::string& external_socket, const Workload& workload, std::size_t clients, std::size_t depth,
+              double seconds) {
+    std::string path = external_socket;
+    std::unique_ptr<Server> server;
+    std::thread server_thread;
+    if (path.empty()) {
+        path = "/tmp/calculator_bench_" + std::to_string(::getpid()) + ".sock";
+        server = std::make_unique<Server>(ServerOptions{path});
+        server_thread = std::thread([&] { server->run(); });
+    }
+
+    std::atomic<bool> failed{false};
+    std::vector<std::vector<std::uint32_t>> results(clients);
+    std::vector<std::thread> threads;
+    const auto start = Clock::now();
+    const auto deadline = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+    for (std::size_t c = 0; c < clients; ++c) {
+        threads.emplace_back([&, c] {
+            try {
+                results[c] = run_client(path, workload, c % 2 == 1, depth, deadline, static_cast<unsigned>(c), failed);
+            } catch (const std::exception& e) {
+                std::cerr << e.what() << "\n";
+                failed = true;
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    const double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::vector<std::uint32_t> latencies;
+    for (const auto& r : results) {
+        latencies.insert(latencies.end(), r.begin(), r.end());
+    }
+    std::sort(latencies.begin(), latencies.end());
+    std::cout << std::setw(7) << clients << std::setw(7) << depth << std::setw(12) << std::fixed
+              << std::setprecision(0) << static_cast<double>(latencies.size()) / elapsed << std::setprecision(1)
+              << std::setw(10) << percentile(latencies, 0.5) << std::setw(10) << percentile(latencies, 0.99)
+              << std::setw(10) << percentile(latencies, 0.999);
+
+    if (server) {
+        server->stop();
+        server_thread.join();
+        const ServerStats& stats = server->get_stats();
+        std::cout << std::setw(14) << static_cast<double>(stats.requests) / static_cast<double>(stats.wakeups);
+        if (stats.requests != latencies.size()) {
+            std::cerr << "\nserver answered " << stats.requests << " requests, clients saw " << latencies.size()
+                      << "\n";
+            failed = true;
+        }
+    }
+    std::cout << "\n";
+    return !failed;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const std::size_t clients = argc > 1 ? static_cast<std::size_t>(std::atoi(argv[1])) : 8;
+    const std::size_t depth = argc > 2 ? static_cast<std::size_t>(std::atoi(argv[2])) : 32;
+    const double seconds = argc > 3 ? std::atof(argv[3]) : 2.0;
+    const std::string socket = argc > 4 ? argv[4] : "";
+    const Workload workload = make_workload(500);
+
+    std::cout << std::setw(7) << "clients" << std::setw(7) << "depth" << std::setw(12) << "req/s" << std::setw(10)
+              << "p50 us" << std::setw(10) << "p99 us" << std::setw(10) << "p999 us"
+              << (socket.empty() ? "    req/wakeup" : "") << "\n";
+    bool ok = run_load(socket, workload, clients, 1, seconds) && run_load(socket, workload, clients, depth, seconds);
+    if (!ok) {
+        return 1;
+    }
+    std::cout << "checks passed\n";
+    return 0;
+}
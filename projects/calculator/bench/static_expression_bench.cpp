@@ -0,0 +1,140 @@
+// Compile-time formulas (see static_expression.h) against parse_expression(). The
+// static_asserts below check grammar, precedence, folding and error codes while this
+// file compiles; at run time every formula is evaluated both ways, on whole-number and
+// fractional bindings and past the JIT threshold, and must agree bit for bit. Then
+// reports the cost of an evaluation each way. Exits non-zero on a disagreement.
+//   ./build/calculator_static_expression_bench [iterations]     (default 5000000)
+#include "bench_common.h"
+#include "calculator.h"
+#include "static_expression.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Grammar and precedence, as OperatorPrecedence defines them.
+static_assert(calc::eval<"2 + 3 * (4 - 1)">() == 11);
+static_assert(calc::eval<"2 ^ 3 ^ 2">() == 512);
+static_assert(calc::eval<"-2 ^ 2">() == -4);
+static_assert(calc::eval<"10 - 4 - 3">() == 3);
+static_assert(calc::eval<"2 * -+3">() == -6);
+static_assert(calc::eval<"1 / 4 + .5e1">() == 5.25);
+static_assert(calc::eval<"max(1, 2) * abs(-3)">() == 6);
+// Folding as simplify() folds: integer subtrees exactly, even above 2^53.
+static_assert(calc::eval<"2^62 + 1 - 2^62">() == 1);
+static_assert(calc::eval<"(2^62 + 1.0) - 2^62">() == 0);
+// Errors, with the codes and offsets parse_tree() reports.
+static_assert(calc::parse_error<"2 +">().code == ErrorCode::ExpectedOperand);
+static_assert(calc::parse_error<"2 +">().offset == 3);
+static_assert(calc::parse_error<"(1 + 2">().code == ErrorCode::ExpectedClosingParen);
+static_assert(calc::parse_error<"1 $ 2">().code == ErrorCode::UnexpectedCharacter);
+static_assert(calc::parse_error<"1 2">().code == ErrorCode::UnexpectedToken);
+static_assert(calc::parse_error<"tan(1)">().code == ErrorCode::UnknownFunction);
+static_assert(calc::parse_error<"pow(1)">().code == ErrorCode::WrongArgumentCount);
+static_assert(!calc::parse_error<"sqrt(x) + y">());
+// Slots in order of first appearance.
+static_assert(calc::Formula<"b * a + b">::slot("a") == 1);
+static_assert(calc::Formula<"b * a + b">::num_slots() == 2);
+
+namespace {
+
+bool same(double a, double b) {
+    return std::memcmp(&a, &b, sizeof a) == 0;
+}
+
+// Cost of one evaluation each way, summed over the formulas timed.
+struct Totals {
+    std::size_t iterations;   // per formula and way
+    double static_ns = 0.0;
+    double runtime_ns = 0.0;
+    std::size_t timed = 0;
+};
+
+// Evaluates `source` both ways on random bindings, half of them whole numbers; false
+// on the first disagreement. Then times both ways, unless evaluation throws.
+template <calc::FixedString source>
+bool check(std::mt19937_64& rng, Totals& totals) {
+    static constexpr calc::Formula<source> formula;
+    const CompiledExpression expression = parse_expression(source.view());
+    if (expression.num_slots() != formula.num_slots()) {
+        std::cerr << "'" << source.view() << "': " << formula.num_slots() << " slots, expected "
+                  << expression.num_slots() << "\n";
+        return false;
+    }
+    std::vector<double> bindings(formula.num_slots() + 1);
+    std::uniform_real_distribution<double> real(-50.0, 50.0);
+    for (std::uint64_t n = 0; n <= 2 * kJitThreshold; ++n) {
+        for (double& binding : bindings) {
+            binding = n % 2 == 0 ? std::floor(real(rng)) : real(rng);
+        }
+        double expected = 0.0;
+        double actual = 0.0;
+        std::string expected_error;
+        std::string actual_error;
+        try {
+            expected = expression.evaluate(bindings);
+        } catch (const std::runtime_error& e) {
+            expected_error = e.what();
+        }
+        try {
+            actual = formula.evaluate(bindings);
+        } catch (const std::runtime_error& e) {
+            actual_error = e.what();
+        }
+        if (!same(actual, expected) || actual_error != expected_error) {
+            std::cerr << std::setprecision(17) << "'" << source.view() << "': " << actual << actual_error
+                      << ", parse_expression " << expected << expected_error << "\n";
+            return false;
+        }
+    }
+    if constexpr (calc::Formula<source>::num_slots() == 0) {
+        // The one computed by the compiler.
+        constexpr double folded = calc::eval<source>();
+        if (!same(folded, expression.evaluate())) {
+            std::cerr << "'" << source.view() << "': eval " << folded << "\n";
+            return false;
+        }
+    }
+
+    for (double& binding : bindings) {
+        binding = real(rng);
+    }
+    try {
+        do_not_optimize(expression.evaluate(bindings));
+    } catch (const std::runtime_error&) {
+        return true;
+    }
+    totals.static_ns += measure_ns_per_op(totals.iterations, [&] { do_not_optimize(formula.evaluate(bindings)); });
+    totals.runtime_ns += measure_ns_per_op(totals.iterations, [&] { do_not_optimize(expression.evaluate(bindings)); });
+    ++totals.timed;
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::mt19937_64 rng(23);
+    Totals totals{argc > 1 ? static_cast<std::size_t>(std::atol(argv[1])) : 5'000'000};
+    const bool ok = check<"2 + 3 * (4 - 1)">(rng, totals) &&
+                    check<"price * qty * (1 + tax_rate) - discount / 100 + shipping">(rng, totals) &&
+                    check<"sqrt(x^2 + y^2) / (abs(z) + 1)">(rng, totals) &&
+                    check<"x * (2^62 + 1) - y * 3 / 4">(rng, totals) &&
+                    check<"-(a - b) ^ 2 + 2 ^ -1 * min(a, 1.5e3) - 7 * 0.1">(rng, totals) &&
+                    check<"(x + 1) / (y - y)">(rng, totals) &&
+                    check<"0.1 + 0.2 * 3.3e-5 - 12345.678 + 1. * x - 9007199254740993">(rng, totals) &&
+                    check<"exp(1) * n + log(10) - cos(0.5) / 2.5^1.5">(rng, totals);
+    if (!ok) {
+        return 1;
+    }
+    const auto timed = static_cast<double>(totals.timed);
+    std::cout << std::fixed << std::setprecision(2) << "ns per evaluation, mean over " << totals.timed
+              << " formulas\n"
+              << "  calc::Formula                 " << std::setw(8) << totals.static_ns / timed << "\n"
+              << "  CompiledExpression::evaluate  " << std::setw(8) << totals.runtime_ns / timed << "\n"
+              << "checks passed\n";
+    return 0;
+}
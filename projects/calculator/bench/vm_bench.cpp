@@ -0,0 +1,59 @@
+// Tree-walk vs bytecode VM throughput on deep (left-leaning chain) and wide (balanced)
+// expressions. Exits non-zero if the two disagree.
+//   cmake -S . -B build -DCMAKE_BUILD_TYPE=Release && cmake --build build
+//   ./build/calculator_vm_bench [visits]     (default 20000000 node visits per measurement)
+#include "bench_common.h"
+#include "bytecode.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+namespace {
+
+void run_case(const std::string& name, const std::string& expression, std::size_t nodes, std::size_t visits) {
+    // Unshared, so every node is visited and "nodes" is the real per-evaluation work.
+    Ast tree = parse_tree(expression, false);
+    Node root = tree.root();
+    Program program = compile(tree);
+    VirtualMachine vm;
+
+    double tree_result = root.evaluate();
+    double vm_result = vm.run(program);
+    if (tree_result != vm_result && !(std::isnan(tree_result) && std::isnan(vm_result))) {
+        std::cerr << name << ": result mismatch (tree " << tree_result << ", vm " << vm_result << ")\n";
+        std::exit(1);
+    }
+
+    std::size_t iterations = std::max<std::size_t>(1, visits / nodes);
+    double tree_ns = measure_ns_per_op(iterations, [&] { do_not_optimize(root.evaluate()); });
+    double vm_ns = measure_ns_per_op(iterations, [&] { do_not_optimize(vm.run(program)); });
+
+    std::cout << std::left << std::setw(14) << name << std::right
+              << std::setw(10) << nodes
+              << std::setw(14) << std::fixed << std::setprecision(1) << tree_ns
+              << std::setw(14) << vm_ns
+              << std::setw(10) << std::setprecision(2) << tree_ns / vm_ns << "x\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const std::size_t visits = argc > 1 ? static_cast<std::size_t>(std::atol(argv[1])) : 20'000'000;
+    std::cout << std::left << std::setw(14) << "case" << std::right
+              << std::setw(10) << "nodes"
+              << std::setw(14) << "tree ns/eval"
+              << std::setw(14) << "vm ns/eval"
+              << std::setw(11) << "speedup\n";
+
+    for (std::size_t terms : {8, 64, 1024, 8192}) {
+        run_case("deep/" + std::to_string(terms), make_deep_expression(terms), 2 * terms - 1, visits);
+    }
+    for (std::size_t depth : {3, 6, 10, 13}) {
+        run_case("wide/" + std::to_string(depth), make_wide_expression(depth), (std::size_t{2} << depth) - 1, visits);
+    }
+    return 0;
+}
@@ -0,0 +1,417 @@
+#include "aggregate.h"
+#include "batch.h"
+#include "functions.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+
+namespace {
+
+// Terms per chunk: the unit of work handed to a thread, and the leaves of the
+// reduction tree. Each chunk's columns (32 KiB apiece) stay in L2.
+constexpr std::size_t kChunkRows = 4096;
+// Longest range or array an aggregate takes: keeps the index exact and the per-chunk
+// results in memory.
+constexpr double kMaxRows = 0x1p36;
+
+// An aggregate call found in the source, e.g. "sum(i, 1, n, i^2)".
+struct Call {
+    AggregateKind kind;
+    std::uint32_t begin;            // offset of the name
+    std::uint32_t end;              // one past the ')'
+    std::string_view index;         // empty for an aggregate over arrays
+    std::uint32_t arg_begin[4];     // source range of each argument
+    std::uint32_t arg_end[4];
+    int num_args;
+};
+
+std::optional<AggregateKind> aggregate_kind(std::string_view name) {
+    if (name == "sum") return AggregateKind::Sum;
+    if (name == "prod") return AggregateKind::Product;
+    if (name == "min") return AggregateKind::Min;
+    if (name == "max") return AggregateKind::Max;
+    return std::nullopt;
+}
+
+// Finds every aggregate call, in source order. Calls without a closing ')' are left
+// for the parser to report.
+Error find_calls(std::string_view source, std::span<const Token> tokens, std::vector<Call>& calls) {
+    std::uint32_t inside_until = 0;
+    for (std::size_t t = 0; t + 1 < tokens.size(); ++t) {
+        const Token& name = tokens[t];
+        std::optional<AggregateKind> kind;
+        if (name.kind != TokenKind::Identifier || tokens[t + 1].kind != TokenKind::LeftParen ||
+            !(kind = aggregate_kind(name.text(source)))) {
+            continue;
+        }
+        // The matching ')' and the commas at this level.
+        std::size_t separators[5] = {t + 1};
+        int num_separators = 1;
+        int depth = 0;
+        std::size_t close = t + 2;
+        for (; close < tokens.size(); ++close) {
+            const TokenKind k = tokens[close].kind;
+            if (k == TokenKind::LeftParen) {
+                ++depth;
+            } else if (k == TokenKind::RightParen && depth-- == 0) {
+                break;
+            } else if (k == TokenKind::Comma && depth == 0 && num_separators++ < 4) {
+                separators[num_separators - 1] = close;
+            }
+        }
+        if (close == tokens.size()) {
+            break;
+        }
+        const int num_args = close == t + 2 ? 0 : num_separators;
+        const bool is_builtin = *kind == AggregateKind::Min || *kind == AggregateKind::Max;
+        if (num_args != 1 && num_args != 4) {
+            if (is_builtin) {
+                continue;
+            }
+            return {ErrorCode::WrongArgumentCount, name.offset};
+        }
+        if (name.offset < inside_until) {
+            return {ErrorCode::NestedAggregate, name.offset};
+        }
+
+        Call call{*kind, name.offset, tokens[close].offset + 1, {}, {}, {}, num_args};
+        separators[num_args] = close;
+        for (int a = 0; a < num_args; ++a) {
+            call.arg_begin[a] = tokens[separators[a]].offset + 1;
+            call.arg_end[a] = tokens[separators[a + 1]].offset;
+        }
+        if (num_args == 4) {
+            if (separators[1] != separators[0] + 2 || tokens[separators[0] + 1].kind != TokenKind::Identifier) {
+                return {ErrorCode::ExpectedIndexVariable, call.arg_begin[0]};
+            }
+            call.index = tokens[separators[0] + 1].text(source);
+        }
+        inside_until = call.end;
+        calls.push_back(call);
+    }
+    return {};
+}
+
+// Compiles source[begin, end); errors are reported at their offset in the whole source.
+Result<CompiledExpression> parse_part(std::string_view source, std::uint32_t begin, std::uint32_t end) {
+    Result<CompiledExpression> part = try_parse_expression(source.substr(begin, end - begin));
+    if (!part) {
+        return Error{part.error().code, part.error().offset + begin};
+    }
+    return part;
+}
+
+double identity(AggregateKind kind) {
+    switch (kind) {
+        case AggregateKind::Sum: return 0.0;
+        case AggregateKind::Product: return 1.0;
+        case AggregateKind::Min: return std::numeric_limits<double>::infinity();
+        case AggregateKind::Max: return -std::numeric_limits<double>::infinity();
+    }
+    return 0.0;
+}
+
+// Pairwise reduction: halves until 32 terms are left, then four independent lanes
+// (which the compiler can keep in SIMD registers). The tree depends only on `n`.
+template <typename Op>
+double pairwise(const double* x, std::size_t n, double identity, Op op) {
+    if (n <= 32) {
+        double lanes[4] = {identity, identity, identity, identity};
+        std::size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            for (std::size_t lane = 0; lane < 4; ++lane) {
+                lanes[lane] = op(lanes[lane], x[i + lane]);
+            }
+        }
+        for (; i < n; ++i) {
+            lanes[0] = op(lanes[0], x[i]);
+        }
+        return op(op(lanes[0], lanes[1]), op(lanes[2], lanes[3]));
+    }
+    const std::size_t half = n / 2;
+    return op(pairwise(x, half, identity, op), pairwise(x + half, n - half, identity, op));
+}
+
+double combine(AggregateKind kind, const double* x, std::size_t n) {
+    switch (kind) {
+        case AggregateKind::Sum: return pairwise(x, n, 0.0, [](double a, double b) { return a + b; });
+        case AggregateKind::Product: return pairwise(x, n, 1.0, [](double a, double b) { return a * b; });
+        case AggregateKind::Min:
+            return pairwise(x, n, identity(kind), [](double a, double b) { return min_value(a, b); });
+        case AggregateKind::Max:
+            return pairwise(x, n, identity(kind), [](double a, double b) { return max_value(a, b); });
+    }
+    return 0.0;
+}
+
+[[noreturn]] void throw_array_misuse(const std::string& name) {
+    throw std::runtime_error("'" + name + "' is an array; aggregate it with sum(), prod(), min() or max()");
+}
+
+} // namespace
+
+Result<AggregateExpression> try_parse_aggregate(std::string_view source) {
+    thread_local std::vector<Token> tokens;
+    tokenize(source, tokens);
+    for (const Token& token : tokens) {
+        if (token.kind == TokenKind::Identifier && token.text(source).starts_with("__")) {
+            return Error{ErrorCode::ReservedName, token.offset};
+        }
+    }
+    std::vector<Call> calls;
+    if (Error error = find_calls(source, tokens, calls)) {
+        return error;
+    }
+
+    // Slots in order of first appearance, skipping index variables where they are the
+    // index: in the first argument and in the body of their aggregate.
+    std::vector<std::string> variables;
+    std::size_t call = 0;
+    for (std::size_t t = 0; t < tokens.size(); ++t) {
+        const Token& token = tokens[t];
+        while (call < calls.size() && token.offset >= calls[call].end) {
+            ++call;
+        }
+        if (token.kind != TokenKind::Identifier ||
+            (t + 1 < tokens.size() && tokens[t + 1].kind == TokenKind::LeftParen)) {
+            continue;
+        }
+        const std::string_view name = token.text(source);
+        if (call < calls.size() && calls[call].num_args == 4 && name == calls[call].index &&
+            token.offset >= calls[call].begin &&
+            (token.offset < calls[call].arg_end[0] || token.offset >= calls[call].arg_begin[3])) {
+            continue;
+        }
+        if (std::find(variables.begin(), variables.end(), name) == variables.end()) {
+            variables.emplace_back(name);
+        }
+    }
+
+    auto inputs_of = [&](const CompiledExpression& expression, std::string_view index) {
+        std::vector<std::uint32_t> inputs;
+        for (const std::string& name : expression.get_variables()) {
+            if (name == index) {
+                inputs.push_back(AggregateExpression::kIndexInput);
+            } else if (name.starts_with("__")) {
+                inputs.push_back(AggregateExpression::kAggregateInput +
+                                 static_cast<std::uint32_t>(std::stoul(name.substr(2))));
+            } else {
+                inputs.push_back(static_cast<std::uint32_t>(std::find(variables.begin(), variables.end(), name) -
+                                                            variables.begin()));
+            }
+        }
+        return inputs;
+    };
+
+    // The outer expression sees each aggregate as a variable "__k", padded with spaces
+    // so that offsets past it are unchanged.
+    std::string outer_source(source);
+    std::vector<AggregateExpression::Aggregate> aggregates;
+    for (std::size_t k = 0; k < calls.size(); ++k) {
+        const Call& c = calls[k];
+        const std::string placeholder = "__" + std::to_string(k);
+        if (placeholder.size() > c.end - c.begin) {
+            return Error{ErrorCode::NestingTooDeep, c.begin};
+        }
+        outer_source.replace(c.begin, c.end - c.begin, c.end - c.begin, ' ');
+        outer_source.replace(c.begin, placeholder.size(), placeholder);
+
+        const int body_arg = c.num_args - 1;
+        Result<CompiledExpression> body = parse_part(source, c.arg_begin[body_arg], c.arg_end[body_arg]);
+        if (!body) {
+            return body.error();
+        }
+        std::vector<std::uint32_t> body_inputs = inputs_of(*body, c.index);
+        AggregateExpression::Aggregate aggregate{c.kind, std::nullopt, std::nullopt,
+                                                 {std::move(*body), std::move(body_inputs)}};
+        if (c.num_args == 4) {
+            Result<CompiledExpression> first = parse_part(source, c.arg_begin[1], c.arg_end[1]);
+            if (!first) {
+                return first.error();
+            }
+            Result<CompiledExpression> last = parse_part(source, c.arg_begin[2], c.arg_end[2]);
+            if (!last) {
+                return last.error();
+            }
+            aggregate.first.emplace(std::move(*first), inputs_of(*first, {}));
+            aggregate.last.emplace(std::move(*last), inputs_of(*last, {}));
+            aggregate.bounds_offset = c.arg_begin[1];
+        }
+        aggregates.push_back(std::move(aggregate));
+    }
+    Result<CompiledExpression> outer = try_parse_expression(outer_source);
+    if (!outer) {
+        return outer.error();
+    }
+    std::vector<std::uint32_t> outer_inputs = inputs_of(*outer, {});
+    return AggregateExpression({std::move(*outer), std::move(outer_inputs)}, std::move(aggregates),
+                               std::move(variables));
+}
+
+AggregateExpression parse_aggregate(std::string_view source) {
+    return try_parse_aggregate(source).value();
+}
+
+bool has_aggregate(std::string_view source) {
+    thread_local std::vector<Token> tokens;
+    thread_local std::vector<Call> calls;
+    tokenize(source, tokens);
+    calls.clear();
+    return find_calls(source, tokens, calls) || !calls.empty();
+}
+
+std::uint32_t AggregateExpression::slot(std::string_view name) const {
+    auto it = std::find(variables.begin(), variables.end(), name);
+    if (it == variables.end()) {
+        throw std::runtime_error("Unknown variable '" + std::string(name) + "'");
+    }
+    return static_cast<std::uint32_t>(it - variables.begin());
+}
+
+double AggregateExpression::evaluate(std::span<const std::span<const double>> values) const {
+    return run(values, nullptr);
+}
+
+double AggregateExpression::evaluate(std::span<const std::span<const double>> values, ThreadPool& pool) const {
+    return run(values, &pool);
+}
+
+double AggregateExpression::evaluate(std::span<const double> scalars, ThreadPool& pool) const {
+    std::vector<std::span<const double>> values;
+    values.reserve(scalars.size());
+    for (const double& scalar : scalars) {
+        values.emplace_back(&scalar, 1);
+    }
+    return run(values, &pool);
+}
+
+double AggregateExpression::run(std::span<const std::span<const double>> values, ThreadPool* pool) const {
+    if (values.size() < variables.size()) {
+        throw std::runtime_error("Unbound variable '" + variables[values.size()] + "'");
+    }
+    std::vector<double> results(aggregates.size());
+    for (std::size_t k = 0; k < aggregates.size(); ++k) {
+        results[k] = reduce(aggregates[k], values, pool);
+    }
+    return evaluate_scalar(outer, values, results);
+}
+
+double AggregateExpression::evaluate_scalar(const Part& part, std::span<const std::span<const double>> values,
+                                            std::span<const double> results) const {
+    std::vector<double> bindings;
+    bindings.reserve(part.inputs.size());
+    for (std::uint32_t input : part.inputs) {
+        if (input >= kAggregateInput) {
+            bindings.push_back(results[input - kAggregateInput]);
+        } else if (values[input].size() != 1) {
+            throw_array_misuse(variables[input]);
+        } else {
+            bindings.push_back(values[input][0]);
+        }
+    }
+    return part.expression.evaluate(bindings);
+}
+
+double AggregateExpression::reduce(const Aggregate& aggregate, std::span<const std::span<const double>> values,
+                                   ThreadPool* pool) const {
+    const Part& body = aggregate.body;
+    double first = 0.0;
+    std::size_t rows = 1;
+    if (aggregate.first) {
+        first = evaluate_scalar(*aggregate.first, values, {});
+        const double last = evaluate_scalar(*aggregate.last, values, {});
+        // Infinities would make the length below NaN.
+        if (!std::isfinite(first) || !std::isfinite(last) || std::floor(first) != first ||
+            std::floor(last) != last) {
+            throw std::runtime_error(describe(Error{ErrorCode::InvalidBounds, aggregate.bounds_offset}));
+        }
+        if (last - first >= kMaxRows) {
+            throw std::runtime_error("Aggregate range is too long");
+        }
+        rows = last < first ? 0 : static_cast<std::size_t>(last - first) + 1;
+    } else {
+        // Arrays set the length; scalars are repeated to match.
+        std::optional<std::size_t> length;
+        for (std::uint32_t input : body.inputs) {
+            const std::size_t size = values[input].size();
+            if (size == 1) {
+                continue;
+            }
+            if (length && *length != size) {
+                throw std::runtime_error("Arrays in one aggregate must be the same length; '" + variables[input] +
+                                         "' has " + std::to_string(size) + " values, not " + std::to_string(*length));
+            }
+            length = size;
+        }
+        rows = length.value_or(1);
+        if (static_cast<double>(rows) >= kMaxRows) {
+            throw std::runtime_error("Aggregate range is too long");
+        }
+    }
+    if (aggregate.first) {
+        for (std::uint32_t input : body.inputs) {
+            if (input != kIndexInput && values[input].size() != 1) {
+                throw_array_misuse(variables[input]);
+            }
+        }
+    }
+    if (rows == 0) {
+        return identity(aggregate.kind);
+    }
+
+    const std::size_t num_chunks = (rows + kChunkRows - 1) / kChunkRows;
+    std::vector<double> partials(num_chunks);
+    auto run_chunks = [&](std::size_t begin, std::size_t end) {
+        // Per thread: a column per input (index or repeated scalar), and the terms in a
+        // buffer of their own so they never overwrite a column. A repeated scalar is
+        // refilled only when its column last held something else; every writer of a
+        // column updates `repeated`, so this holds across aggregates too.
+        thread_local std::vector<double> scratch;
+        thread_local std::vector<std::optional<double>> repeated;
+        thread_local std::vector<std::span<const double>> columns;
+        thread_local std::vector<double> terms(kChunkRows);
+        const std::size_t num_inputs = body.inputs.size();
+        if (scratch.size() < num_inputs * kChunkRows) {
+            scratch.resize(num_inputs * kChunkRows);
+            repeated.assign(num_inputs, std::nullopt);
+        }
+        columns.resize(num_inputs);
+
+        for (std::size_t chunk = begin; chunk < end; ++chunk) {
+            const std::size_t start = chunk * kChunkRows;
+            const std::size_t n = std::min(kChunkRows, rows - start);
+            for (std::size_t i = 0; i < num_inputs; ++i) {
+                const std::uint32_t input = body.inputs[i];
+                double* column = scratch.data() + i * kChunkRows;
+                if (input == kIndexInput) {
+                    for (std::size_t row = 0; row < n; ++row) {
+                        column[row] = first + static_cast<double>(start + row);
+                    }
+                    repeated[i].reset();
+                    columns[i] = {column, n};
+                } else if (values[input].size() == 1) {
+                    const double value = values[input][0];
+                    if (!repeated[i] || std::memcmp(&*repeated[i], &value, sizeof value) != 0) {
+                        std::fill_n(column, kChunkRows, value);
+                        repeated[i] = value;
+                    }
+                    columns[i] = {column, n};
+                } else {
+                    columns[i] = values[input].subspan(start, n);
+                }
+            }
+            evaluate_batch(body.expression, columns, {terms.data(), n});
+            partials[chunk] = combine(aggregate.kind, terms.data(), n);
+        }
+    };
+    if (pool != nullptr) {
+        pool->parallel_for(num_chunks, 1, run_chunks);
+    } else {
+        run_chunks(0, num_chunks);
+    }
+    return combine(aggregate.kind, partials.data(), num_chunks);
+}
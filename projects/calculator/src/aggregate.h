@@ -0,0 +1,98 @@
+#ifndef AGGREGATE_H
+#define AGGREGATE_H
+
+#include "calculator.h"
+#include "thread_pool.h"
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum class AggregateKind : std::uint8_t {
+    Sum,
+    Product,
+    Min,
+    Max,
+};
+
+// An expression with aggregates in it, evaluated as loops rather than one call per
+// term:
+//   sum(i, first, last, body)    body for every whole i from first to last, inclusive;
+//   prod(...), min(...), max(...) likewise. Empty ranges give 0, 1, +inf and -inf.
+//   sum(body)                    body for every element of the arrays it mentions
+//                                (see evaluate()); prod, min and max likewise.
+// min and max with two arguments are still the built-ins. Aggregates may appear
+// anywhere in the expression, as in "sum(x) / sum(1 + 0 * x)", but not inside one
+// another. Names starting with "__" are reserved.
+//
+// Terms are computed in chunks of a fixed size, spread over a ThreadPool, each chunk
+// with the SIMD batch kernels (see evaluate_batch(), whose 1-ulp caveat applies to
+// built-ins here too). Sums and products are taken pairwise, in a tree whose shape
+// depends only on the number of terms: the error grows with log(n) rather than n, and
+// the result is the same bit for bit whatever the number of threads.
+class AggregateExpression {
+public:
+    // Slot of a variable, in order of first appearance in the source; index variables
+    // are not slots. Throws if the expression does not mention `name`.
+    [[nodiscard]] std::uint32_t slot(std::string_view name) const;
+    [[nodiscard]] std::size_t num_slots() const { return variables.size(); }
+    [[nodiscard]] std::span<const std::string> get_variables() const { return variables; }
+
+    // `values[slot]` is one value for a scalar or any number for an array. Arrays may
+    // only appear inside single-argument aggregates, and those in one aggregate must
+    // be the same length. Throws std::runtime_error on a missing binding, a misused or
+    // mismatched array, bounds that are not whole numbers, or a division by zero.
+    // Without a pool, runs on the calling thread.
+    [[nodiscard]] double evaluate(std::span<const std::span<const double>> values) const;
+    [[nodiscard]] double evaluate(std::span<const std::span<const double>> values, ThreadPool& pool) const;
+    // Same, every binding a scalar.
+    [[nodiscard]] double evaluate(std::span<const double> scalars, ThreadPool& pool) const;
+private:
+    friend Result<AggregateExpression> try_parse_aggregate(std::string_view source);
+
+    // Where each variable slot of a CompiledExpression gets its value: a slot of this
+    // expression, the index of the enclosing aggregate, or the result of aggregate
+    // `k` (kAggregateInput + k).
+    static constexpr std::uint32_t kIndexInput = UINT32_MAX;
+    static constexpr std::uint32_t kAggregateInput = std::uint32_t{1} << 31;
+
+    struct Part {
+        CompiledExpression expression;
+        std::vector<std::uint32_t> inputs;
+    };
+    struct Aggregate {
+        AggregateKind kind;
+        std::optional<Part> first;   // bounds, for aggregates over a range
+        std::optional<Part> last;
+        Part body;
+        std::uint32_t bounds_offset = 0;   // of the first bound in the source, for errors
+    };
+
+    AggregateExpression(Part outer, std::vector<Aggregate> aggregates, std::vector<std::string> variables)
+        : outer(std::move(outer)), aggregates(std::move(aggregates)), variables(std::move(variables)) {}
+
+    [[nodiscard]] double run(std::span<const std::span<const double>> values, ThreadPool* pool) const;
+    [[nodiscard]] double reduce(const Aggregate& aggregate, std::span<const std::span<const double>> values,
+                                ThreadPool* pool) const;
+    [[nodiscard]] double evaluate_scalar(const Part& part, std::span<const std::span<const double>> values,
+                                         std::span<const double> results) const;
+
+    Part outer;
+    std::vector<Aggregate> aggregates;
+    std::vector<std::string> variables;
+};
+
+// Parses an expression that may contain aggregates. Syntax errors come back with
+// their offset in `source`, as from try_parse_expression().
+[[nodiscard]] Result<AggregateExpression> try_parse_aggregate(std::string_view source);
+// Same, throwing std::runtime_error(describe(error)).
+[[nodiscard]] AggregateExpression parse_aggregate(std::string_view source);
+
+// Whether `source` calls an aggregate, so a front end can route it here instead of to
+// parse_expression(). Cheap: one lexing pass.
+[[nodiscard]] bool has_aggregate(std::string_view source);
+
+#endif // AGGREGATE_H
@@ -0,0 +1,143 @@
+#include "batch.h"
+#include "batch_kernels.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Rows per block: 2 KiB per register, so a block's working set stays in L1 for
+// typical expression sizes.
+constexpr std::size_t kBlockRows = 256;
+
+// Portable fallback, used when no SIMD kernel set applies.
+void scalar_add(const double* lhs, const double* rhs, double* dst, std::size_t n) {
+    for (std::size_t i = 0; i < n; ++i) dst[i] = lhs[i] + rhs[i];
+}
+void scalar_sub(const double* lhs, const double* rhs, double* dst, std::size_t n) {
+    for (std::size_t i = 0; i < n; ++i) dst[i] = lhs[i] - rhs[i];
+}
+void scalar_mul(const double* lhs, const double* rhs, double* dst, std::size_t n) {
+    for (std::size_t i = 0; i < n; ++i) dst[i] = lhs[i] * rhs[i];
+}
+bool scalar_div(const double* lhs, const double* rhs, double* dst, std::size_t n) {
+    bool ok = true;
+    for (std::size_t i = 0; i < n; ++i) {
+        ok &= rhs[i] != 0.0;
+        dst[i] = lhs[i] / rhs[i];
+    }
+    return ok;
+}
+void scalar_neg(const double* src, double* dst, std::size_t n) {
+    for (std::size_t i = 0; i < n; ++i) dst[i] = -src[i];
+}
+void scalar_scale(double a, const double* x, double* dst, std::size_t n) {
+    for (std::size_t i = 0; i < n; ++i) dst[i] = tangent_term(a, x[i]);
+}
+void scalar_combine(double a, const double* x, double b, const double* y, double* dst, std::size_t n) {
+    for (std::size_t i = 0; i < n; ++i) dst[i] = tangent_term(a, x[i]) + tangent_term(b, y[i]);
+}
+
+} // namespace
+
+const BatchKernels scalar_kernels = {
+    scalar_add, scalar_sub, scalar_mul, scalar_div, scalar_neg,
+    {call_scalar_builtin<BuiltinId::Sqrt>, call_scalar_builtin<BuiltinId::Exp>, call_scalar_builtin<BuiltinId::Log>,
+     call_scalar_builtin<BuiltinId::Abs>, call_scalar_builtin<BuiltinId::Sin>, call_scalar_builtin<BuiltinId::Cos>,
+     call_scalar_builtin<BuiltinId::Pow>, call_scalar_builtin<BuiltinId::Min>, call_scalar_builtin<BuiltinId::Max>},
+    scalar_scale, scalar_combine,
+};
+
+const BatchKernels& kernels_for(SimdLevel level) {
+    switch (std::min(level, detect_simd_level())) {
+#if defined(CALCULATOR_X86_KERNELS)
+        case SimdLevel::AVX2: return avx2_kernels;
+        case SimdLevel::SSE2: return sse2_kernels;
+#endif
+        default: return scalar_kernels;
+    }
+}
+
+SimdLevel detect_simd_level() {
+#if defined(CALCULATOR_X86_KERNELS)
+    static const SimdLevel level = __builtin_cpu_supports("avx2") ? SimdLevel::AVX2 : SimdLevel::SSE2;
+    return level;
+#else
+    return SimdLevel::Scalar;
+#endif
+}
+
+const char* to_string(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::Scalar: return "scalar";
+        case SimdLevel::SSE2: return "sse2";
+        case SimdLevel::AVX2: return "avx2";
+    }
+    return "unknown";
+}
+
+void evaluate_batch(const CompiledExpression& expression, std::span<const std::span<const double>> columns,
+                    std::span<double> out) {
+    evaluate_batch(expression, columns, out, detect_simd_level());
+}
+
+void evaluate_batch(const CompiledExpression& expression, std::span<const std::span<const double>> columns,
+                    std::span<double> out, SimdLevel level) {
+    const Program& program = expression.get_program();
+    auto variables = expression.get_variables();
+    if (columns.size() < program.num_variables) {
+        throw std::runtime_error("Unbound variable '" + variables[columns.size()] + "'");
+    }
+    for (std::uint32_t slot = 0; slot < program.num_variables; ++slot) {
+        if (columns[slot].size() < out.size()) {
+            throw std::runtime_error("Column for '" + variables[slot] + "' is shorter than the output");
+        }
+    }
+    const BatchKernels& kernels = kernels_for(level);
+
+    // Register blocks. Constants are broadcast once; temporaries are reused by every
+    // block. `src[r]` is where register r can be read for the current block.
+    const auto num_constants = static_cast<std::uint32_t>(program.constants.size());
+    const std::uint32_t first_temporary = num_constants + program.num_variables;
+    std::vector<double> storage(static_cast<std::size_t>(num_constants + program.num_registers - first_temporary) *
+                                kBlockRows);
+    std::vector<const double*> src(program.num_registers);
+    for (std::uint32_t c = 0; c < num_constants; ++c) {
+        double* block = storage.data() + c * kBlockRows;
+        std::fill_n(block, kBlockRows, program.constants[c]);
+        src[c] = block;
+    }
+    double* temporaries = storage.data() + num_constants * kBlockRows;
+
+    for (std::size_t start = 0; start < out.size(); start += kBlockRows) {
+        const std::size_t rows = std::min(kBlockRows, out.size() - start);
+        for (std::uint32_t slot = 0; slot < program.num_variables; ++slot) {
+            src[num_constants + slot] = columns[slot].data() + start;
+        }
+        for (const Instruction& ins : program.code) {
+            // The final instruction writes straight into the output column.
+            double* dst = ins.dst == program.result ? out.data() + start
+                                                    : temporaries + (ins.dst - first_temporary) * kBlockRows;
+            switch (ins.op) {
+                case OpCode::Add: kernels.add(src[ins.lhs], src[ins.rhs], dst, rows); break;
+                case OpCode::Sub: kernels.sub(src[ins.lhs], src[ins.rhs], dst, rows); break;
+                case OpCode::Mul: kernels.mul(src[ins.lhs], src[ins.rhs], dst, rows); break;
+                case OpCode::Div:
+                    if (!kernels.div(src[ins.lhs], src[ins.rhs], dst, rows)) {
+                        throw std::runtime_error("Division by zero!");
+                    }
+                    break;
+                case OpCode::Neg: kernels.neg(src[ins.lhs], dst, rows); break;
+                case OpCode::Pow:
+                    kernels.call[static_cast<std::size_t>(BuiltinId::Pow)](src[ins.lhs], src[ins.rhs], dst, rows);
+                    break;
+                case OpCode::Call: kernels.call[ins.builtin](src[ins.lhs], src[ins.rhs], dst, rows); break;
+            }
+            src[ins.dst] = dst;
+        }
+        if (program.code.empty()) {
+            std::copy_n(src[program.result], rows, out.data() + start);
+        }
+    }
+}
@@ -0,0 +1,37 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "calculator.h"
+
+#include <cstddef>
+#include <span>
+
+// Instruction sets the batch kernels are compiled for.
+enum class SimdLevel {
+    Scalar,
+    SSE2,
+    AVX2,
+};
+
+// Best level supported by the CPU we are running on.
+[[nodiscard]] SimdLevel detect_simd_level();
+[[nodiscard]] const char* to_string(SimdLevel level);
+
+// Evaluates one expression over many rows at once (columnar evaluation).
+//
+// `columns[slot]` holds the values of variable `slot` for every row and must be at
+// least `out.size()` long. Rows are processed in blocks: each bytecode instruction
+// runs as one vectorized loop over the whole block, so dispatch cost is paid once
+// per block instead of once per row. Built-in functions and `^` use vectorized
+// versions that may differ from the scalar evaluators' libm results by 1 ulp (see
+// batch_math.h). Throws "Division by zero!" if any row divides by zero, like the
+// scalar evaluators.
+void evaluate_batch(const CompiledExpression& expression, std::span<const std::span<const double>> columns,
+                    std::span<double> out);
+
+// Same, forcing a particular kernel set (mainly for benchmarks). Levels the CPU does
+// not support fall back to the best supported one.
+void evaluate_batch(const CompiledExpression& expression, std::span<const std::span<const double>> columns,
+                    std::span<double> out, SimdLevel level);
+
+#endif // BATCH_H
@@ -0,0 +1,138 @@
+// AVX2 batch kernels: four doubles per instruction. Only called after a runtime CPU
+// check (see detect_simd_level()).
+//
+// AVX2 is enabled for a region of this file, not with -mavx2 for all of it: inline
+// functions from the shared headers (the built-in table, tangent_term(), the standard
+// algorithms) are emitted here as weak copies, and the linker may keep this file's
+// copy for every caller. So every header is included before the region, and within it
+// only this file's kernels, Lanes and batch_math.h's templates are defined, all in
+// anonymous namespaces.
+#include "batch_kernels.h"
+#include "functions.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <immintrin.h>
+#include <limits>
+
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+
+#include "batch_math.h"
+
+namespace {
+
+void add(const double* lhs, const double* rhs, double* dst, std::size_t n) {
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(dst + i, _mm256_add_pd(_mm256_loadu_pd(lhs + i), _mm256_loadu_pd(rhs + i)));
+    }
+    for (; i < n; ++i) {
+        dst[i] = lhs[i] + rhs[i];
+    }
+}
+
+void sub(const double* lhs, const double* rhs, double* dst, std::size_t n) {
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(dst + i, _mm256_sub_pd(_mm256_loadu_pd(lhs + i), _mm256_loadu_pd(rhs + i)));
+    }
+    for (; i < n; ++i) {
+        dst[i] = lhs[i] - rhs[i];
+    }
+}
+
+void mul(const double* lhs, const double* rhs, double* dst, std::size_t n) {
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(dst + i, _mm256_mul_pd(_mm256_loadu_pd(lhs + i), _mm256_loadu_pd(rhs + i)));
+    }
+    for (; i < n; ++i) {
+        dst[i] = lhs[i] * rhs[i];
+    }
+}
+
+bool div(const double* lhs, const double* rhs, double* dst, std::size_t n) {
+    const __m256d zero = _mm256_setzero_pd();
+    __m256d any_zero = zero;
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d divisor = _mm256_loadu_pd(rhs + i);
+        any_zero = _mm256_or_pd(any_zero, _mm256_cmp_pd(divisor, zero, _CMP_EQ_OQ));
+        _mm256_storeu_pd(dst + i, _mm256_div_pd(_mm256_loadu_pd(lhs + i), divisor));
+    }
+    bool ok = _mm256_movemask_pd(any_zero) == 0;
+    for (; i < n; ++i) {
+        ok &= rhs[i] != 0.0;
+        dst[i] = lhs[i] / rhs[i];
+    }
+    return ok;
+}
+
+void neg(const double* src, double* dst, std::size_t n) {
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(dst + i, _mm256_xor_pd(_mm256_loadu_pd(src + i), sign));
+    }
+    for (; i < n; ++i) {
+        dst[i] = -src[i];
+    }
+}
+
+// tangent_term() lane by lane: the product is masked to zero where the tangent is zero.
+void scale(double a, const double* x, double* dst, std::size_t n) {
+    const __m256d va = _mm256_set1_pd(a);
+    const __m256d zero = _mm256_setzero_pd();
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d vx = _mm256_loadu_pd(x + i);
+        _mm256_storeu_pd(dst + i, _mm256_and_pd(_mm256_mul_pd(va, vx), _mm256_cmp_pd(vx, zero, _CMP_NEQ_UQ)));
+    }
+    for (; i < n; ++i) {
+        dst[i] = tangent_term(a, x[i]);
+    }
+}
+
+void combine(double a, const double* x, double b, const double* y, double* dst, std::size_t n) {
+    const __m256d va = _mm256_set1_pd(a);
+    const __m256d vb = _mm256_set1_pd(b);
+    const __m256d zero = _mm256_setzero_pd();
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d vx = _mm256_loadu_pd(x + i);
+        __m256d vy = _mm256_loadu_pd(y + i);
+        __m256d px = _mm256_and_pd(_mm256_mul_pd(va, vx), _mm256_cmp_pd(vx, zero, _CMP_NEQ_UQ));
+        __m256d py = _mm256_and_pd(_mm256_mul_pd(vb, vy), _mm256_cmp_pd(vy, zero, _CMP_NEQ_UQ));
+        _mm256_storeu_pd(dst + i, _mm256_add_pd(px, py));
+    }
+    for (; i < n; ++i) {
+        dst[i] = tangent_term(a, x[i]) + tangent_term(b, y[i]);
+    }
+}
+
+// Lane type for the vectorized built-ins (see batch_math.h).
+struct Lanes {
+    typedef double D __attribute__((vector_size(32)));
+    typedef unsigned long long U __attribute__((vector_size(32)));
+    using Mask = decltype(D{} < D{});
+    static constexpr std::size_t width = 4;
+    static D sqrt(D x) { return (D)_mm256_sqrt_pd((__m256d)x); }
+    static bool any(Mask mask) { return _mm256_movemask_pd((__m256d)mask) != 0; }
+};
+
+} // namespace
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+const BatchKernels avx2_kernels = {add, sub, mul, div, neg, batch_math::function_kernels<Lanes>,
+                                    scale, combine};
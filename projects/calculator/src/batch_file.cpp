@@ -0,0 +1,154 @@
+#include "batch_file.h"
+#include "expression_cache.h"
+#include "mapped_file.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Input bytes per unit of work. Large enough to amortize scheduling, small enough to
+// balance threads and keep the reordering window modest.
+constexpr std::size_t kChunkBytes = 1u << 22;
+
+bool is_blank(std::string_view line) {
+    return std::all_of(line.begin(), line.end(), [](char c) { return c == ' ' || (c >= '\t' && c <= '\r'); });
+}
+
+std::size_t evaluate_lines(std::string_view text, ExpressionCache& cache, std::string& out) {
+    std::size_t failures = 0;
+    while (!text.empty()) {
+        std::size_t newline = text.find('\n');
+        std::string_view line = text.substr(0, newline);
+        text.remove_prefix(newline == std::string_view::npos ? text.size() : newline + 1);
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+
+        if (!is_blank(line)) {
+            if (Result<ExactValue> result = cache.try_evaluate_exact(line)) {
+                append_result(out, *result);
+            } else {
+                out += "Error: ";
+                out += describe(result.error());
+                ++failures;
+            }
+        }
+        out += '\n';
+    }
+    return failures;
+}
+
+} // namespace
+
+std::size_t evaluate_lines(std::string_view text, std::string& out) {
+    ExpressionCache cache;
+    return evaluate_lines(text, cache, out);
+}
+
+std::vector<std::string_view> split_lines(std::string_view text, std::size_t chunk_bytes) {
+    std::vector<std::string_view> chunks;
+    while (!text.empty()) {
+        std::size_t end = std::min(text.size(), chunk_bytes);
+        if (end < text.size()) {
+            const void* newline = std::memchr(text.data() + end, '\n', text.size() - end);
+            end = newline ? static_cast<const char*>(newline) - text.data() + 1 : text.size();
+        }
+        chunks.push_back(text.substr(0, end));
+        text.remove_prefix(end);
+    }
+    return chunks;
+}
+
+std::size_t write_chunks_in_order(std::size_t count, unsigned threads, std::FILE* out,
+                                  const std::function<ChunkWorker()>& make_worker) {
+    threads = threads != 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+    threads = static_cast<unsigned>(std::min<std::size_t>(threads, std::max<std::size_t>(1, count)));
+
+    if (threads == 1) {
+        const ChunkWorker work = make_worker();
+        std::string buffer;
+        std::size_t failures = 0;
+        for (std::size_t index = 0; index < count; ++index) {
+            buffer.clear();
+            failures += work(index, buffer);
+            std::fwrite(buffer.data(), 1, buffer.size(), out);
+        }
+        std::fflush(out);
+        return failures;
+    }
+
+    // Workers claim chunks in order and publish each chunk's output; this thread
+    // writes them back in input order. Workers stay at most `window` chunks ahead of
+    // the writer so memory use is bounded.
+    const std::size_t window = 4 * static_cast<std::size_t>(threads);
+    std::vector<std::string> outputs(count);
+    std::vector<char> ready(count, 0);
+    std::atomic<std::size_t> next_chunk{0};
+    std::atomic<std::size_t> failures{0};
+    std::size_t written = 0;
+    std::mutex mutex;
+    std::condition_variable chunk_done;
+    std::condition_variable chunk_written;
+
+    auto worker = [&] {
+        const ChunkWorker work = make_worker();
+        for (;;) {
+            std::size_t index = next_chunk.fetch_add(1);
+            if (index >= count) {
+                return;
+            }
+            {
+                std::unique_lock lock(mutex);
+                chunk_written.wait(lock, [&] { return index < written + window; });
+            }
+            std::string buffer;
+            failures += work(index, buffer);
+            {
+                std::lock_guard lock(mutex);
+                outputs[index] = std::move(buffer);
+                ready[index] = 1;
+            }
+            chunk_done.notify_one();
+        }
+    };
+
+    std::vector<std::jthread> pool;
+    pool.reserve(threads);
+    for (unsigned t = 0; t < threads; ++t) {
+        pool.emplace_back(worker);
+    }
+    while (written < count) {
+        std::string buffer;
+        {
+            std::unique_lock lock(mutex);
+            chunk_done.wait(lock, [&] { return ready[written] != 0; });
+            buffer = std::move(outputs[written]);
+        }
+        std::fwrite(buffer.data(), 1, buffer.size(), out);
+        {
+            std::lock_guard lock(mutex);
+            ++written;
+        }
+        chunk_written.notify_all();
+    }
+    std::fflush(out);
+    return failures;
+}
+
+std::size_t run_batch_file(const BatchFileOptions& options, std::FILE* out) {
+    MappedFile input(options.input_path);
+    const std::vector<std::string_view> chunks = split_lines(input.contents(), kChunkBytes);
+    return write_chunks_in_order(chunks.size(), options.threads, out, [&]() -> ChunkWorker {
+        return [&chunks, cache = std::make_shared<ExpressionCache>()](std::size_t index, std::string& buffer) {
+            buffer.reserve(chunks[index].size());
+            return evaluate_lines(chunks[index], *cache, buffer);
+        };
+    });
+}
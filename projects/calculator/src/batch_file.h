@@ -0,0 +1,46 @@
+#ifndef BATCH_FILE_H
+#define BATCH_FILE_H
+
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct BatchFileOptions {
+    std::string input_path;
+    unsigned threads = 1;     // 0 = one per hardware thread
+};
+
+// Evaluates every line of a file and writes one output line per input line, in input
+// order: the result (shortest round-trip form), "Error: <message>", or an empty line
+// for a blank input line.
+//
+// The input is memory-mapped and split into line-aligned chunks; with several threads
+// each chunk is evaluated independently (each thread with its own ExpressionCache) and
+// the chunk outputs are written back in order. Output goes through large buffers with
+// no per-line flush. Returns the number of lines that failed.
+std::size_t run_batch_file(const BatchFileOptions& options, std::FILE* out);
+
+// Evaluates the lines of `text` into `out` (appending). Exposed for callers that
+// already hold the text in memory.
+std::size_t evaluate_lines(std::string_view text, std::string& out);
+
+// Shared by the file modes (see also csv_file.h).
+
+// Splits `text` into pieces of roughly `chunk_bytes` that each end just after a '\n'
+// (or at the end of the text).
+std::vector<std::string_view> split_lines(std::string_view text, std::size_t chunk_bytes);
+
+// Appends the output for chunk `index` to `out` and returns how many of its lines
+// failed.
+using ChunkWorker = std::function<std::size_t(std::size_t index, std::string& out)>;
+
+// Runs a worker over chunks 0 to `count` - 1 on up to `threads` threads (0 = one per
+// hardware thread) and writes the outputs to `out` in chunk order. `make_worker` is
+// called once per thread, so a worker can keep per-thread state such as a cache.
+// Returns the total of the failure counts.
+std::size_t write_chunks_in_order(std::size_t count, unsigned threads, std::FILE* out,
+                                  const std::function<ChunkWorker()>& make_worker);
+
+#endif // BATCH_FILE_H
@@ -0,0 +1,62 @@
+#ifndef BATCH_KERNELS_H
+#define BATCH_KERNELS_H
+
+#include "functions.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// dst[i] = lhs[i] <op> rhs[i] for i in [0, n). Operands may alias dst.
+using BinaryKernel = void (*)(const double* lhs, const double* rhs, double* dst, std::size_t n);
+// As BinaryKernel for division; returns false if any rhs[i] was zero.
+using DivideKernel = bool (*)(const double* lhs, const double* rhs, double* dst, std::size_t n);
+// dst[i] = <op> src[i].
+using UnaryKernel = void (*)(const double* src, double* dst, std::size_t n);
+// Tangent propagation for forward-mode differentiation (see gradient.h):
+// dst[i] = a * x[i], and dst[i] = a * x[i] + b * y[i]. Each product is computed by
+// tangent_term(), so a zero x[i] contributes zero even where `a` is infinite or NaN.
+// Operands may alias dst.
+using ScaleKernel = void (*)(double a, const double* x, double* dst, std::size_t n);
+using CombineKernel = void (*)(double a, const double* x, double b, const double* y, double* dst, std::size_t n);
+
+// The product of a partial derivative and a tangent, taking a zero tangent to mean
+// "does not depend on this operand": 0 * inf is 0 here, not NaN.
+inline double tangent_term(double partial, double tangent) {
+    return tangent != 0.0 ? partial * tangent : 0.0;
+}
+
+// One implementation of every bytecode operator for a given instruction set. Each set
+// lives in its own translation unit so it can be compiled with matching -m flags.
+struct BatchKernels {
+    BinaryKernel add;
+    BinaryKernel sub;
+    BinaryKernel mul;
+    DivideKernel div;
+    UnaryKernel neg;
+    // One kernel per built-in function, indexed by BuiltinId; unary built-ins ignore
+    // rhs. `^` uses the Pow entry.
+    std::array<BinaryKernel, kNumBuiltins> call;
+    ScaleKernel scale;
+    CombineKernel combine;
+};
+
+// Built-in kernel that calls the scalar (libm) version row by row.
+template <BuiltinId Id>
+void call_scalar_builtin(const double* lhs, const double* rhs, double* dst, std::size_t n) {
+    const auto fn = get_builtin(static_cast<std::uint32_t>(Id)).scalar;
+    for (std::size_t i = 0; i < n; ++i) dst[i] = fn(lhs[i], rhs[i]);
+}
+
+enum class SimdLevel;
+
+extern const BatchKernels scalar_kernels;
+#if defined(CALCULATOR_X86_KERNELS)
+extern const BatchKernels sse2_kernels;
+extern const BatchKernels avx2_kernels;
+#endif
+
+// The kernel set for `level`, or for the best level the CPU supports if it is lower.
+[[nodiscard]] const BatchKernels& kernels_for(SimdLevel level);
+
+#endif // BATCH_KERNELS_H
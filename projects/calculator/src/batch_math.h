@@ -0,0 +1,467 @@
+#ifndef BATCH_MATH_H
+#define BATCH_MATH_H
+
+// Vectorized built-in functions for the SIMD batch kernels, written once with GCC
+// vector extensions and instantiated by each instruction-set translation unit for its
+// own lane type. A lane type `L` provides:
+//   D, U     vectors of double and of uint64_t with the same number of lanes
+//   Mask     the type of a comparison between two D (all ones where true)
+//   width    lanes per vector
+//   sqrt(D)  and any(Mask), which need the matching intrinsics
+//
+// sqrt and abs are exact and bit-identical to libm; min and max are bit-identical to
+// the scalar built-ins, which also fix the sign of min(+0, -0) (see min_value()). exp,
+// log, sin, cos and pow are within 1 ulp of glibc (bench/math_bench.cpp checks these
+// bounds). The algorithms use only +, -, *, / and bit operations, never contracted
+// into FMA, so the vector code computes the same bits at every width. Lanes it does not cover
+// (sin and cos of |x| > 2^19; pow of a zero, infinite or NaN operand, of x < 0 with
+// a non-integral y, or near overflow) are recomputed with the scalar built-in.
+
+#include "batch_kernels.h"
+#include "functions.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+// Everything here has internal linkage: the header is compiled once per instruction
+// set with different -m flags, and the linker must never merge those copies.
+namespace {
+
+namespace batch_math {
+
+constexpr double kInfinity = std::numeric_limits<double>::infinity();
+constexpr double kNaN = std::numeric_limits<double>::quiet_NaN();
+// Adding 1.5 * 2^52 rounds a double below 2^51 in magnitude to an integer and leaves
+// that integer in the low mantissa bits.
+constexpr double kShifter = 0x1.8p52;
+
+template <typename V, typename T>
+V splat(T value) {
+    V out;
+    for (std::size_t i = 0; i < sizeof(V) / sizeof(T); ++i) {
+        out[i] = value;
+    }
+    return out;
+}
+
+template <typename L>
+typename L::D clear_low_word(typename L::D x) {
+    using U = typename L::U;
+    return (typename L::D)((U)x & 0xffffffff00000000ULL);
+}
+
+template <typename L>
+typename L::D abs(typename L::D x) {
+    using U = typename L::U;
+    return (typename L::D)((U)x & 0x7fffffffffffffffULL);
+}
+
+// Flips the sign of the lanes whose `bit` is set.
+template <typename L>
+typename L::D flip_sign(typename L::D x, typename L::U bit) {
+    using U = typename L::U;
+    return (typename L::D)((U)x ^ (bit << 63));
+}
+
+// exp(x) = 2^k * exp(r) with x = k*ln2 + r and |r| <= ln2/2 (Cody-Waite reduction,
+// ln2 split so k*ln2hi is exact); exp(r) from its Taylor series.
+template <typename L>
+typename L::D exp(typename L::D x) {
+    using D = typename L::D;
+    using U = typename L::U;
+    constexpr double kLog2e = 1.44269504088896338700e+00;
+    constexpr double kLn2Hi = 6.93147180369123816490e-01;
+    constexpr double kLn2Lo = 1.90821492927058770002e-10;
+
+    // Out-of-range arguments saturate to 0 and infinity; NaN compares false and stays.
+    x = x < splat<D>(-746.0) ? splat<D>(-746.0) : x;
+    x = x > splat<D>(710.0) ? splat<D>(710.0) : x;
+    const D t = x * kLog2e + kShifter;
+    const D k = t - kShifter;
+    D r = x - k * kLn2Hi;
+    r = r - k * kLn2Lo;
+
+    // Terms up to r^13/13!; the next one is below 2^-57 on |r| <= ln2/2. Evaluated in
+    // pairs (Estrin's scheme) to shorten the dependency chain.
+    const D r2 = r * r;
+    const D r4 = r2 * r2;
+    const D p01 = 0.5 + r * (1.0 / 6.0);
+    const D p23 = 1.0 / 24.0 + r * (1.0 / 120.0);
+    const D p45 = 1.0 / 720.0 + r * (1.0 / 5040.0);
+    const D p67 = 1.0 / 40320.0 + r * (1.0 / 362880.0);
+    const D p89 = 1.0 / 3628800.0 + r * (1.0 / 39916800.0);
+    const D p1011 = 1.0 / 479001600.0 + r * (1.0 / 6227020800.0);
+    const D p = (p01 + r2 * p23) + r4 * ((p45 + r2 * p67) + r4 * (p89 + r2 * p1011));
+    const D m = 1.0 + (r + r2 * p);
+
+    // Scale by 2^k in two halves, so every factor is a normal power of two and a
+    // result in the subnormal range is rounded only once.
+    const U biased = (U)t - (U)splat<D>(kShifter) + 2048; // k + 2048
+    const U half = biased >> 1;
+    const D scale1 = (D)((half - 1) << 52);
+    const D scale2 = (D)((biased - half - 1) << 52);
+    return m * scale1 * scale2;
+}
+
+// log(x) = k*ln2 + log(m) with m in [sqrt(2)/2, sqrt(2)), where log(m) is fdlibm's
+// series in s = (m-1)/(m+1).
+template <typename L>
+typename L::D log(typename L::D x) {
+    using D = typename L::D;
+    using U = typename L::U;
+    constexpr double kLn2Hi = 6.93147180369123816490e-01;
+    constexpr double kLn2Lo = 1.90821492927058770002e-10;
+    constexpr double kSqrt2 = 1.41421356237309514547e+00;
+    constexpr double Lg1 = 6.666666666666735130e-01;
+    constexpr double Lg2 = 3.999999999940941908e-01;
+    constexpr double Lg3 = 2.857142874366239149e-01;
+    constexpr double Lg4 = 2.222219843214978396e-01;
+    constexpr double Lg5 = 1.818357216161805012e-01;
+    constexpr double Lg6 = 1.531383769920937332e-01;
+    constexpr double Lg7 = 1.479819860511658591e-01;
+
+    // Subnormals are scaled into the normal range first.
+    const auto subnormal = x < splat<D>(0x1p-1022);
+    const U bits = (U)(subnormal ? x * 0x1p54 : x);
+    U exponent = (bits >> 52) & 0x7ff;
+    D m = (D)((bits & 0x000fffffffffffffULL) | 0x3ff0000000000000ULL);
+    const auto high = m > splat<D>(kSqrt2);
+    m = high ? m * 0.5 : m;
+    exponent = exponent + ((U)high & 1) - ((U)subnormal & 54);
+    const D k = (D)((U)splat<D>(kShifter) + exponent - 1023) - kShifter;
+
+    const D f = m - 1.0;
+    const D hfsq = 0.5 * f * f;
+    const D s = f / (2.0 + f);
+    const D z = s * s;
+    const D w = z * z;
+    const D t1 = w * (Lg2 + w * (Lg4 + w * Lg6));
+    const D t2 = z * (Lg1 + w * (Lg3 + w * (Lg5 + w * Lg7)));
+    const D r = t2 + t1;
+    D result = k * kLn2Hi - ((hfsq - (s * (hfsq + r) + k * kLn2Lo)) - f);
+
+    result = x == splat<D>(kInfinity) ? x : result;
+    result = x < splat<D>(0.0) ? splat<D>(kNaN) : result;
+    result = x == splat<D>(0.0) ? splat<D>(-kInfinity) : result;
+    return x != x ? x : result;
+}
+
+// Largest |x| whose reduction modulo pi/2 below stays accurate: the quotient must fit
+// in 20 bits so that q * kPio2_1 and q * kPio2_2 are exact.
+constexpr double kMaxTrigArgument = 0x1p19;
+
+// x = q*pi/2 + (r + y), |r + y| <= pi/4, with pi/2 split into three 33-bit parts.
+// Returns q mod 4.
+template <typename L>
+typename L::U reduce_half_pi(typename L::D x, typename L::D& r, typename L::D& y) {
+    using D = typename L::D;
+    using U = typename L::U;
+    constexpr double kTwoOverPi = 6.36619772367581382433e-01;
+    constexpr double kPio2_1 = 1.57079632673412561417e+00;
+    constexpr double kPio2_2 = 6.07710050630396597660e-11;
+    constexpr double kPio2_3 = 2.02226624871116645580e-21;
+    constexpr double kPio2_3t = 8.47842766036889956997e-32;
+
+    const D t = x * kTwoOverPi + kShifter;
+    const D q = t - kShifter;
+    const D r1 = x - q * kPio2_1;
+    const D w = q * kPio2_2;
+    const D r2 = r1 - w;
+    const D tail = (((r1 - r2) - w) - q * kPio2_3) - q * kPio2_3t;
+    r = r2 + tail;
+    y = (r2 - r) + tail;
+    return (U)t & 3;
+}
+
+// fdlibm's __kernel_sin and __kernel_cos: sin and cos of r + y for |r| <= pi/4.
+template <typename L>
+typename L::D kernel_sin(typename L::D r, typename L::D y) {
+    using D = typename L::D;
+    constexpr double S1 = -1.66666666666666324348e-01;
+    constexpr double S2 = 8.33333333332248946124e-03;
+    constexpr double S3 = -1.98412698298579493134e-04;
+    constexpr double S4 = 2.75573137070700676789e-06;
+    constexpr double S5 = -2.50507602534068634195e-08;
+    constexpr double S6 = 1.58969099521155010221e-10;
+    const D z = r * r;
+    const D v = z * r;
+    const D p = S2 + z * (S3 + z * (S4 + z * (S5 + z * S6)));
+    return r - ((z * (0.5 * y - v * p) - y) - v * S1);
+}
+
+template <typename L>
+typename L::D kernel_cos(typename L::D r, typename L::D y) {
+    using D = typename L::D;
+    constexpr double C1 = 4.16666666666666019037e-02;
+    constexpr double C2 = -1.38888888888741095749e-03;
+    constexpr double C3 = 2.48015872894767294178e-05;
+    constexpr double C4 = -2.75573143513906633035e-07;
+    constexpr double C5 = 2.08757232129817482790e-09;
+    constexpr double C6 = -1.13596475577881948265e-11;
+    const D z = r * r;
+    const D p = z * (C1 + z * (C2 + z * (C3 + z * (C4 + z * (C5 + z * C6)))));
+    const D hz = 0.5 * z;
+    const D w = 1.0 - hz;
+    return w + (((1.0 - w) - hz) + (z * p - r * y));
+}
+
+template <typename L>
+typename L::D sin(typename L::D x, typename L::Mask& fallback) {
+    using D = typename L::D;
+    using U = typename L::U;
+    fallback = !(abs<L>(x) <= splat<D>(kMaxTrigArgument));
+    D r;
+    D y;
+    const U quadrant = reduce_half_pi<L>(x, r, y);
+    const D value = (quadrant & 1) != 0 ? kernel_cos<L>(r, y) : kernel_sin<L>(r, y);
+    const D result = flip_sign<L>(value, quadrant >> 1);
+    // sin(x) rounds to x below 2^-26; this also keeps the sign of -0.
+    return abs<L>(x) < splat<D>(0x1p-26) ? x : result;
+}
+
+template <typename L>
+typename L::D cos(typename L::D x, typename L::Mask& fallback) {
+    using D = typename L::D;
+    using U = typename L::U;
+    fallback = !(abs<L>(x) <= splat<D>(kMaxTrigArgument));
+    D r;
+    D y;
+    const U quadrant = reduce_half_pi<L>(x, r, y);
+    const D value = (quadrant & 1) != 0 ? kernel_sin<L>(r, y) : kernel_cos<L>(r, y);
+    return flip_sign<L>(value, ((quadrant + 1) >> 1) & 1);
+}
+
+// fdlibm's __ieee754_pow for finite x != 0 and finite y: log2|x| to about 64 bits as
+// t1 + t2, y * log2|x| as p_h + p_l, then 2^(p_h + p_l). A negative x is allowed
+// when y is an integer below 2^51; the sign comes from y's parity.
+template <typename L>
+typename L::D pow(typename L::D x, typename L::D y, typename L::Mask& fallback) {
+    using D = typename L::D;
+    using U = typename L::U;
+    constexpr double kBp1 = 1.5;
+    constexpr double kDpH1 = 5.84962487220764160156e-01; // log2(1.5) high part
+    constexpr double kDpL1 = 1.35003920212974897128e-08; // log2(1.5) low part
+    constexpr double L1 = 5.99999999999994648725e-01;
+    constexpr double L2 = 4.28571428578550184252e-01;
+    constexpr double L3 = 3.33333329818377432918e-01;
+    constexpr double L4 = 2.72728123808534006489e-01;
+    constexpr double L5 = 2.30660745775561754067e-01;
+    constexpr double L6 = 2.06975017800338417784e-01;
+    constexpr double P1 = 1.66666666666666019037e-01;
+    constexpr double P2 = -2.77777777770155933842e-03;
+    constexpr double P3 = 6.61375632143793436117e-05;
+    constexpr double P4 = -1.65339022054652515390e-06;
+    constexpr double P5 = 4.13813679705723846039e-08;
+    constexpr double kLg2 = 6.93147180559945286227e-01;
+    constexpr double kLg2H = 6.93147182464599609375e-01;
+    constexpr double kLg2L = -1.90465429995776804525e-09;
+    constexpr double kCp = 9.61796693925975554329e-01; // 2/(3 ln2)
+    constexpr double kCpH = 9.61796700954437255859e-01;
+    constexpr double kCpL = -7.02846165095275826516e-09;
+
+    const D ax = abs<L>(x);
+    const D ay = abs<L>(y);
+    const D shifted_y = ay + kShifter;
+    const auto integral_y = (shifted_y - kShifter) == ay;
+    const U odd_y = (U)shifted_y & (U)(x < splat<D>(0.0)) & 1;
+    const auto in_domain = (ax >= splat<D>(0x1p-1022)) & (ax < splat<D>(kInfinity)) & (ay < splat<D>(0x1p51)) &
+                           ((x > splat<D>(0.0)) | integral_y);
+
+    // Split |x| = 2^n * m with m in [1, sqrt(3/2)) or [sqrt(3/2), sqrt(3)) (k = 1).
+    const U bits = (U)ax;
+    const U high = bits >> 32;
+    const U j = high & 0x000fffff;
+    const auto middle = (j > 0x3988e) & (j < 0xbb67a);
+    const auto upper = j >= 0xbb67a;
+    const U ix = (j | 0x3ff00000) - ((U)upper & 0x00100000);
+    const U n = (high >> 20) - 0x3ff + ((U)upper & 1);
+    const U k = (U)middle & 1;
+    const D m = (D)((ix << 32) | (bits & 0xffffffff));
+    const D bp = middle ? splat<D>(kBp1) : splat<D>(1.0);
+    const D dp_h = middle ? splat<D>(kDpH1) : splat<D>(0.0);
+    const D dp_l = middle ? splat<D>(kDpL1) : splat<D>(0.0);
+
+    // ss = s_h + s_l = (m - bp) / (m + bp)
+    D u = m - bp;
+    D v = 1.0 / (m + bp);
+    const D ss = u * v;
+    const D s_h = clear_low_word<L>(ss);
+    D t_h = (D)((((ix >> 1) | 0x20000000) + 0x00080000 + (k << 18)) << 32);
+    D t_l = m - (t_h - bp);
+    const D s_l = v * ((u - s_h * t_h) - s_h * t_l);
+
+    // log(m)
+    D s2 = ss * ss;
+    D r = s2 * s2 * (L1 + s2 * (L2 + s2 * (L3 + s2 * (L4 + s2 * (L5 + s2 * L6)))));
+    r = r + s_l * (s_h + ss);
+    s2 = s_h * s_h;
+    t_h = clear_low_word<L>(3.0 + s2 + r);
+    t_l = r - ((t_h - 3.0) - s2);
+    u = s_h * t_h;
+    v = s_l * t_h + t_l * ss;
+    D p_h = clear_low_word<L>(u + v);
+    D p_l = v - (p_h - u);
+    const D z_h = kCpH * p_h;
+    const D z_l = kCpL * p_h + p_l * kCp + dp_l;
+
+    // log2|x| = t1 + t2 = n + dp_h + z_h + z_l
+    const D t = (D)((U)splat<D>(kShifter) + n) - kShifter;
+    const D t1 = clear_low_word<L>(((z_h + z_l) + dp_h) + t);
+    const D t2 = z_l - (((t1 - t) - dp_h) - z_h);
+
+    // y * log2|x| = p_h + p_l, with y split so y1 * t1 is exact.
+    const D y1 = clear_low_word<L>(y);
+    p_l = (y - y1) * t1 + y * t2;
+    p_h = y1 * t1;
+    const D sum = p_l + p_h;
+    // Near overflow or underflow the scalar version handles rounding and errno.
+    fallback = !(in_domain & (abs<L>(sum) < splat<D>(1000.0)));
+
+    // 2^(p_h + p_l) = 2^e * 2^f with e = round(p_h + p_l) and |f| <= 1/2.
+    const D shifted = sum + kShifter;
+    p_h = p_h - (shifted - kShifter);
+    D f = clear_low_word<L>(p_l + p_h);
+    u = f * kLg2H;
+    v = (p_l - (f - p_h)) * kLg2 + f * kLg2L;
+    D z = u + v;
+    const D w = v - (z - u);
+    f = z * z;
+    const D c = z - f * (P1 + f * (P2 + f * (P3 + f * (P4 + f * P5))));
+    r = (z * c) / (c - 2.0) - (w + z * w);
+    z = 1.0 - (r - z);
+    const D scale = (D)(((U)shifted - (U)splat<D>(kShifter) + 1023) << 52);
+    return flip_sign<L>(z * scale, odd_y);
+}
+
+// min and max as min_value() and max_value() define them (see functions.h): a NaN
+// operand yields the other one, and -0 is below +0. Equal operands have equal bits
+// except for zeros of opposite sign, so OR-ing them picks -0 and AND-ing picks +0.
+template <typename L>
+typename L::D min(typename L::D x, typename L::D y) {
+    using D = typename L::D;
+    using U = typename L::U;
+    D m = x < y ? x : y;
+    m = x == y ? (D)((U)x | (U)y) : m;
+    return y != y ? x : m;
+}
+
+template <typename L>
+typename L::D max(typename L::D x, typename L::D y) {
+    using D = typename L::D;
+    using U = typename L::U;
+    D m = x > y ? x : y;
+    m = x == y ? (D)((U)x & (U)y) : m;
+    return y != y ? x : m;
+}
+
+// Adapts each function to `D apply(D x, D y, Mask& fallback)`. `kMayFallBack` is
+// false for the ones that cover every input.
+template <typename L>
+struct Functions {
+    using D = typename L::D;
+    using Mask = typename L::Mask;
+
+    struct Sqrt {
+        static constexpr bool kMayFallBack = false;
+        static D apply(D x, D, Mask&) { return L::sqrt(x); }
+    };
+    struct Exp {
+        static constexpr bool kMayFallBack = false;
+        static D apply(D x, D, Mask&) { return batch_math::exp<L>(x); }
+    };
+    struct Log {
+        static constexpr bool kMayFallBack = false;
+        static D apply(D x, D, Mask&) { return batch_math::log<L>(x); }
+    };
+    struct Abs {
+        static constexpr bool kMayFallBack = false;
+        static D apply(D x, D, Mask&) { return batch_math::abs<L>(x); }
+    };
+    struct Sin {
+        static constexpr bool kMayFallBack = true;
+        static D apply(D x, D, Mask& fallback) { return batch_math::sin<L>(x, fallback); }
+    };
+    struct Cos {
+        static constexpr bool kMayFallBack = true;
+        static D apply(D x, D, Mask& fallback) { return batch_math::cos<L>(x, fallback); }
+    };
+    struct Pow {
+        static constexpr bool kMayFallBack = true;
+        static D apply(D x, D y, Mask& fallback) { return batch_math::pow<L>(x, y, fallback); }
+    };
+    struct Min {
+        static constexpr bool kMayFallBack = false;
+        static D apply(D x, D y, Mask&) { return batch_math::min<L>(x, y); }
+    };
+    struct Max {
+        static constexpr bool kMayFallBack = false;
+        static D apply(D x, D y, Mask&) { return batch_math::max<L>(x, y); }
+    };
+};
+
+// One full vector of `Id`, redoing the lanes F flags with the scalar built-in.
+template <typename L, typename F, BuiltinId Id>
+void call_lanes(const double* lhs, const double* rhs, double* dst) {
+    using D = typename L::D;
+    using Mask = typename L::Mask;
+    D x;
+    D y;
+    std::memcpy(&x, lhs, sizeof x);
+    std::memcpy(&y, rhs, sizeof y);
+    Mask fallback{};
+    D result = F::apply(x, y, fallback);
+    if constexpr (F::kMayFallBack) {
+        if (L::any(fallback)) [[unlikely]] {
+            const auto scalar = get_builtin(static_cast<std::uint32_t>(Id)).scalar;
+            for (std::size_t lane = 0; lane < L::width; ++lane) {
+                if (fallback[lane]) {
+                    result[lane] = scalar(x[lane], y[lane]);
+                }
+            }
+        }
+    }
+    std::memcpy(dst, &result, sizeof result);
+}
+
+// BinaryKernel for built-in `Id`. A partial last vector is padded with 1.0 (valid
+// for every function) rather than finished with the scalar code, so a row's result
+// does not depend on where it falls in the block.
+template <typename L, typename F, BuiltinId Id>
+void call(const double* lhs, const double* rhs, double* dst, std::size_t n) {
+    std::size_t i = 0;
+    for (; i + L::width <= n; i += L::width) {
+        call_lanes<L, F, Id>(lhs + i, rhs + i, dst + i);
+    }
+    if (i < n) {
+        double x[L::width];
+        double y[L::width];
+        double result[L::width];
+        std::fill_n(x, L::width, 1.0);
+        std::fill_n(y, L::width, 1.0);
+        std::copy(lhs + i, lhs + n, x);
+        std::copy(rhs + i, rhs + n, y);
+        call_lanes<L, F, Id>(x, y, result);
+        std::copy_n(result, n - i, dst + i);
+    }
+}
+
+template <typename L>
+constexpr std::array<BinaryKernel, kNumBuiltins> function_kernels = {
+    call<L, typename Functions<L>::Sqrt, BuiltinId::Sqrt>,
+    call<L, typename Functions<L>::Exp, BuiltinId::Exp>,
+    call<L, typename Functions<L>::Log, BuiltinId::Log>,
+    call<L, typename Functions<L>::Abs, BuiltinId::Abs>,
+    call<L, typename Functions<L>::Sin, BuiltinId::Sin>,
+    call<L, typename Functions<L>::Cos, BuiltinId::Cos>,
+    call<L, typename Functions<L>::Pow, BuiltinId::Pow>,
+    call<L, typename Functions<L>::Min, BuiltinId::Min>,
+    call<L, typename Functions<L>::Max, BuiltinId::Max>,
+};
+
+} // namespace batch_math
+
+} // namespace
+
+#endif // BATCH_MATH_H
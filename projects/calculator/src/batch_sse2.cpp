@@ -0,0 +1,118 @@
+// SSE2 batch kernels: two doubles per instruction. SSE2 is part of the x86-64
+// baseline, so this file needs no extra compiler flags.
+#include "batch_kernels.h"
+#include "batch_math.h"
+
+#include <emmintrin.h>
+
+namespace {
+
+void add(const double* lhs, const double* rhs, double* dst, std::size_t n) {
+    std::size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        _mm_storeu_pd(dst + i, _mm_add_pd(_mm_loadu_pd(lhs + i), _mm_loadu_pd(rhs + i)));
+    }
+    for (; i < n; ++i) {
+        dst[i] = lhs[i] + rhs[i];
+    }
+}
+
+void sub(const double* lhs, const double* rhs, double* dst, std::size_t n) {
+    std::size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        _mm_storeu_pd(dst + i, _mm_sub_pd(_mm_loadu_pd(lhs + i), _mm_loadu_pd(rhs + i)));
+    }
+    for (; i < n; ++i) {
+        dst[i] = lhs[i] - rhs[i];
+    }
+}
+
+void mul(const double* lhs, const double* rhs, double* dst, std::size_t n) {
+    std::size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        _mm_storeu_pd(dst + i, _mm_mul_pd(_mm_loadu_pd(lhs + i), _mm_loadu_pd(rhs + i)));
+    }
+    for (; i < n; ++i) {
+        dst[i] = lhs[i] * rhs[i];
+    }
+}
+
+bool div(const double* lhs, const double* rhs, double* dst, std::size_t n) {
+    const __m128d zero = _mm_setzero_pd();
+    __m128d any_zero = zero;
+    std::size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d divisor = _mm_loadu_pd(rhs + i);
+        any_zero = _mm_or_pd(any_zero, _mm_cmpeq_pd(divisor, zero));
+        _mm_storeu_pd(dst + i, _mm_div_pd(_mm_loadu_pd(lhs + i), divisor));
+    }
+    bool ok = _mm_movemask_pd(any_zero) == 0;
+    for (; i < n; ++i) {
+        ok &= rhs[i] != 0.0;
+        dst[i] = lhs[i] / rhs[i];
+    }
+    return ok;
+}
+
+void neg(const double* src, double* dst, std::size_t n) {
+    const __m128d sign = _mm_set1_pd(-0.0);
+    std::size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        _mm_storeu_pd(dst + i, _mm_xor_pd(_mm_loadu_pd(src + i), sign));
+    }
+    for (; i < n; ++i) {
+        dst[i] = -src[i];
+    }
+}
+
+// tangent_term() lane by lane: the product is masked to zero where the tangent is zero.
+void scale(double a, const double* x, double* dst, std::size_t n) {
+    const __m128d va = _mm_set1_pd(a);
+    const __m128d zero = _mm_setzero_pd();
+    std::size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d vx = _mm_loadu_pd(x + i);
+        _mm_storeu_pd(dst + i, _mm_and_pd(_mm_mul_pd(va, vx), _mm_cmpneq_pd(vx, zero)));
+    }
+    for (; i < n; ++i) {
+        dst[i] = tangent_term(a, x[i]);
+    }
+}
+
+void combine(double a, const double* x, double b, const double* y, double* dst, std::size_t n) {
+    const __m128d va = _mm_set1_pd(a);
+    const __m128d vb = _mm_set1_pd(b);
+    const __m128d zero = _mm_setzero_pd();
+    std::size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d vx = _mm_loadu_pd(x + i);
+        __m128d vy = _mm_loadu_pd(y + i);
+        __m128d px = _mm_and_pd(_mm_mul_pd(va, vx), _mm_cmpneq_pd(vx, zero));
+        __m128d py = _mm_and_pd(_mm_mul_pd(vb, vy), _mm_cmpneq_pd(vy, zero));
+        _mm_storeu_pd(dst + i, _mm_add_pd(px, py));
+    }
+    for (; i < n; ++i) {
+        dst[i] = tangent_term(a, x[i]) + tangent_term(b, y[i]);
+    }
+}
+
+// Lane type for the vectorized built-ins (see batch_math.h).
+struct Lanes {
+    typedef double D __attribute__((vector_size(16)));
+    typedef unsigned long long U __attribute__((vector_size(16)));
+    using Mask = decltype(D{} < D{});
+    static constexpr std::size_t width = 2;
+    static D sqrt(D x) { return (D)_mm_sqrt_pd((__m128d)x); }
+    static bool any(Mask mask) { return _mm_movemask_pd((__m128d)mask) != 0; }
+};
+
+// With two lanes the vector pow is slower than libm's, so this set keeps libm for it.
+constexpr std::array<BinaryKernel, kNumBuiltins> function_kernels = [] {
+    auto kernels = batch_math::function_kernels<Lanes>;
+    kernels[static_cast<std::size_t>(BuiltinId::Pow)] = call_scalar_builtin<BuiltinId::Pow>;
+    return kernels;
+}();
+
+} // namespace
+
+const BatchKernels sse2_kernels = {add, sub, mul, div, neg, function_kernels, scale, combine};
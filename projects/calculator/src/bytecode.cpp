@@ -0,0 +1,183 @@
+#include "bytecode.h"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+namespace {
+
+// Exactly representable as int64, and not -0 (which the integer path cannot carry).
+bool to_integer(double value, std::int64_t& out) {
+    if (!(value >= -0x1p63 && value < 0x1p63)) {
+        return false;
+    }
+    out = static_cast<std::int64_t>(value);
+    return static_cast<double>(out) == value && !(out == 0 && std::signbit(value));
+}
+
+OpCode to_opcode(char op) {
+    switch (op) {
+        case '+': return OpCode::Add;
+        case '-': return OpCode::Sub;
+        case '*': return OpCode::Mul;
+        case '/': return OpCode::Div;
+        case '^': return OpCode::Pow;
+        default:
+            throw std::runtime_error("Unknown operator");
+    }
+}
+
+// Lays out the registers and emits the code for Program and IntegerProgram alike.
+// Constants occupy the low registers, then one register per variable slot, then
+// temporaries in arena order. `constant_of` converts a literal node to the program's
+// register type.
+template <typename P, typename ConstantOf>
+P compile_registers(const Ast& ast, ConstantOf constant_of) {
+    P program;
+    if (ast.empty()) {
+        throw std::runtime_error("Cannot compile an empty expression");
+    }
+
+    std::vector<std::uint32_t> register_of(ast.size());
+    auto nodes = ast.get_nodes();
+    for (std::uint32_t i = 0; i < nodes.size(); ++i) {
+        if (nodes[i].kind == NodeKind::Number || nodes[i].kind == NodeKind::Integer) {
+            register_of[i] = static_cast<std::uint32_t>(program.constants.size());
+            program.constants.push_back(constant_of(nodes[i]));
+        }
+    }
+    auto first_variable = static_cast<std::uint32_t>(program.constants.size());
+    program.num_variables = static_cast<std::uint32_t>(ast.get_variables().size());
+    program.num_registers = first_variable + program.num_variables;
+    for (std::uint32_t i = 0; i < nodes.size(); ++i) {
+        const AstNode& node = nodes[i];
+        OpCode op = OpCode::Add;   // every kind below either sets it or continues
+        switch (node.kind) {
+            case NodeKind::Number:
+            case NodeKind::Integer:
+                continue;
+            case NodeKind::Variable:
+                register_of[i] = first_variable + node.slot;
+                continue;
+            case NodeKind::Operation: op = to_opcode(node.op); break;
+            case NodeKind::Negate: op = OpCode::Neg; break;
+            case NodeKind::Call: op = OpCode::Call; break;
+        }
+        register_of[i] = program.num_registers++;
+        program.code.push_back({op, static_cast<std::uint8_t>(node.slot), register_of[i], register_of[node.left],
+                                register_of[node.right]});
+    }
+    program.result = register_of[ast.get_root()];
+    return program;
+}
+
+} // namespace
+
+Program compile(const Ast& ast) {
+    return compile_registers<Program>(ast, [](const AstNode& node) {
+        return node.kind == NodeKind::Number ? node.value : static_cast<double>(node.integer);
+    });
+}
+
+std::optional<IntegerProgram> compile_integer(const Ast& ast) {
+    // Children precede parents and every operator is integer on integer operands, so
+    // the tree is integer exactly when no node is a decimal literal or a call.
+    for (const AstNode& node : ast.get_nodes()) {
+        if (node.kind == NodeKind::Number || node.kind == NodeKind::Call) {
+            return std::nullopt;
+        }
+    }
+    return compile_registers<IntegerProgram>(ast, [](const AstNode& node) { return node.integer; });
+}
+
+double VirtualMachine::run(ProgramView program, std::span<const double> bindings) {
+    if (bindings.size() < program.num_variables) {
+        throw std::runtime_error("Expected " + std::to_string(program.num_variables) + " variable bindings, got " +
+                                 std::to_string(bindings.size()));
+    }
+    Result<double> result = try_run(program, bindings);
+    if (!result) {
+        throw std::runtime_error("Division by zero!");
+    }
+    return *result;
+}
+
+Result<double> VirtualMachine::try_run(ProgramView program, std::span<const double> bindings) {
+    if (bindings.size() < program.num_variables) {
+        return Error{ErrorCode::UnboundVariable, 0};
+    }
+    if (registers.size() < program.num_registers) {
+        registers.resize(program.num_registers);
+    }
+    double* r = registers.data();
+    r = std::copy(program.constants.begin(), program.constants.end(), r);
+    std::copy_n(bindings.begin(), program.num_variables, r);
+    r = registers.data();
+
+    for (const Instruction& ins : program.code) {
+        switch (ins.op) {
+            case OpCode::Add: r[ins.dst] = r[ins.lhs] + r[ins.rhs]; break;
+            case OpCode::Sub: r[ins.dst] = r[ins.lhs] - r[ins.rhs]; break;
+            case OpCode::Mul: r[ins.dst] = r[ins.lhs] * r[ins.rhs]; break;
+            case OpCode::Div:
+                if (r[ins.rhs] == 0.0) {
+                    return Error{ErrorCode::DivisionByZero, 0};
+                }
+                r[ins.dst] = r[ins.lhs] / r[ins.rhs];
+                break;
+            case OpCode::Pow: r[ins.dst] = std::pow(r[ins.lhs], r[ins.rhs]); break;
+            case OpCode::Neg: r[ins.dst] = -r[ins.lhs]; break;
+            case OpCode::Call: r[ins.dst] = get_builtin(ins.builtin).scalar(r[ins.lhs], r[ins.rhs]); break;
+        }
+    }
+    return r[program.result];
+}
+
+std::optional<std::int64_t> IntegerMachine::run(IntegerProgramView program, std::span<const double> bindings) {
+    std::int64_t* r = load(program, bindings.size());
+    for (std::uint32_t i = 0; i < program.num_variables; ++i) {
+        if (!to_integer(bindings[i], r[i])) {
+            return std::nullopt;
+        }
+    }
+    return execute(program);
+}
+
+std::optional<std::int64_t> IntegerMachine::run(IntegerProgramView program, std::span<const std::int64_t> bindings) {
+    std::int64_t* r = load(program, bindings.size());
+    std::copy_n(bindings.begin(), program.num_variables, r);
+    return execute(program);
+}
+
+std::int64_t* IntegerMachine::load(IntegerProgramView program, std::size_t num_bindings) {
+    if (num_bindings < program.num_variables) {
+        throw std::runtime_error("Expected " + std::to_string(program.num_variables) + " variable bindings, got " +
+                                 std::to_string(num_bindings));
+    }
+    if (registers.size() < program.num_registers) {
+        registers.resize(program.num_registers);
+    }
+    return std::copy(program.constants.begin(), program.constants.end(), registers.data());
+}
+
+std::optional<std::int64_t> IntegerMachine::execute(IntegerProgramView program) {
+    std::int64_t* r = registers.data();
+    bool exact = true;
+    for (const Instruction& ins : program.code) {
+        switch (ins.op) {
+            case OpCode::Add: exact = apply_integer_operator('+', r[ins.lhs], r[ins.rhs], r[ins.dst]); break;
+            case OpCode::Sub: exact = apply_integer_operator('-', r[ins.lhs], r[ins.rhs], r[ins.dst]); break;
+            case OpCode::Mul: exact = apply_integer_operator('*', r[ins.lhs], r[ins.rhs], r[ins.dst]); break;
+            case OpCode::Div:
+                exact = r[ins.rhs] != 0 && apply_integer_operator('/', r[ins.lhs], r[ins.rhs], r[ins.dst]);
+                break;
+            case OpCode::Pow: exact = apply_integer_operator('^', r[ins.lhs], r[ins.rhs], r[ins.dst]); break;
+            case OpCode::Neg: exact = negate_integer(r[ins.lhs], r[ins.dst]); break;
+            case OpCode::Call: exact = false; break;
+        }
+        if (!exact) {
+            return std::nullopt;
+        }
+    }
+    return r[program.result];
+}
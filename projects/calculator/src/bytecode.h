@@ -0,0 +1,147 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include "expression.h"
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+// Operations understood by the virtual machine.
+enum class OpCode : std::uint8_t {
+    Add,
+    Sub,
+    Mul,
+    Div,
+    Pow,
+    Neg,     // registers[dst] = -registers[lhs]
+    Call,    // registers[dst] = builtin(registers[lhs], registers[rhs])
+};
+
+// Three-address instruction: registers[dst] = registers[lhs] <op> registers[rhs].
+struct Instruction {
+    OpCode op;
+    std::uint8_t builtin;    // Call: index into builtins()
+    std::uint32_t dst;
+    std::uint32_t lhs;
+    std::uint32_t rhs;
+};
+
+struct ProgramView;
+struct IntegerProgramView;
+
+// A flat, position-independent form of an expression tree.
+//
+// The register file is laid out as [constants..., variables..., temporaries...].
+// Constants and variable bindings are copied in once per evaluation; every
+// instruction writes a fresh temporary, so the program never needs a value stack
+// and never chases a pointer.
+struct Program {
+    std::vector<double> constants;
+    std::uint32_t num_variables = 0;
+    std::vector<Instruction> code;
+    std::uint32_t num_registers = 0;
+    std::uint32_t result = 0;
+
+    [[nodiscard]] ProgramView view() const;
+};
+
+// The parts of a Program without owning them, e.g. a program that lives in a mapped
+// program file (see program_file.h). Valid as long as the memory it points into.
+struct ProgramView {
+    std::span<const double> constants;
+    std::uint32_t num_variables = 0;
+    std::span<const Instruction> code;
+    std::uint32_t num_registers = 0;
+    std::uint32_t result = 0;
+};
+
+inline ProgramView Program::view() const {
+    return {constants, num_variables, code, num_registers, result};
+}
+
+// Flattens an expression tree into a Program. The arena is already in post-order
+// (children first), so this is a single linear pass.
+[[nodiscard]] Program compile(const Ast& ast);
+
+// Executes Programs. Owns a scratch register file that is reused across runs,
+// so evaluating a compiled expression does not allocate once the file is warm.
+class VirtualMachine {
+public:
+    // `bindings[i]` is the value of variable slot i; it must cover every slot.
+    // Throws "Division by zero!".
+    [[nodiscard]] double run(ProgramView program, std::span<const double> bindings = {});
+    [[nodiscard]] double run(const Program& program, std::span<const double> bindings = {}) {
+        return run(program.view(), bindings);
+    }
+    // Same, without exceptions: a missing binding is ErrorCode::UnboundVariable and a
+    // zero divisor ErrorCode::DivisionByZero, both at offset 0 since programs keep no
+    // source positions (see locate_error()).
+    [[nodiscard]] Result<double> try_run(ProgramView program, std::span<const double> bindings = {});
+    [[nodiscard]] Result<double> try_run(const Program& program, std::span<const double> bindings = {}) {
+        return try_run(program.view(), bindings);
+    }
+private:
+    std::vector<double> registers;
+};
+
+// The same register layout over int64 registers, for expressions that are integer
+// throughout: integer literals and variables combined with + - * / ^ and unary minus.
+// Uses the Add..Neg opcodes; never contains Call.
+struct IntegerProgram {
+    std::vector<std::int64_t> constants;
+    std::uint32_t num_variables = 0;
+    std::vector<Instruction> code;
+    std::uint32_t num_registers = 0;
+    std::uint32_t result = 0;
+
+    [[nodiscard]] IntegerProgramView view() const;
+};
+
+// The parts of an IntegerProgram without owning them, as ProgramView is for Program.
+struct IntegerProgramView {
+    std::span<const std::int64_t> constants;
+    std::uint32_t num_variables = 0;
+    std::span<const Instruction> code;
+    std::uint32_t num_registers = 0;
+    std::uint32_t result = 0;
+};
+
+inline IntegerProgramView IntegerProgram::view() const {
+    return {constants, num_variables, code, num_registers, result};
+}
+
+// Infers the type of every node (a node is integer when it is an integer literal, a
+// variable, or an integer operation on integer operands) and compiles the tree for
+// IntegerMachine if all of it is integer. Returns nullopt otherwise: the tree holds a
+// decimal literal or a function call, and only runs on the double path.
+[[nodiscard]] std::optional<IntegerProgram> compile_integer(const Ast& ast);
+
+// Executes IntegerPrograms exactly, with 64-bit integer instructions and overflow
+// checks (see apply_integer_operator()). Returns nullopt when a binding is not an
+// integer or a step has no exact int64 result; the caller then reruns the expression
+// on the double path, so the int path never changes a result except to make it exact.
+// A zero divisor also returns nullopt, for the double path to report.
+class IntegerMachine {
+public:
+    [[nodiscard]] std::optional<std::int64_t> run(IntegerProgramView program, std::span<const double> bindings = {});
+    [[nodiscard]] std::optional<std::int64_t> run(const IntegerProgram& program,
+                                                  std::span<const double> bindings = {}) {
+        return run(program.view(), bindings);
+    }
+    // Same, with bindings that are already integers (exact even above 2^53).
+    [[nodiscard]] std::optional<std::int64_t> run(IntegerProgramView program, std::span<const std::int64_t> bindings);
+    [[nodiscard]] std::optional<std::int64_t> run(const IntegerProgram& program,
+                                                  std::span<const std::int64_t> bindings) {
+        return run(program.view(), bindings);
+    }
+private:
+    // Copies the constants into the registers and returns where the variables go.
+    std::int64_t* load(IntegerProgramView program, std::size_t num_bindings);
+    std::optional<std::int64_t> execute(IntegerProgramView program);
+
+    std::vector<std::int64_t> registers;
+};
+
+#endif // BYTECODE_H
@@ -0,0 +1,136 @@
+#include "calculator.h"
+#include "phase_stats.h"
+
+#include <charconv>
+
+CompiledExpression::CompiledExpression(Ast tree, OptimizerStats stats)
+    : ast(std::move(tree)), program(compile(ast)), integer_program(compile_integer(ast)), stats(stats) {
+    if (prefer_closures(ast)) {
+        closures.emplace(ast);
+    }
+    if (JitFunction::is_supported()) {
+        jit = std::make_unique<JitState>();
+    }
+}
+
+std::uint32_t CompiledExpression::slot(std::string_view name) const {
+    auto variables = ast.get_variables();
+    for (std::uint32_t i = 0; i < variables.size(); ++i) {
+        if (variables[i] == name) {
+            return i;
+        }
+    }
+    throw std::runtime_error("Unknown variable '" + std::string(name) + "'");
+}
+
+double CompiledExpression::evaluate(std::span<const double> bindings) const {
+    return evaluate_exact(bindings).value;
+}
+
+ExactValue CompiledExpression::evaluate_exact(std::span<const double> bindings) const {
+    if (bindings.size() < program.num_variables) {
+        throw std::runtime_error("Unbound variable '" + ast.get_variables()[bindings.size()] + "'");
+    }
+    Result<ExactValue> result = try_evaluate_exact(bindings);
+    if (!result) {
+        throw std::runtime_error("Division by zero!");
+    }
+    return *result;
+}
+
+Result<ExactValue> CompiledExpression::try_evaluate_exact(std::span<const double> bindings) const {
+    PhaseTimer<kEvaluateSampling> timer(Phase::Evaluate);
+    if (bindings.size() < program.num_variables) {
+        return Error{ErrorCode::UnboundVariable, 0};
+    }
+    if (integer_program) {
+        thread_local IntegerMachine machine;
+        if (std::optional<std::int64_t> exact = machine.run(*integer_program, bindings)) {
+            return ExactValue{true, *exact, static_cast<double>(*exact)};
+        }
+    }
+    thread_local VirtualMachine vm;
+    const JitFunction* native = count_evaluation();
+    Result<double> value = native    ? native->try_run(bindings)
+                           : closures ? closures->try_evaluate(bindings)
+                                      : vm.try_run(program, bindings);
+    if (!value) {
+        return value.error();
+    }
+    return ExactValue{false, 0, *value};
+}
+
+const JitFunction* CompiledExpression::get_native() const {
+    return jit ? jit->ready.load(std::memory_order_acquire) : nullptr;
+}
+
+const JitFunction* CompiledExpression::count_evaluation() const {
+    if (!jit) {
+        return nullptr;
+    }
+    if (const JitFunction* native = jit->ready.load(std::memory_order_acquire)) {
+        return native;
+    }
+    // A plain load and store rather than an atomic increment: a count lost to a race
+    // only delays compilation slightly, and an uncontended store is far cheaper.
+    std::uint64_t count = jit->evaluations.load(std::memory_order_relaxed) + 1;
+    jit->evaluations.store(count, std::memory_order_relaxed);
+    if (count < kJitThreshold || jit->claimed.exchange(true)) {
+        return nullptr;
+    }
+    // Only the thread that claimed the compilation writes `function`; others read it
+    // through `ready` once published. If code generation fails the expression simply
+    // stays interpreted.
+    try {
+        jit->function = std::make_unique<JitFunction>(program);
+        jit->ready.store(jit->function.get(), std::memory_order_release);
+    } catch (const std::exception&) {
+    }
+    return jit->ready.load(std::memory_order_acquire);
+}
+
+std::size_t CompiledExpression::memory_usage() const {
+    std::size_t bytes = sizeof(*this) + ast.memory_usage() + program.constants.capacity() * sizeof(double) +
+                        program.code.capacity() * sizeof(Instruction);
+    if (integer_program) {
+        bytes += integer_program->constants.capacity() * sizeof(std::int64_t) +
+                 integer_program->code.capacity() * sizeof(Instruction);
+    }
+    if (closures) {
+        bytes += closures->size() * sizeof(Closure);
+    }
+    if (jit) {
+        bytes += sizeof(JitState);
+        if (const JitFunction* native = get_native()) {
+            bytes += native->code_size();
+        }
+    }
+    return bytes;
+}
+
+void append_result(std::string& out, const ExactValue& result) {
+    char buffer[32];
+    auto [end, ec] = result.is_integer ? std::to_chars(buffer, buffer + sizeof buffer, result.integer)
+                                       : std::to_chars(buffer, buffer + sizeof buffer, result.value);
+    out.append(buffer, end);
+}
+
+CompiledExpression parse_expression(std::string_view expression) {
+    return try_parse_expression(expression).value();
+}
+
+Result<CompiledExpression> try_parse_expression(std::string_view expression) {
+    // simplify() copies the tree out, so the parse can reuse warm buffers and a
+    // syntax error costs no allocation.
+    thread_local Ast parsed;
+    {
+        PhaseTimer<kParseSampling> timer(Phase::Parse);
+        if (Error error = parse_tree(expression, parsed)) {
+            return error;
+        }
+    }
+    PhaseTimer<kParseSampling> timer(Phase::Build);
+    OptimizerStats stats;
+    Ast tree = simplify(parsed, stats);
+    return CompiledExpression(std::move(tree), stats);
+}
@@ -0,0 +1,100 @@
+#ifndef CALCULATOR_H
+#define CALCULATOR_H
+
+#include "bytecode.h"
+#include "closure.h"
+#include "jit.h"
+#include "expression.h"
+#include "optimizer.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+// Result of CompiledExpression::evaluate_exact().
+struct ExactValue {
+    bool is_integer;         // computed entirely on the int64 path
+    std::int64_t integer;    // the exact result, when is_integer
+    double value;            // the result as a double (`integer` rounded, if above 2^53)
+};
+
+// A parsed and compiled expression, ready to be evaluated many times.
+//
+// Variables are resolved to slots once, at parse time: look a name up with slot()
+// outside the hot loop, then fill a `double` array in slot order and pass it to
+// evaluate(). No parsing or name lookup happens per evaluation.
+//
+// Expressions that are integer throughout (see compile_integer()) also get an int64
+// program. While every binding is a whole number and no step overflows, they run on
+// it and are exact; otherwise they fall back to double. Double evaluation uses
+// closures for shallow, unshared trees (see prefer_closures()) and the bytecode VM
+// for everything else, until an expression has been evaluated kJitThreshold times:
+// then it is compiled to native code (see JitFunction) and runs on that.
+class CompiledExpression {
+public:
+    explicit CompiledExpression(Ast tree, OptimizerStats stats = {});
+
+    // Slot of a variable, in order of first appearance in the source. Throws if the
+    // expression does not mention `name`.
+    [[nodiscard]] std::uint32_t slot(std::string_view name) const;
+    [[nodiscard]] std::size_t num_slots() const { return program.num_variables; }
+    [[nodiscard]] std::span<const std::string> get_variables() const { return ast.get_variables(); }
+
+    // `bindings[i]` is the value of slot i. Thread-safe: each thread evaluates with its
+    // own scratch registers.
+    [[nodiscard]] double evaluate(std::span<const double> bindings = {}) const;
+    // Same, keeping the exact int64 result when the integer path applies.
+    [[nodiscard]] ExactValue evaluate_exact(std::span<const double> bindings = {}) const;
+    // Same, without exceptions: a missing binding or a zero divisor comes back as an
+    // Error at offset 0 (see locate_error() for the source position).
+    [[nodiscard]] Result<ExactValue> try_evaluate_exact(std::span<const double> bindings = {}) const;
+    // Value and gradient in one pass: gradient[i] receives the partial derivative with
+    // respect to slot i (see gradient.h). Runs on the tree, not the compiled code.
+    [[nodiscard]] double evaluate_gradient(std::span<const double> bindings, std::span<double> gradient) const {
+        return ast.evaluate_gradient(ast.get_root(), bindings, gradient);
+    }
+
+    [[nodiscard]] const Ast& get_ast() const { return ast; }
+    [[nodiscard]] const Program& get_program() const { return program; }
+    [[nodiscard]] const std::optional<IntegerProgram>& get_integer_program() const { return integer_program; }
+    // The native code, once the expression is hot; null before that.
+    [[nodiscard]] const JitFunction* get_native() const;
+    // What simplification did to the parsed tree before it was compiled.
+    [[nodiscard]] const OptimizerStats& get_stats() const { return stats; }
+    // Approximate bytes owned by this object, including its heap buffers.
+    [[nodiscard]] std::size_t memory_usage() const;
+private:
+    Ast ast;
+    Program program;
+    std::optional<IntegerProgram> integer_program;
+    std::optional<ClosureProgram> closures;
+    OptimizerStats stats;
+
+    // Hotness counting and the code it triggers. On the heap so CompiledExpression
+    // stays movable; null where there is no JIT.
+    struct JitState {
+        std::atomic<std::uint64_t> evaluations{0};
+        std::atomic<bool> claimed{false};
+        std::unique_ptr<JitFunction> function;
+        std::atomic<const JitFunction*> ready{nullptr};
+    };
+    [[nodiscard]] const JitFunction* count_evaluation() const;
+
+    std::unique_ptr<JitState> jit;
+};
+
+// Appends `result` in shortest round-trip form; integer results are printed exactly,
+// even above 2^53. The format every non-interactive front end uses.
+void append_result(std::string& out, const ExactValue& result);
+
+// Parses, simplifies (see simplify()) and compiles an infix expression such as
+// "x * 2 + y".
+CompiledExpression parse_expression(std::string_view expression);
+// Same, reporting a syntax error as a Result instead of throwing.
+[[nodiscard]] Result<CompiledExpression> try_parse_expression(std::string_view expression);
+
+#endif // CALCULATOR_H
@@ -0,0 +1,235 @@
+#include "closure.h"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+namespace {
+
+// Operand kinds. Each knows how to read its value from a ClosureOperand.
+struct Constant {
+    static double get(const ClosureOperand& operand, const double*) { return operand.constant; }
+};
+struct Variable {
+    static double get(const ClosureOperand& operand, const double* bindings) { return bindings[operand.slot]; }
+};
+struct Subtree {
+    static double get(const ClosureOperand& operand, const double* bindings) {
+        return operand.subtree->fn(*operand.subtree, bindings);
+    }
+};
+
+enum class OperandKind { Constant, Variable, Subtree };
+
+// Set by a division by zero, which then carries on with the IEEE result; checked once
+// per evaluation instead of unwinding through the nested closure calls.
+thread_local bool divided_by_zero = false;
+
+template <char Op>
+double apply(double left_val, double right_val) {
+    if constexpr (Op == '+') {
+        return left_val + right_val;
+    } else if constexpr (Op == '-') {
+        return left_val - right_val;
+    } else if constexpr (Op == '*') {
+        return left_val * right_val;
+    } else if constexpr (Op == '/') {
+        if (right_val == 0.0) {
+            divided_by_zero = true;
+        }
+        return left_val / right_val;
+    } else {
+        return std::pow(left_val, right_val);
+    }
+}
+
+template <char Op, typename L, typename R>
+ClosureFn binary() {
+    return [](const Closure& self, const double* bindings) {
+        return apply<Op>(L::get(self.left, bindings), R::get(self.right, bindings));
+    };
+}
+
+template <typename L>
+ClosureFn negate() {
+    return [](const Closure& self, const double* bindings) { return -L::get(self.left, bindings); };
+}
+
+template <typename L>
+ClosureFn load() {
+    return [](const Closure& self, const double* bindings) { return L::get(self.left, bindings); };
+}
+
+template <typename L, typename R>
+ClosureFn call() {
+    return [](const Closure& self, const double* bindings) {
+        return self.builtin(L::get(self.left, bindings), R::get(self.right, bindings));
+    };
+}
+
+// Unary calls pass their one argument twice; evaluate it once.
+template <typename L>
+ClosureFn unary_call() {
+    return [](const Closure& self, const double* bindings) {
+        double x = L::get(self.left, bindings);
+        return self.builtin(x, x);
+    };
+}
+
+// Run-time operand kinds index these tables of template instantiations, so choosing a
+// closure's function happens once, at compile time of the expression.
+using MakeFn = ClosureFn (*)();
+
+template <template <typename> class Make>
+ClosureFn select(OperandKind kind) {
+    static constexpr MakeFn table[3] = {Make<Constant>::make, Make<Variable>::make, Make<Subtree>::make};
+    return table[static_cast<int>(kind)]();
+}
+
+template <typename L> struct Negate { static ClosureFn make() { return negate<L>(); } };
+template <typename L> struct Load { static ClosureFn make() { return load<L>(); } };
+template <typename L> struct UnaryCall { static ClosureFn make() { return unary_call<L>(); } };
+
+template <char Op>
+ClosureFn select_binary(OperandKind left, OperandKind right) {
+    static constexpr MakeFn table[3][3] = {
+        {binary<Op, Constant, Constant>, binary<Op, Constant, Variable>, binary<Op, Constant, Subtree>},
+        {binary<Op, Variable, Constant>, binary<Op, Variable, Variable>, binary<Op, Variable, Subtree>},
+        {binary<Op, Subtree, Constant>, binary<Op, Subtree, Variable>, binary<Op, Subtree, Subtree>},
+    };
+    return table[static_cast<int>(left)][static_cast<int>(right)]();
+}
+
+ClosureFn select_call(OperandKind left, OperandKind right) {
+    static constexpr MakeFn table[3][3] = {
+        {call<Constant, Constant>, call<Constant, Variable>, call<Constant, Subtree>},
+        {call<Variable, Constant>, call<Variable, Variable>, call<Variable, Subtree>},
+        {call<Subtree, Constant>, call<Subtree, Variable>, call<Subtree, Subtree>},
+    };
+    return table[static_cast<int>(left)][static_cast<int>(right)]();
+}
+
+ClosureFn select_operation(char op, OperandKind left, OperandKind right) {
+    switch (op) {
+        case '+': return select_binary<'+'>(left, right);
+        case '-': return select_binary<'-'>(left, right);
+        case '*': return select_binary<'*'>(left, right);
+        case '/': return select_binary<'/'>(left, right);
+        case '^': return select_binary<'^'>(left, right);
+        default:
+            throw std::runtime_error("Unknown operator");
+    }
+}
+
+// How a node is seen by its parent.
+struct Compiled {
+    OperandKind kind;
+    ClosureOperand operand;
+};
+
+} // namespace
+
+ClosureProgram::ClosureProgram(const Ast& ast) : num_variables(static_cast<std::uint32_t>(ast.get_variables().size())) {
+    if (ast.empty()) {
+        throw std::runtime_error("Cannot compile an empty expression");
+    }
+    auto nodes = ast.get_nodes();
+    // One closure per interior node, plus one if the root is a leaf. Reserved up front
+    // so the subtree pointers handed out below stay valid.
+    std::size_t interior = 0;
+    for (const AstNode& node : nodes) {
+        interior += node.kind == NodeKind::Operation || node.kind == NodeKind::Negate || node.kind == NodeKind::Call;
+    }
+    closures.reserve(interior + 1);
+
+    std::vector<Compiled> compiled(nodes.size());
+    for (std::uint32_t i = 0; i < nodes.size(); ++i) {
+        const AstNode& node = nodes[i];
+        Closure closure{};
+        switch (node.kind) {
+            case NodeKind::Number:
+                compiled[i] = {OperandKind::Constant, {.constant = node.value}};
+                continue;
+            case NodeKind::Integer:
+                compiled[i] = {OperandKind::Constant, {.constant = static_cast<double>(node.integer)}};
+                continue;
+            case NodeKind::Variable:
+                compiled[i] = {OperandKind::Variable, {.slot = node.slot}};
+                continue;
+            case NodeKind::Operation:
+                closure.fn = select_operation(node.op, compiled[node.left].kind, compiled[node.right].kind);
+                break;
+            case NodeKind::Negate:
+                closure.fn = select<Negate>(compiled[node.left].kind);
+                break;
+            case NodeKind::Call:
+                closure.builtin = get_builtin(node.slot).scalar;
+                closure.fn = node.right == node.left ? select<UnaryCall>(compiled[node.left].kind)
+                                                     : select_call(compiled[node.left].kind, compiled[node.right].kind);
+                break;
+        }
+        closure.left = compiled[node.left].operand;
+        closure.right = compiled[node.right].operand;
+        compiled[i] = {OperandKind::Subtree, {.subtree = &closures.emplace_back(closure)}};
+    }
+
+    const Compiled& top = compiled[ast.get_root()];
+    if (top.kind == OperandKind::Subtree) {
+        root = top.operand.subtree;
+    } else {
+        root = &closures.emplace_back(Closure{select<Load>(top.kind), top.operand, {}, nullptr});
+    }
+}
+
+double ClosureProgram::evaluate(std::span<const double> bindings) const {
+    if (bindings.size() < num_variables) {
+        throw std::runtime_error("Expected " + std::to_string(num_variables) + " variable bindings, got " +
+                                 std::to_string(bindings.size()));
+    }
+    Result<double> result = try_evaluate(bindings);
+    if (!result) {
+        throw std::runtime_error("Division by zero!");
+    }
+    return *result;
+}
+
+Result<double> ClosureProgram::try_evaluate(std::span<const double> bindings) const {
+    if (bindings.size() < num_variables) {
+        return Error{ErrorCode::UnboundVariable, 0};
+    }
+    divided_by_zero = false;
+    double result = root->fn(*root, bindings.data());
+    if (divided_by_zero) {
+        return Error{ErrorCode::DivisionByZero, 0};
+    }
+    return result;
+}
+
+bool prefer_closures(const Ast& ast) {
+    auto nodes = ast.get_nodes();
+    auto is_interior = [&](std::uint32_t index) {
+        return nodes[index].kind == NodeKind::Operation || nodes[index].kind == NodeKind::Negate ||
+               nodes[index].kind == NodeKind::Call;
+    };
+    // Nested closure calls needed to evaluate each node, and how often each operation
+    // is evaluated by its parents.
+    std::vector<std::uint32_t> depth(nodes.size(), 0);
+    std::vector<char> uses(nodes.size(), 0);
+    for (std::uint32_t i = 0; i < nodes.size(); ++i) {
+        const AstNode& node = nodes[i];
+        if (!is_interior(i)) {
+            continue;
+        }
+        depth[i] = 1 + std::max(depth[node.left], depth[node.right]);
+        if (depth[i] > kMaxClosureDepth) {
+            return false;
+        }
+        // Unary closures evaluate their operand once even though it is named twice.
+        bool second_operand = node.kind == NodeKind::Operation || node.right != node.left;
+        if ((is_interior(node.left) && uses[node.left]++) ||
+            (second_operand && is_interior(node.right) && uses[node.right]++)) {
+            return false;
+        }
+    }
+    return true;
+}
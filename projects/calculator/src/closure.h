@@ -0,0 +1,70 @@
+#ifndef CLOSURE_H
+#define CLOSURE_H
+
+#include "expression.h"
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+struct Closure;
+
+// Evaluates one closure; `bindings[i]` is the value of variable slot i.
+using ClosureFn = double (*)(const Closure& self, const double* bindings);
+
+// What a closure reads for one operand. Which member is live is baked into the
+// closure's function, never stored or tested at run time.
+union ClosureOperand {
+    double constant;
+    std::uint32_t slot;
+    const Closure* subtree;
+};
+
+// One compiled node: a specialized function plus its operands.
+struct Closure {
+    ClosureFn fn;
+    ClosureOperand left;
+    ClosureOperand right;
+    double (*builtin)(double, double);    // Call only
+};
+
+// Closure-compiled form of an expression tree, a middle ground between walking the
+// tree and generating machine code.
+//
+// Every interior node becomes a captureless lambda instantiated for its operator and
+// for the kind of each operand (constant, variable or subtree), so evaluating a node
+// is one indirect call that reads its operands directly: no switch over node kinds or
+// operators, and leaves cost nothing of their own. Shared (hash-consed) subtrees are
+// evaluated once per use, as in a plain tree walk.
+//
+// Move-only: closures point at each other inside one buffer.
+class ClosureProgram {
+public:
+    explicit ClosureProgram(const Ast& ast);
+
+    ClosureProgram(ClosureProgram&&) noexcept = default;
+    ClosureProgram& operator=(ClosureProgram&&) noexcept = default;
+    ClosureProgram(const ClosureProgram&) = delete;
+    ClosureProgram& operator=(const ClosureProgram&) = delete;
+
+    // `bindings` must cover every variable slot of the tree. Throws "Division by zero!"
+    // like the other evaluators.
+    [[nodiscard]] double evaluate(std::span<const double> bindings = {}) const;
+    // Same, reporting errors as VirtualMachine::try_run() does.
+    [[nodiscard]] Result<double> try_evaluate(std::span<const double> bindings = {}) const;
+
+    [[nodiscard]] std::size_t size() const { return closures.size(); }
+private:
+    std::vector<Closure> closures;
+    const Closure* root = nullptr;
+    std::uint32_t num_variables = 0;
+};
+
+// Whether closures should beat the bytecode VM on `ast`. They win while evaluation
+// stays within kMaxClosureDepth nested calls (the depth a CPU's return-stack predictor
+// covers) and no operation is shared, since closures would recompute shared subtrees
+// that the VM computes once.
+inline constexpr std::size_t kMaxClosureDepth = 16;
+[[nodiscard]] bool prefer_closures(const Ast& ast);
+
+#endif // CLOSURE_H
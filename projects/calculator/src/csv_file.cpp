@@ -0,0 +1,428 @@
+#include "csv_file.h"
+#include "batch.h"
+#include "batch_file.h"
+#include "calculator.h"
+#include "mapped_file.h"
+#include "static_expression.h"
+
+#include <algorithm>
+#include <bit>
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#ifdef CALCULATOR_X86_KERNELS
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Input bytes per unit of work, as for run_batch_file().
+constexpr std::size_t kChunkBytes = 1u << 22;
+// Rows per evaluate_batch() call: enough to amortize its dispatch, few enough that the
+// columns stay in cache between parsing and evaluation.
+constexpr std::size_t kBlockRows = 1024;
+
+// Bit i of each mask describes byte i of a 64-byte block.
+struct Masks {
+    std::uint64_t commas;
+    std::uint64_t newlines;
+    std::uint64_t quotes;
+};
+
+Masks classify(const char* block) {
+#ifdef CALCULATOR_X86_KERNELS
+    // SSE2 is part of the x86-64 baseline: 16 compares per instruction, no extra flags.
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i quote = _mm_set1_epi8('"');
+    Masks masks{};
+    for (int part = 0; part < 4; ++part) {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16 * part));
+        const int shift = 16 * part;
+        masks.commas |= std::uint64_t(std::uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, comma)))) << shift;
+        masks.newlines |= std::uint64_t(std::uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, newline)))) << shift;
+        masks.quotes |= std::uint64_t(std::uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, quote)))) << shift;
+    }
+    return masks;
+#else
+    Masks masks{};
+    for (int i = 0; i < 64; ++i) {
+        masks.commas |= std::uint64_t(block[i] == ',') << i;
+        masks.newlines |= std::uint64_t(block[i] == '\n') << i;
+        masks.quotes |= std::uint64_t(block[i] == '"') << i;
+    }
+    return masks;
+#endif
+}
+
+// Bits of the bytes between an opening quote and its closing quote. A prefix XOR over
+// the quote bits; `open` carries an unclosed quote into the next block.
+std::uint64_t inside_quotes(std::uint64_t quotes, bool& open) {
+    for (int shift = 1; shift < 64; shift *= 2) {
+        quotes ^= quotes << shift;
+    }
+    if (open) {
+        quotes = ~quotes;
+    }
+    open = (quotes >> 63) != 0;
+    return quotes;
+}
+
+// inside_quotes() with the state reset at every '\n', for the rare block where a quote
+// is still open at one: a row end always ends the row. Sets the bit of each such '\n'
+// in `unterminated`.
+std::uint64_t inside_quotes_by_row(const Masks& masks, bool& open, std::uint64_t& unterminated) {
+    std::uint64_t inside = 0;
+    for (int i = 0; i < 64; ++i) {
+        const std::uint64_t bit = std::uint64_t{1} << i;
+        if (masks.quotes & bit) {
+            open = !open;
+        } else if ((masks.newlines & bit) && open) {
+            unterminated |= bit;
+            open = false;
+        }
+        if (open) {
+            inside |= bit;
+        }
+    }
+    return inside;
+}
+
+std::string_view trim(std::string_view field) {
+    auto blank = [](char c) { return c == ' ' || c == '\t' || c == '\r'; };
+    while (!field.empty() && blank(field.front())) {
+        field.remove_prefix(1);
+    }
+    while (!field.empty() && blank(field.back())) {
+        field.remove_suffix(1);
+    }
+    if (field.size() >= 2 && field.front() == '"' && field.back() == '"') {
+        field = trim(field.substr(1, field.size() - 2));
+    }
+    return field;
+}
+
+// Whole numbers are read as int64 as well, so rows of them can be evaluated exactly
+// (see IntegerMachine), even above 2^53. Other plain decimals such as prices take
+// Clinger's fast path (see calc::detail::read_decimal()), a fraction of the cost of
+// from_chars; anything else goes to from_chars. All round correctly, so `value` does
+// not depend on the path.
+bool parse_number(std::string_view field, double& value, std::int64_t& integer, bool& is_integer) {
+    field = trim(field);
+    if (field.size() > 1 && field[0] == '+' && field[1] != '-') {
+        field.remove_prefix(1);
+    }
+    const char* end = field.data() + field.size();
+    auto [integer_end, integer_ec] = std::from_chars(field.data(), end, integer);
+    // "-0" is a double: the int64 path has no negative zero.
+    is_integer = integer_ec == std::errc() && integer_end == end && (integer != 0 || field[0] != '-');
+    if (is_integer) {
+        value = static_cast<double>(integer);
+        return true;
+    }
+    const bool negative = !field.empty() && field[0] == '-';
+    const std::string_view digits = field.substr(negative);
+    if (!digits.empty() && (std::isdigit(static_cast<unsigned char>(digits[0])) ||
+                            (digits.size() > 1 && digits[0] == '.' && std::isdigit(static_cast<unsigned char>(digits[1]))))) {
+        bool exact = false;
+        if (calc::detail::read_decimal(digits, value, exact) == digits.size() && exact) {
+            value = negative ? -value : value;
+            return true;
+        }
+    }
+    auto [next, ec] = std::from_chars(field.data(), end, value);
+    return ec == std::errc() && next == end && !field.empty();
+}
+
+// The header's column names, unquoted.
+std::vector<std::string> split_header(std::string_view line) {
+    std::vector<std::string> names(1);
+    bool quoted = false;
+    for (std::size_t i = 0; i < line.size(); ++i) {
+        const char c = line[i];
+        if (c == '"') {
+            if (quoted && i + 1 < line.size() && line[i + 1] == '"') {
+                names.back() += '"';
+                ++i;
+            } else {
+                quoted = !quoted;
+            }
+        } else if (c == ',' && !quoted) {
+            names.emplace_back();
+        } else {
+            names.back() += c;
+        }
+    }
+    for (std::string& name : names) {
+        name = std::string(trim(name));
+    }
+    return names;
+}
+
+// Where each column goes: the expression's variables, by name.
+struct Layout {
+    std::vector<std::string> names;
+    std::vector<std::int32_t> slot_of_column;   // -1 for columns the expression ignores
+    std::size_t needed_columns = 0;             // last used column + 1
+};
+
+Layout make_layout(std::string_view header, const CompiledExpression& expression) {
+    Layout layout;
+    layout.names = split_header(header);
+    layout.slot_of_column.assign(layout.names.size(), -1);
+    const std::span<const std::string> variables = expression.get_variables();
+    for (std::size_t slot = 0; slot < variables.size(); ++slot) {
+        auto column = std::find(layout.names.begin(), layout.names.end(), variables[slot]);
+        if (column == layout.names.end()) {
+            throw std::runtime_error("No column named '" + variables[slot] + "' in the CSV header");
+        }
+        const auto index = static_cast<std::size_t>(column - layout.names.begin());
+        layout.slot_of_column[index] = static_cast<std::int32_t>(slot);
+        layout.needed_columns = std::max(layout.needed_columns, index + 1);
+    }
+    return layout;
+}
+
+// Splits the data rows of one chunk, converts the fields the expression uses into
+// per-slot columns and evaluates them a block of rows at a time. One per thread.
+class ChunkEvaluator {
+public:
+    ChunkEvaluator(std::string_view source, const CompiledExpression& expression, const Layout& layout)
+        : source(source), expression(expression), layout(layout),
+          columns(expression.num_slots(), std::vector<double>(kBlockRows)),
+          integers(expression.num_slots(), std::vector<std::int64_t>(kBlockRows)), results(kBlockRows),
+          status(kBlockRows), whole(kBlockRows, 1), messages(kBlockRows), values(expression.num_slots()),
+          integer_values(expression.num_slots()) {}
+
+    std::size_t run(std::string_view chunk, std::string& out) {
+        failures = 0;
+        const char* data = chunk.data();
+        std::size_t field_start = 0;
+        bool quoted = false;
+        // Once the last column the expression uses has been read, the rest of the row
+        // is skipped: only its '\n' matters.
+        const std::size_t last_column = std::max<std::size_t>(layout.needed_columns, 1);
+        bool skipping = false;
+        for (std::size_t base = 0; base < chunk.size(); base += 64) {
+            Masks masks;
+            if (base + 64 <= chunk.size()) {
+                masks = classify(data + base);
+            } else {
+                char tail[64] = {};
+                std::memcpy(tail, data + base, chunk.size() - base);
+                masks = classify(tail);
+            }
+            const bool quoted_before = quoted;
+            std::uint64_t inside = inside_quotes(masks.quotes, quoted);
+            std::uint64_t unterminated = 0;
+            if ((masks.newlines & inside) != 0) {
+                quoted = quoted_before;
+                inside = inside_quotes_by_row(masks, quoted, unterminated);
+            }
+            const std::uint64_t outside = ~inside;
+            const std::uint64_t all = (masks.commas | masks.newlines) & outside;
+            const std::uint64_t row_ends = masks.newlines & outside;
+            std::uint64_t separators = skipping ? row_ends : all;
+            while (separators != 0) {
+                const std::uint64_t lowest = separators & -separators;
+                const std::size_t at = base + static_cast<std::size_t>(std::countr_zero(separators));
+                if (unterminated & lowest) {
+                    fail_unterminated();   // the quote swallowed the rest of the row
+                }
+                if (!skipping) {
+                    end_field({data + field_start, at - field_start});
+                }
+                if (row_ends & lowest) {
+                    end_row(out);
+                    skipping = false;
+                    separators = all & ~((lowest << 1) - 1);
+                } else if (column >= last_column) {
+                    skipping = true;
+                    separators = row_ends & ~((lowest << 1) - 1);
+                } else {
+                    separators &= separators - 1;
+                }
+                field_start = at + 1;
+            }
+        }
+        // The last line of the file may lack its '\n'.
+        if (field_start < chunk.size()) {
+            if (quoted) {
+                fail_unterminated();
+            }
+            if (!skipping) {
+                end_field(chunk.substr(field_start));
+            }
+            end_row(out);
+        }
+        flush(out);
+        return failures;
+    }
+private:
+    enum class RowStatus : std::uint8_t {
+        Ok,
+        Blank,
+        Failed,
+    };
+
+    void end_field(std::string_view field) {
+        if (column == 0) {
+            first_field = field;
+        }
+        if (column < layout.needed_columns && status[row] == RowStatus::Ok) {
+            const std::int32_t slot = layout.slot_of_column[column];
+            if (slot >= 0) {
+                const auto index = static_cast<std::size_t>(slot);
+                bool is_integer = false;
+                if (!parse_number(field, columns[index][row], integers[index][row], is_integer)) {
+                    fail("Column '" + layout.names[column] + "' is not a number");
+                }
+                whole[row] &= is_integer;
+            }
+        }
+        ++column;
+    }
+
+    void end_row(std::string& out) {
+        if (column == 1 && trim(first_field).empty()) {
+            if (status[row] == RowStatus::Failed) {
+                --failures;   // an empty first field is not an error on a blank line
+            }
+            status[row] = RowStatus::Blank;
+        } else if (column < layout.needed_columns && status[row] == RowStatus::Ok) {
+            std::size_t missing = column;
+            while (layout.slot_of_column[missing] < 0) {
+                ++missing;
+            }
+            fail("Column '" + layout.names[missing] + "' is missing");
+        }
+        column = 0;
+        if (++row == kBlockRows) {
+            flush(out);
+        }
+    }
+
+    void fail_unterminated() {
+        if (status[row] == RowStatus::Ok) {
+            fail("Unterminated quote");
+        }
+    }
+
+    void fail(std::string message) {
+        status[row] = RowStatus::Failed;
+        messages[row] = std::move(message);
+        ++failures;
+    }
+
+    void flush(std::string& out) {
+        if (row == 0) {
+            return;
+        }
+        std::vector<std::span<const double>> spans(columns.begin(), columns.end());
+        // A division by zero anywhere in the block, perhaps in a row that failed already,
+        // makes the kernels throw; the rows are then evaluated one at a time.
+        bool evaluated = true;
+        try {
+            evaluate_batch(expression, spans, std::span<double>(results.data(), row));
+        } catch (const std::runtime_error&) {
+            evaluated = false;
+        }
+
+        // Rows of whole numbers go through the int64 program where there is one, as
+        // literals do in --batch, so results are exact and formatted the same way.
+        const std::optional<IntegerProgram>& integer_program = expression.get_integer_program();
+        for (std::size_t r = 0; r < row; ++r) {
+            if (status[r] == RowStatus::Ok) {
+                std::optional<std::int64_t> exact;
+                if (integer_program && whole[r]) {
+                    for (std::size_t slot = 0; slot < integers.size(); ++slot) {
+                        integer_values[slot] = integers[slot][r];
+                    }
+                    exact = machine.run(*integer_program, std::span<const std::int64_t>(integer_values));
+                }
+                if (exact) {
+                    append_result(out, {true, *exact, static_cast<double>(*exact)});
+                } else if (evaluated) {
+                    append_result(out, {false, 0, results[r]});
+                } else {
+                    for (std::size_t slot = 0; slot < columns.size(); ++slot) {
+                        values[slot] = columns[slot][r];
+                    }
+                    if (Result<ExactValue> result = expression.try_evaluate_exact(values)) {
+                        append_result(out, *result);
+                    } else {
+                        out += "Error: ";
+                        out += describe(locate_error(source, values, result.error().code));
+                        ++failures;
+                    }
+                }
+            } else if (status[r] == RowStatus::Failed) {
+                out += "Error: ";
+                out += messages[r];
+            }
+            out += '\n';
+            status[r] = RowStatus::Ok;
+            whole[r] = 1;
+        }
+        row = 0;
+    }
+
+    IntegerMachine machine;
+    std::string_view source;
+    const CompiledExpression& expression;
+    const Layout& layout;
+    std::vector<std::vector<double>> columns;          // [slot][row in block]
+    std::vector<std::vector<std::int64_t>> integers;   // the same, where `whole`
+    std::vector<double> results;
+    std::vector<RowStatus> status;
+    std::vector<char> whole;                           // every field used is an integer
+    std::vector<std::string> messages;                 // for failed rows
+    std::vector<double> values;                        // one row's bindings
+    std::vector<std::int64_t> integer_values;
+    std::size_t row = 0;                        // in the current block
+    std::size_t column = 0;                     // in the current row
+    std::string_view first_field;
+    std::size_t failures = 0;
+};
+
+// The header line, and the data rows after it.
+std::pair<std::string_view, std::string_view> split_off_header(std::string_view text) {
+    const std::size_t newline = text.find('\n');
+    if (newline == std::string_view::npos) {
+        return {text, {}};
+    }
+    return {text.substr(0, newline), text.substr(newline + 1)};
+}
+
+} // namespace
+
+std::size_t evaluate_csv(std::string_view text, std::string_view expression, std::string& out) {
+    const CompiledExpression compiled = parse_expression(expression);
+    const auto [header, rows] = split_off_header(text);
+    const Layout layout = make_layout(header, compiled);
+    ChunkEvaluator evaluator(expression, compiled, layout);
+    return evaluator.run(rows, out);
+}
+
+std::size_t run_csv_file(const CsvFileOptions& options, std::FILE* out) {
+    const CompiledExpression expression = parse_expression(options.expression);
+    MappedFile input(options.input_path);
+    const auto [header, rows] = split_off_header(input.contents());
+    const Layout layout = make_layout(header, expression);
+    const std::vector<std::string_view> chunks = split_lines(rows, kChunkBytes);
+    return write_chunks_in_order(chunks.size(), options.threads, out, [&]() -> ChunkWorker {
+        auto evaluator = std::make_shared<ChunkEvaluator>(options.expression, expression, layout);
+        return [&chunks, evaluator](std::size_t index, std::string& buffer) {
+            buffer.reserve(chunks[index].size() / 2);
+            return evaluator->run(chunks[index], buffer);
+        };
+    });
+}
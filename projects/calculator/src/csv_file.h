@@ -0,0 +1,38 @@
+#ifndef CSV_FILE_H
+#define CSV_FILE_H
+
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+struct CsvFileOptions {
+    std::string input_path;
+    std::string expression;   // over the column names in the header
+    unsigned threads = 1;     // 0 = one per hardware thread
+};
+
+// Computes a derived column: evaluates one expression for every data row of a CSV
+// file, each variable bound to the column of that name in the header line, and writes
+// one output line per data row, in input order: the result (formatted by
+// append_result(); rows of whole numbers are evaluated exactly, as literals are in
+// --batch), "Error: <message>" for a row with a missing or non-numeric field, an
+// unterminated quote or a division by zero, or an empty line for a blank row. No
+// header is written. Throws std::runtime_error if the expression does not parse or
+// names a column the header lacks.
+//
+// Fields are separated by ',' and may be quoted with '"' ("" inside quotes is a
+// quote); quoted fields may contain commas but not line breaks: every '\n' ends a row,
+// and a quote still open there fails that row alone. Numbers are read with
+// std::from_chars, after trimming blanks and quotes. Only the columns the expression
+// uses are converted.
+//
+// The input is memory-mapped and split into line-aligned chunks spread over the
+// threads, as run_batch_file() does. Within a chunk, separators are found 64 bytes at a
+// time with SIMD compares, and rows are evaluated in blocks with evaluate_batch().
+// Returns the number of rows that failed.
+std::size_t run_csv_file(const CsvFileOptions& options, std::FILE* out);
+
+// Same for CSV text already in memory, header line included, appending to `out`.
+std::size_t evaluate_csv(std::string_view text, std::string_view expression, std::string& out);
+
+#endif // CSV_FILE_H
@@ -0,0 +1,26 @@
+#include "error.h"
+
+const char* to_string(ErrorCode code) {
+    switch (code) {
+        case ErrorCode::None: return "No error";
+        case ErrorCode::UnexpectedCharacter: return "Unexpected character";
+        case ErrorCode::InvalidNumber: return "Invalid number";
+        case ErrorCode::ExpectedOperand: return "Expected a number, variable, function call or '('";
+        case ErrorCode::ExpectedClosingParen: return "Expected ')'";
+        case ErrorCode::UnexpectedToken: return "Unexpected token";
+        case ErrorCode::UnknownFunction: return "Unknown function";
+        case ErrorCode::WrongArgumentCount: return "Wrong number of arguments";
+        case ErrorCode::NestingTooDeep: return "Expression nested too deeply";
+        case ErrorCode::ExpectedIndexVariable: return "Expected an index variable";
+        case ErrorCode::NestedAggregate: return "Aggregates cannot be nested";
+        case ErrorCode::ReservedName: return "Names starting with '__' are reserved";
+        case ErrorCode::InvalidBounds: return "Aggregate bounds must be finite whole numbers";
+        case ErrorCode::DivisionByZero: return "Division by zero";
+        case ErrorCode::UnboundVariable: return "Unbound variable";
+    }
+    return "Unknown error";
+}
+
+std::string describe(const Error& error) {
+    return std::string(to_string(error.code)) + " at offset " + std::to_string(error.offset);
+}
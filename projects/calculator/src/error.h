@@ -0,0 +1,87 @@
+#ifndef ERROR_H
+#define ERROR_H
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+
+enum class ErrorCode : std::uint8_t {
+    None,
+    UnexpectedCharacter,
+    InvalidNumber,
+    ExpectedOperand,
+    ExpectedClosingParen,
+    UnexpectedToken,
+    UnknownFunction,
+    WrongArgumentCount,
+    NestingTooDeep,
+    // Aggregates (see aggregate.h).
+    ExpectedIndexVariable,
+    NestedAggregate,
+    ReservedName,
+    InvalidBounds,
+    // Evaluation errors; the offset is that of the '/' or the variable responsible.
+    DivisionByZero,
+    UnboundVariable,
+};
+
+// An error code plus the byte offset in the source it refers to. Cheap to return by
+// value, so parsing reports failures without throwing.
+struct Error {
+    ErrorCode code = ErrorCode::None;
+    std::uint32_t offset = 0;
+
+    constexpr explicit operator bool() const { return code != ErrorCode::None; }
+};
+
+[[nodiscard]] const char* to_string(ErrorCode code);
+
+// "Expected ')' at offset 7". Only used when an error is actually reported.
+[[nodiscard]] std::string describe(const Error& error);
+
+// The value of an operation that can fail, or the Error it failed with. A stand-in for
+// C++23 std::expected<T, Error>, with the same member names, for the evaluation and
+// parsing paths that must not throw: a failure costs the same as a success.
+template <typename T>
+class Result {
+public:
+    Result(T value) : storage(std::in_place_index<0>, std::move(value)) {}
+    Result(Error error) : storage(std::in_place_index<1>, error) {}
+
+    [[nodiscard]] bool has_value() const { return storage.index() == 0; }
+    explicit operator bool() const { return has_value(); }
+
+    // Throws std::runtime_error(describe(error())) if there is no value.
+    [[nodiscard]] T& value() & {
+        check();
+        return **this;
+    }
+    [[nodiscard]] const T& value() const& {
+        check();
+        return **this;
+    }
+    [[nodiscard]] T&& value() && {
+        check();
+        return std::move(**this);
+    }
+    // Unchecked: only after has_value().
+    [[nodiscard]] T& operator*() { return *std::get_if<0>(&storage); }
+    [[nodiscard]] const T& operator*() const { return *std::get_if<0>(&storage); }
+    [[nodiscard]] T* operator->() { return std::get_if<0>(&storage); }
+    [[nodiscard]] const T* operator->() const { return std::get_if<0>(&storage); }
+    // Only when !has_value().
+    [[nodiscard]] const Error& error() const { return *std::get_if<1>(&storage); }
+private:
+    void check() const {
+        if (!has_value()) {
+            throw std::runtime_error(describe(error()));
+        }
+    }
+
+    std::variant<T, Error> storage;
+};
+
+#endif // ERROR_H
@@ -0,0 +1,428 @@
+#include "expression.h"
+#include "lexer.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+namespace {
+
+std::uint64_t hash_node(const AstNode& node) {
+    std::uint64_t bits;
+    std::memcpy(&bits, &node.value, sizeof bits);
+    std::uint64_t h = bits;
+    h = h * 0x9E3779B97F4A7C15ull ^ (static_cast<std::uint64_t>(node.left) << 32 | node.right);
+    h = h * 0x9E3779B97F4A7C15ull ^ (static_cast<std::uint64_t>(node.slot) << 16 |
+                                      static_cast<std::uint64_t>(node.kind) << 8 |
+                                      static_cast<unsigned char>(node.op));
+    return h ^ (h >> 29);
+}
+
+bool is_interior(const AstNode& node) {
+    return node.kind != NodeKind::Number && node.kind != NodeKind::Integer && node.kind != NodeKind::Variable;
+}
+
+// Bitwise equality, so +0/-0 and different NaNs stay distinct.
+bool same_node(const AstNode& a, const AstNode& b) {
+    return a.kind == b.kind && a.op == b.op && a.left == b.left && a.right == b.right && a.slot == b.slot &&
+           std::memcmp(&a.value, &b.value, sizeof a.value) == 0;
+}
+
+} // namespace
+
+void Ast::reserve(std::size_t count) {
+    nodes.reserve(count);
+    if (hash_consing && buckets.size() < 2 * count) {
+        rehash(std::bit_ceil(2 * count));
+    }
+}
+
+void Ast::clear() {
+    nodes.clear();
+    variables.clear();
+    std::fill(buckets.begin(), buckets.end(), 0);
+    root_index = 0;
+    deduplicated = 0;
+}
+
+std::size_t Ast::memory_usage() const {
+    std::size_t bytes = nodes.capacity() * sizeof(AstNode) + buckets.capacity() * sizeof(std::uint32_t) +
+                        variables.capacity() * sizeof(std::string);
+    for (const std::string& name : variables) {
+        bytes += name.capacity() > std::string().capacity() ? name.capacity() + 1 : 0;
+    }
+    return bytes;
+}
+
+std::uint32_t Ast::push(const AstNode& node) {
+    if (!hash_consing) {
+        nodes.push_back(node);
+        return static_cast<std::uint32_t>(nodes.size() - 1);
+    }
+    // Keep the load factor at or below one half.
+    if (2 * (nodes.size() + 1) > buckets.size()) {
+        rehash(std::max<std::size_t>(16, 2 * buckets.size()));
+    }
+    std::size_t mask = buckets.size() - 1;
+    for (std::size_t i = hash_node(node) & mask;; i = (i + 1) & mask) {
+        if (buckets[i] == 0) {
+            nodes.push_back(node);
+            buckets[i] = static_cast<std::uint32_t>(nodes.size());
+            return buckets[i] - 1;
+        }
+        if (same_node(nodes[buckets[i] - 1], node)) {
+            ++deduplicated;
+            return buckets[i] - 1;
+        }
+    }
+}
+
+void Ast::rehash(std::size_t bucket_count) {
+    buckets.assign(bucket_count, 0);
+    std::size_t mask = bucket_count - 1;
+    for (std::uint32_t n = 0; n < nodes.size(); ++n) {
+        std::size_t i = hash_node(nodes[n]) & mask;
+        while (buckets[i] != 0) {
+            i = (i + 1) & mask;
+        }
+        buckets[i] = n + 1;
+    }
+}
+
+double Ast::leaf_value(const AstNode& node, std::span<const double> bindings) const {
+    if (node.kind == NodeKind::Number) {
+        return node.value;
+    }
+    if (node.kind == NodeKind::Integer) {
+        return static_cast<double>(node.integer);
+    }
+    if (node.slot >= bindings.size()) {
+        throw std::runtime_error("Unbound variable '" + variables[node.slot] + "'");
+    }
+    return bindings[node.slot];
+}
+
+namespace {
+
+// Deepest evaluate_tree() recurses before handing a subtree to evaluate_dag(), whose
+// loops need no stack: a flat chain of a million terms is a million levels deep.
+constexpr std::uint32_t kMaxTreeDepth = 1u << 14;
+
+} // namespace
+
+// Plain recursion over an unshared tree with every variable bound. One switch over the
+// closed set of node kinds, with the common operators inlined, so each node costs one
+// jump-table branch instead of an indirect call through a vtable.
+double Ast::evaluate_tree(std::uint32_t index, const double* bindings, std::uint32_t depth) const {
+    if (depth == kMaxTreeDepth) {
+        return evaluate_dag(index, {bindings, variables.size()});
+    }
+    const AstNode& node = nodes[index];
+    switch (node.kind) {
+        case NodeKind::Number:
+            return node.value;
+        case NodeKind::Integer:
+            return static_cast<double>(node.integer);
+        case NodeKind::Variable:
+            return bindings[node.slot];
+        case NodeKind::Negate:
+            return -evaluate_tree(node.left, bindings, depth + 1);
+        case NodeKind::Call: {
+            auto first = evaluate_tree(node.left, bindings, depth + 1);
+            auto second = node.right == node.left ? first : evaluate_tree(node.right, bindings, depth + 1);
+            return get_builtin(node.slot).scalar(first, second);
+        }
+        case NodeKind::Operation:
+            break;
+    }
+    auto left_val = evaluate_tree(node.left, bindings, depth + 1);
+    // x op x repeats the operand index; evaluate it once.
+    auto right_val = node.right == node.left ? left_val : evaluate_tree(node.right, bindings, depth + 1);
+    switch (node.op) {
+        case '+': return left_val + right_val;
+        case '-': return left_val - right_val;
+        case '*': return left_val * right_val;
+        default: return apply_operator(node.op, left_val, right_val);
+    }
+}
+
+double Ast::evaluate(std::uint32_t index, std::span<const double> bindings) const {
+    // Without sharing every node has one parent, so plain recursion already visits each
+    // node once. The DAG walk checks each variable it reaches, so it also handles
+    // partial bindings and reports the first unbound name.
+    if (deduplicated == 0 && bindings.size() >= variables.size()) {
+        return evaluate_tree(index, bindings.data(), 0);
+    }
+    return evaluate_dag(index, bindings);
+}
+
+double Ast::evaluate_dag(std::uint32_t index, std::span<const double> bindings) const {
+    // Children precede parents, so one backward sweep marks the nodes reachable from
+    // `index` and one forward sweep computes each of them exactly once.
+    thread_local std::vector<char> reachable;
+    thread_local std::vector<double> values;
+    reachable.assign(index + 1, 0);
+    values.resize(index + 1);
+
+    reachable[index] = 1;
+    for (std::uint32_t i = index + 1; i-- > 0;) {
+        if (reachable[i] && is_interior(nodes[i])) {
+            reachable[nodes[i].left] = 1;
+            reachable[nodes[i].right] = 1;
+        }
+    }
+    for (std::uint32_t i = 0; i <= index; ++i) {
+        if (!reachable[i]) {
+            continue;
+        }
+        const AstNode& node = nodes[i];
+        values[i] = is_interior(node) ? apply_node(node, values[node.left], values[node.right])
+                                      : leaf_value(node, bindings);
+    }
+    return values[index];
+}
+
+// Function to check if a character is an operator.
+bool is_operator(char c) {
+    return c == '+' || c == '-' || c == '*' || c == '/' || c == '^';
+}
+
+namespace {
+
+// Single-pass Pratt parser: builds the tree directly into the arena while walking the
+// token buffer, with no operator or operand stacks. Each binary operator has a left
+// binding power (how tightly it grabs the operand on its left) and a right one used
+// to parse its right operand; making the right one smaller than the left yields
+// right associativity.
+class PrattParser {
+public:
+    // With `offsets`, offsets[i] receives the source offset of node i as it is added.
+    PrattParser(std::string_view source, std::span<const Token> tokens, Ast& ast,
+                std::vector<std::uint32_t>* offsets = nullptr)
+        : source(source), tokens(tokens), ast(ast), offsets(offsets) {}
+
+    Error parse() {
+        std::uint32_t root = 0;
+        if (parse_expression(0, 0, root)) {
+            if (pos < tokens.size()) {
+                fail_at(tokens[pos], ErrorCode::UnexpectedToken);
+            } else {
+                ast.set_root(root);
+            }
+        }
+        return error;
+    }
+private:
+    static constexpr OperatorPrecedence get_precedence{};
+    // Prefix - and + bind tighter than * and / but looser than ^, so -2^2 == -(2^2).
+    static constexpr int kPrefixBindingPower = 2 * get_precedence('^') - 1;
+
+    static int left_binding_power(char op) { return 2 * get_precedence(op); }
+    static int right_binding_power(char op) {
+        return get_precedence.is_right_associative(op) ? left_binding_power(op) - 1 : left_binding_power(op) + 1;
+    }
+
+    bool parse_expression(int min_binding_power, int depth, std::uint32_t& out) {
+        if (depth > kMaxNestingDepth) {
+            return fail(ErrorCode::NestingTooDeep, offset_here());
+        }
+        if (!parse_prefix(depth, out)) {
+            return false;
+        }
+        while (pos < tokens.size() && tokens[pos].kind == TokenKind::Operator) {
+            const Token& token = tokens[pos];
+            if (left_binding_power(token.op) <= min_binding_power) {
+                break;
+            }
+            ++pos;
+            std::uint32_t right = 0;
+            if (!parse_expression(right_binding_power(token.op), depth + 1, right)) {
+                return false;
+            }
+            out = at(token, ast.add_operation(token.op, out, right));
+        }
+        return true;
+    }
+
+    bool parse_prefix(int depth, std::uint32_t& out) {
+        if (pos >= tokens.size()) {
+            return fail(ErrorCode::ExpectedOperand, offset_here());
+        }
+        const Token& token = tokens[pos++];
+        switch (token.kind) {
+            case TokenKind::Number:
+                out = at(token, token.is_integer ? ast.add_integer(token.integer) : ast.add_number(token.value));
+                return true;
+            case TokenKind::Identifier:
+                if (pos < tokens.size() && tokens[pos].kind == TokenKind::LeftParen) {
+                    return parse_call(token, depth, out);
+                }
+                out = at(token, ast.add_variable(token.text(source)));
+                return true;
+            case TokenKind::LeftParen:
+                if (!parse_expression(0, depth + 1, out)) {
+                    return false;
+                }
+                return expect(TokenKind::RightParen, ErrorCode::ExpectedClosingParen);
+            case TokenKind::Operator:
+                if (token.op == '-' || token.op == '+') {
+                    if (!parse_expression(kPrefixBindingPower, depth + 1, out)) {
+                        return false;
+                    }
+                    if (token.op == '-') {
+                        out = at(token, ast.add_negate(out));
+                    }
+                    return true;
+                }
+                return fail(ErrorCode::ExpectedOperand, token.offset);
+            default:
+                return fail_at(token, ErrorCode::ExpectedOperand);
+        }
+    }
+
+    // name '(' expression (',' expression)* ')'; the current token is the '('.
+    bool parse_call(const Token& name, int depth, std::uint32_t& out) {
+        int builtin = find_builtin(name.text(source));
+        if (builtin < 0) {
+            return fail(ErrorCode::UnknownFunction, name.offset);
+        }
+        ++pos;
+        std::uint32_t args[2] = {};
+        int count = 0;
+        if (pos < tokens.size() && tokens[pos].kind == TokenKind::RightParen) {
+            ++pos;
+        } else {
+            do {
+                std::uint32_t arg = 0;
+                if (!parse_expression(0, depth + 1, arg)) {
+                    return false;
+                }
+                if (count < 2) {
+                    args[count] = arg;
+                }
+                ++count;
+            } while (accept(TokenKind::Comma));
+            if (!expect(TokenKind::RightParen, ErrorCode::ExpectedClosingParen)) {
+                return false;
+            }
+        }
+        if (count != get_builtin(builtin).arity) {
+            return fail(ErrorCode::WrongArgumentCount, name.offset);
+        }
+        out = at(name, ast.add_call(static_cast<std::uint32_t>(builtin), args[0], count == 2 ? args[1] : args[0]));
+        return true;
+    }
+
+    bool accept(TokenKind kind) {
+        if (pos < tokens.size() && tokens[pos].kind == kind) {
+            ++pos;
+            return true;
+        }
+        return false;
+    }
+
+    bool expect(TokenKind kind, ErrorCode code) {
+        return accept(kind) || fail(code, offset_here());
+    }
+
+    // Reports `code` at `token`, unless the lexer already flagged the token as bad.
+    bool fail_at(const Token& token, ErrorCode code) {
+        if (token.kind == TokenKind::Invalid) {
+            char c = source[token.offset];
+            code = (c >= '0' && c <= '9') || c == '.' ? ErrorCode::InvalidNumber : ErrorCode::UnexpectedCharacter;
+        }
+        return fail(code, token.offset);
+    }
+
+    // Notes where node `index` came from, if offsets are wanted. A node shared by
+    // hash-consing keeps its first, leftmost occurrence.
+    std::uint32_t at(const Token& token, std::uint32_t index) {
+        if (offsets != nullptr && index == offsets->size()) {
+            offsets->push_back(token.offset);
+        }
+        return index;
+    }
+
+    std::uint32_t offset_here() const {
+        return pos < tokens.size() ? tokens[pos].offset : static_cast<std::uint32_t>(source.size());
+    }
+
+    bool fail(ErrorCode code, std::uint32_t offset) {
+        error = {code, offset};
+        return false;
+    }
+
+    std::string_view source;
+    std::span<const Token> tokens;
+    Ast& ast;
+    std::vector<std::uint32_t>* offsets;
+    std::size_t pos = 0;
+    Error error;
+};
+
+} // namespace
+
+Error parse_tree(std::string_view expression, Ast& ast) {
+    // The token buffer is reused across calls, so a warm parse does not allocate.
+    thread_local std::vector<Token> tokens;
+    tokenize(expression, tokens);
+    return parse_tokens(expression, tokens, ast);
+}
+
+Error parse_tokens(std::string_view expression, std::span<const Token> tokens, Ast& ast) {
+    ast.clear();
+    // Every node comes from at least one token, so this covers the whole parse.
+    ast.reserve(tokens.size());
+    return PrattParser(expression, tokens, ast).parse();
+}
+
+Ast parse_tree(std::string_view expression, bool share_subtrees) {
+    Ast ast(share_subtrees);
+    if (Error error = parse_tree(expression, ast)) {
+        throw std::runtime_error(describe(error));
+    }
+    return ast;
+}
+
+Error locate_error(std::string_view expression, std::span<const double> bindings, ErrorCode code) {
+    // Buffers reused across calls, as in parse_tree(), so error-heavy input does not
+    // allocate once they are warm.
+    thread_local std::vector<Token> tokens;
+    thread_local Ast ast;
+    thread_local std::vector<std::uint32_t> offsets;
+    thread_local std::vector<double> values;
+    tokenize(expression, tokens);
+    ast.clear();
+    ast.reserve(tokens.size());
+    offsets.clear();
+    if (PrattParser(expression, tokens, ast, &offsets).parse()) {
+        return {code, 0};
+    }
+    // Nodes are in evaluation order (children first, left to right), so the first
+    // failing node is the one the evaluators tripped over.
+    values.resize(ast.size());
+    for (std::uint32_t i = 0; i < ast.size(); ++i) {
+        const AstNode& node = ast[i];
+        switch (node.kind) {
+            case NodeKind::Number:
+                values[i] = node.value;
+                break;
+            case NodeKind::Integer:
+                values[i] = static_cast<double>(node.integer);
+                break;
+            case NodeKind::Variable:
+                if (node.slot >= bindings.size()) {
+                    return {code, code == ErrorCode::UnboundVariable ? offsets[i] : 0};
+                }
+                values[i] = bindings[node.slot];
+                break;
+            default:
+                if (node.kind == NodeKind::Operation && node.op == '/' && values[node.right] == 0.0) {
+                    return {code, code == ErrorCode::DivisionByZero ? offsets[i] : 0};
+                }
+                values[i] = apply_node(node, values[node.left], values[node.right]);
+                break;
+        }
+    }
+    return {code, 0};
+}
@@ -0,0 +1,288 @@
+#ifndef EXPRESSION_H
+#define EXPRESSION_H
+
+#include "error.h"
+#include "functions.h"
+#include "lexer.h"
+
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Applies a binary operator to two already-evaluated operands. Shared by every
+// evaluator, the compile-time one included, so they agree on semantics, including the
+// division-by-zero error.
+constexpr double apply_operator(char op, double left_val, double right_val) {
+    switch (op) {
+        case '+': return left_val + right_val;
+        case '-': return left_val - right_val;
+        case '*': return left_val * right_val;
+        case '/':
+            if (right_val == 0.0) {
+                throw std::runtime_error("Division by zero!");
+            }
+            return left_val / right_val;
+        case '^': return std::pow(left_val, right_val);
+        default:
+            throw std::runtime_error("Unknown operator");
+    }
+}
+
+// Integer counterpart of apply_operator, used by the exact int64 path. Stores the
+// result and returns true only when it is exactly what the double path would compute
+// with unlimited precision. Returns false (the caller falls back to double) on
+// overflow, an inexact division, a negative exponent, or a zero that the double path
+// would produce as -0. Division by zero throws like apply_operator.
+constexpr bool apply_integer_operator(char op, std::int64_t left_val, std::int64_t right_val, std::int64_t& out) {
+    switch (op) {
+        case '+': return !__builtin_add_overflow(left_val, right_val, &out);
+        case '-': return !__builtin_sub_overflow(left_val, right_val, &out);
+        case '*':
+            return !__builtin_mul_overflow(left_val, right_val, &out) &&
+                   !(out == 0 && (left_val < 0 || right_val < 0));
+        case '/':
+            if (right_val == 0) {
+                throw std::runtime_error("Division by zero!");
+            }
+            if (right_val == -1 && left_val == INT64_MIN) {
+                return false;
+            }
+            out = left_val / right_val;
+            return left_val % right_val == 0 && !(out == 0 && right_val < 0);
+        case '^': {
+            if (right_val < 0) {
+                return false;
+            }
+            std::int64_t result = 1;
+            std::int64_t base = left_val;
+            for (std::int64_t exponent = right_val; exponent != 0; exponent >>= 1) {
+                if ((exponent & 1) && __builtin_mul_overflow(result, base, &result)) {
+                    return false;
+                }
+                if (exponent > 1 && __builtin_mul_overflow(base, base, &base)) {
+                    return false;
+                }
+            }
+            out = result;
+            return true;
+        }
+        default:
+            throw std::runtime_error("Unknown operator");
+    }
+}
+
+// Integer negation on the same terms: -0 and -INT64_MIN fall back to double.
+constexpr bool negate_integer(std::int64_t value, std::int64_t& out) {
+    return value != 0 && !__builtin_sub_overflow(std::int64_t{0}, value, &out);
+}
+
+enum class NodeKind : std::uint8_t {
+    Number,
+    Integer,
+    Operation,
+    Variable,
+    Negate,
+    Call,
+};
+
+// One slot of the arena. Children are referred to by their 32-bit index in the same
+// arena rather than by pointer, and are always stored before their parent.
+struct AstNode {
+    union {
+        double value;        // Number
+        std::int64_t integer; // Integer (an integer literal, kept exact)
+    };
+    std::uint32_t left;      // Operation, Negate, Call: first operand
+    std::uint32_t right;     // Operation, Call: second operand (a copy of left for unary calls)
+    std::uint32_t slot;      // Variable: index into the bindings; Call: built-in id
+    NodeKind kind;
+    char op;                 // Operation
+};
+
+// Computes an interior node (Operation, Negate or Call) from its operand values.
+inline double apply_node(const AstNode& node, double left_val, double right_val) {
+    switch (node.kind) {
+        case NodeKind::Negate: return -left_val;
+        case NodeKind::Call: return get_builtin(node.slot).scalar(left_val, right_val);
+        default: return apply_operator(node.op, left_val, right_val);
+    }
+}
+
+// A value paired with its derivative along one direction, for forward-mode automatic
+// differentiation: bind x as {x, 1} and every other variable as {v, 0}, and the
+// result's tangent is the partial derivative with respect to x.
+struct Dual {
+    double value;
+    double tangent;
+};
+
+class Ast;
+
+// Lightweight view of one node of an Ast. Valid for as long as the Ast it came from
+// is neither destroyed nor moved.
+class Node {
+public:
+    Node(const Ast& ast, std::uint32_t index) : ast(&ast), index(index) {}
+
+    [[nodiscard]] double evaluate() const;
+    [[nodiscard]] double evaluate(std::span<const double> bindings) const;
+    [[nodiscard]] Dual evaluate(std::span<const Dual> bindings) const;
+    [[nodiscard]] double evaluate_gradient(std::span<const double> bindings, std::span<double> gradient) const;
+    [[nodiscard]] NodeKind kind() const;
+    [[nodiscard]] std::uint32_t get_index() const { return index; }
+private:
+    const Ast* ast;
+    std::uint32_t index;
+};
+
+// RAII: Owns every node of an expression in one contiguous buffer, so a whole tree is
+// allocated once and freed once.
+//
+// By default the arena is hash-consed: adding a node that is structurally identical to
+// an existing one returns the existing index, so repeated subtrees such as the three
+// `(a+b)` in `(a+b)*(a+b)/(a+b)` become one shared node and the tree becomes a DAG.
+class Ast {
+public:
+    explicit Ast(bool hash_consing = true) : hash_consing(hash_consing) {}
+
+    void reserve(std::size_t count);
+    void clear();
+
+    std::uint32_t add_number(double value) {
+        return push({value, 0, 0, 0, NodeKind::Number, 0});
+    }
+    std::uint32_t add_integer(std::int64_t value) {
+        AstNode node{};
+        node.integer = value;
+        node.kind = NodeKind::Integer;
+        return push(node);
+    }
+    std::uint32_t add_operation(char op, std::uint32_t left, std::uint32_t right) {
+        return push({0.0, left, right, 0, NodeKind::Operation, op});
+    }
+    std::uint32_t add_negate(std::uint32_t operand) {
+        return push({0.0, operand, operand, 0, NodeKind::Negate, 0});
+    }
+    std::uint32_t add_call(std::uint32_t builtin, std::uint32_t first, std::uint32_t second) {
+        return push({0.0, first, second, builtin, NodeKind::Call, 0});
+    }
+    // Variables get a slot in order of first appearance; repeated names share it.
+    std::uint32_t add_variable(std::string_view name) {
+        return push({0.0, 0, 0, declare_variable(name), NodeKind::Variable, 0});
+    }
+    // Reserves a slot without adding a node (used by passes that rebuild a tree and
+    // must keep the original slot numbering).
+    std::uint32_t declare_variable(std::string_view name) {
+        std::uint32_t slot = 0;
+        while (slot < variables.size() && variables[slot] != name) {
+            ++slot;
+        }
+        if (slot == variables.size()) {
+            variables.emplace_back(name);
+        }
+        return slot;
+    }
+    void set_root(std::uint32_t index) { root_index = index; }
+
+    [[nodiscard]] Node root() const { return {*this, root_index}; }
+    [[nodiscard]] std::uint32_t get_root() const { return root_index; }
+    [[nodiscard]] std::size_t size() const { return nodes.size(); }
+    [[nodiscard]] bool empty() const { return nodes.empty(); }
+    [[nodiscard]] const AstNode& operator[](std::uint32_t index) const { return nodes[index]; }
+    [[nodiscard]] std::span<const AstNode> get_nodes() const { return nodes; }
+    [[nodiscard]] std::span<const std::string> get_variables() const { return variables; }
+    // Number of add_* calls answered with an existing node.
+    [[nodiscard]] std::size_t get_deduplicated() const { return deduplicated; }
+    // Heap bytes held by the arena, its hash table and variable names.
+    [[nodiscard]] std::size_t memory_usage() const;
+
+    // Evaluates the subtree rooted at `index`; variable slots index into `bindings`.
+    // Shared nodes are computed once per call.
+    [[nodiscard]] double evaluate(std::uint32_t index, std::span<const double> bindings = {}) const;
+    // Same, carrying a tangent through every node (see Dual). The value is exactly
+    // what the double overload returns. Defined in gradient.cpp.
+    [[nodiscard]] Dual evaluate(std::uint32_t index, std::span<const Dual> bindings) const;
+    // Value and full gradient in one pass: gradient[i] receives the partial
+    // derivative with respect to variable slot i, for every slot of the tree.
+    // Defined in gradient.cpp; see evaluate_gradient() in gradient.h.
+    [[nodiscard]] double evaluate_gradient(std::uint32_t index, std::span<const double> bindings,
+                                           std::span<double> gradient) const;
+private:
+    std::uint32_t push(const AstNode& node);
+    void rehash(std::size_t bucket_count);
+    [[nodiscard]] double evaluate_tree(std::uint32_t index, const double* bindings, std::uint32_t depth) const;
+    [[nodiscard]] double evaluate_dag(std::uint32_t index, std::span<const double> bindings) const;
+    [[nodiscard]] double leaf_value(const AstNode& node, std::span<const double> bindings) const;
+
+    std::vector<AstNode> nodes;
+    std::vector<std::string> variables;
+    std::uint32_t root_index = 0;
+
+    // Open-addressing table of node index + 1 (0 = empty), sized to a power of two.
+    bool hash_consing;
+    std::vector<std::uint32_t> buckets;
+    std::size_t deduplicated = 0;
+};
+
+inline double Node::evaluate() const { return ast->evaluate(index); }
+inline double Node::evaluate(std::span<const double> bindings) const { return ast->evaluate(index, bindings); }
+inline Dual Node::evaluate(std::span<const Dual> bindings) const { return ast->evaluate(index, bindings); }
+inline double Node::evaluate_gradient(std::span<const double> bindings, std::span<double> gradient) const {
+    return ast->evaluate_gradient(index, bindings, gradient);
+}
+inline NodeKind Node::kind() const { return (*ast)[index].kind; }
+
+// Function Object (Functor) to define operator precedence. A switch rather than a
+// lookup table, so the parser's per-operator query compiles down to a few compares
+// and the functor is usable in constant expressions.
+struct OperatorPrecedence {
+    // Overload the function call operator `()`
+    // to check the precedence of an operator.
+    constexpr int operator()(char op) const {
+        switch (op) {
+            case '+': case '-': return 1;
+            case '*': case '/': return 2;
+            case '^': return 3;
+            default: return 0; // Low precedence for unknown operators.
+        }
+    }
+    // `^` groups right-to-left (2^3^2 == 2^9); everything else left-to-right.
+    constexpr bool is_right_associative(char op) const { return op == '^'; }
+};
+
+// Function to check if a character is an operator.
+bool is_operator(char c);
+
+// Deepest nesting of parentheses, unary operators and right-associative chains the
+// recursive parser accepts before reporting an error instead of risking the stack.
+inline constexpr int kMaxNestingDepth = 2000;
+
+// Parses an infix expression and builds an expression tree. Grammar, loosest first:
+//   + -  (left)    * /  (left)    unary -, +    ^  (right)
+//   primary: number | variable | function(args...) | ( expression )
+// Literals written with digits only that fit in an int64 become Integer nodes.
+// With `share_subtrees` repeated subtrees are hash-consed into one node. Throws
+// std::runtime_error describing the first error. Most callers want
+// parse_expression() from calculator.h, which also compiles the tree.
+Ast parse_tree(std::string_view expression, bool share_subtrees = true);
+
+// Same, reusing the buffers of `ast` (its previous contents are discarded) and
+// reporting failure as a code plus source offset instead of throwing. Once the
+// buffers are warm this performs no heap allocation.
+[[nodiscard]] Error parse_tree(std::string_view expression, Ast& ast);
+// The parsing half of that, on tokens tokenize() produced from `expression`. Lets
+// lexing and parsing be timed apart.
+[[nodiscard]] Error parse_tokens(std::string_view expression, std::span<const Token> tokens, Ast& ast);
+
+// Pins down an evaluation error. Compiled code keeps no source positions, so
+// evaluators report DivisionByZero and UnboundVariable at offset 0; this re-parses
+// `expression` and returns `code` at the offset of the first '/' whose divisor is
+// zero, or of the first unbound variable, for `bindings`. Offset 0 if it finds no such
+// spot. Costs a parse: call it only once evaluation has failed.
+[[nodiscard]] Error locate_error(std::string_view expression, std::span<const double> bindings, ErrorCode code);
+
+#endif // EXPRESSION_H
@@ -0,0 +1,125 @@
+#include "expression_cache.h"
+
+#include <algorithm>
+
+namespace {
+
+// Rough per-entry bookkeeping cost: list node, hash node and control block.
+constexpr std::size_t kEntryOverhead = 128;
+
+bool is_space(char c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+bool is_word(char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c == '.';
+}
+bool is_sign(char c) { return c == '+' || c == '-'; }
+
+// True if `text` ends inside a number's exponent, "1e" or "1.5E-", where a blank
+// before (or after) the sign decides whether the sign belongs to the number.
+bool ends_in_exponent(std::string_view text) {
+    if (!text.empty() && is_sign(text.back())) {
+        text.remove_suffix(1);
+    }
+    if (text.empty() || (text.back() != 'e' && text.back() != 'E')) {
+        return false;
+    }
+    std::size_t start = text.size();
+    while (start > 0 && is_word(text[start - 1])) {
+        --start;
+    }
+    return text[start] == '.' || (text[start] >= '0' && text[start] <= '9');
+}
+
+} // namespace
+
+void ExpressionCache::normalize(std::string_view source, std::string& out) {
+    out.clear();
+    bool pending_space = false;
+    for (char c : source) {
+        if (is_space(c)) {
+            pending_space = true;
+            continue;
+        }
+        if (pending_space && !out.empty() &&
+            ((is_word(out.back()) && is_word(c)) ||
+             ((is_sign(c) || is_sign(out.back())) && ends_in_exponent(out)))) {
+            out += ' ';
+        }
+        pending_space = false;
+        out += c;
+    }
+}
+
+const ExpressionCache::Entry& ExpressionCache::lookup(std::string_view source) {
+    return *try_lookup(source).value();
+}
+
+Result<const ExpressionCache::Entry*> ExpressionCache::try_lookup(std::string_view source) {
+    normalize(source, key_buffer);
+    if (auto it = index.find(key_buffer); it != index.end()) {
+        ++stats.hits;
+        entries.splice(entries.begin(), entries, it->second);
+        return &entries.front();
+    }
+
+    ++stats.misses;
+    // Parse the original text so error offsets point into what the caller passed.
+    Result<CompiledExpression> parsed = try_parse_expression(source);
+    if (!parsed) {
+        return parsed.error();
+    }
+    auto expression = std::make_shared<const CompiledExpression>(std::move(*parsed));
+    entries.push_front({key_buffer, std::move(expression), 0});
+    Entry& entry = entries.front();
+    entry.bytes = entry.key.capacity() + entry.expression->memory_usage() + kEntryOverhead;
+    index.emplace(entry.key, entries.begin());
+    memory_used += entry.bytes;
+    // Never evict the entry we are about to return, even if it alone exceeds the cap;
+    // it goes the next time something is inserted.
+    evict_to(std::max(memory_limit, entry.bytes));
+    return &entry;
+}
+
+std::shared_ptr<const CompiledExpression> ExpressionCache::get(std::string_view source) {
+    return lookup(source).expression;
+}
+
+double ExpressionCache::evaluate(std::string_view source, std::span<const double> bindings) {
+    return lookup(source).expression->evaluate(bindings);
+}
+
+ExactValue ExpressionCache::evaluate_exact(std::string_view source, std::span<const double> bindings) {
+    return lookup(source).expression->evaluate_exact(bindings);
+}
+
+Result<ExactValue> ExpressionCache::try_evaluate_exact(std::string_view source, std::span<const double> bindings) {
+    Result<const Entry*> entry = try_lookup(source);
+    if (!entry) {
+        return entry.error();
+    }
+    Result<ExactValue> result = (*entry)->expression->try_evaluate_exact(bindings);
+    if (!result) {
+        return locate_error(source, bindings, result.error().code);
+    }
+    return result;
+}
+
+void ExpressionCache::set_memory_limit(std::size_t bytes) {
+    memory_limit = bytes;
+    evict_to(memory_limit);
+}
+
+void ExpressionCache::clear() {
+    index.clear();
+    entries.clear();
+    memory_used = 0;
+}
+
+void ExpressionCache::evict_to(std::size_t limit) {
+    while (memory_used > limit && !entries.empty()) {
+        const Entry& victim = entries.back();
+        index.erase(victim.key);
+        memory_used -= victim.bytes;
+        entries.pop_back();
+        ++stats.evictions;
+    }
+}
@@ -0,0 +1,82 @@
+#ifndef EXPRESSION_CACHE_H
+#define EXPRESSION_CACHE_H
+
+#include "calculator.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+struct CacheStats {
+    std::uint64_t hits = 0;
+    std::uint64_t misses = 0;
+    std::uint64_t evictions = 0;
+};
+
+// LRU cache of compiled expressions in front of parse_expression().
+//
+// Entries are keyed by normalized source text (insignificant whitespace removed), so
+// "x*2 + y" and "x * 2+y" share one entry. A hit costs one normalization pass and one
+// hash lookup: no lexing, parsing or compilation. The cache holds at most
+// `memory_limit` bytes (as estimated by CompiledExpression::memory_usage() plus the
+// key); least recently used entries are evicted first.
+//
+// Not thread-safe; give each thread its own cache. Expressions returned by get()
+// stay valid after eviction.
+class ExpressionCache {
+public:
+    explicit ExpressionCache(std::size_t memory_limit = 64u << 20) : memory_limit(memory_limit) {}
+
+    // The compiled form of `source`, parsed on a miss. Parse errors propagate as
+    // exceptions and are not cached.
+    [[nodiscard]] std::shared_ptr<const CompiledExpression> get(std::string_view source);
+
+    // Shorthands for get(source)->evaluate(bindings) and ->evaluate_exact(bindings)
+    // without the reference-count traffic.
+    [[nodiscard]] double evaluate(std::string_view source, std::span<const double> bindings = {});
+    [[nodiscard]] ExactValue evaluate_exact(std::string_view source, std::span<const double> bindings = {});
+    // Same as evaluate_exact(), without exceptions. Syntax and evaluation errors come
+    // back with their offset in `source` (see locate_error()).
+    [[nodiscard]] Result<ExactValue> try_evaluate_exact(std::string_view source,
+                                                        std::span<const double> bindings = {});
+
+    void set_memory_limit(std::size_t bytes);
+    void clear();
+
+    [[nodiscard]] const CacheStats& get_stats() const { return stats; }
+    [[nodiscard]] std::size_t size() const { return entries.size(); }
+    [[nodiscard]] std::size_t get_memory_used() const { return memory_used; }
+    [[nodiscard]] std::size_t get_memory_limit() const { return memory_limit; }
+
+    // Drops whitespace except where it separates two word characters ("x y" must not
+    // become "xy") or falls on either side of the sign after a number's exponent
+    // letter ("1e -5" is an error, "1e-5" a number). Writes into `out`, reusing its
+    // capacity.
+    static void normalize(std::string_view source, std::string& out);
+private:
+    struct Entry {
+        std::string key;
+        std::shared_ptr<const CompiledExpression> expression;
+        std::size_t bytes;
+    };
+
+    const Entry& lookup(std::string_view source);
+    Result<const Entry*> try_lookup(std::string_view source);
+    void evict_to(std::size_t limit);
+
+    std::size_t memory_limit;
+    std::size_t memory_used = 0;
+    CacheStats stats;
+    // Most recently used first. The index keys view the strings owned by the list
+    // nodes, which never move.
+    std::list<Entry> entries;
+    std::unordered_map<std::string_view, std::list<Entry>::iterator> index;
+    std::string key_buffer;
+};
+
+#endif // EXPRESSION_CACHE_H
@@ -0,0 +1,84 @@
+#ifndef FUNCTIONS_H
+#define FUNCTIONS_H
+
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <span>
+#include <string_view>
+
+// A built-in function callable from expressions, e.g. sqrt(x) or max(a, b). Every
+// built-in takes one or two arguments; unary ones ignore their second parameter.
+struct Builtin {
+    std::string_view name;
+    std::uint8_t arity;
+    double (*scalar)(double, double);
+};
+
+// Ids of the built-ins, in table order. Lets code that keeps per-function data (such
+// as the batch kernels) index it without a name lookup.
+enum class BuiltinId : std::uint8_t {
+    Sqrt,
+    Exp,
+    Log,
+    Abs,
+    Sin,
+    Cos,
+    Pow,
+    Min,
+    Max,
+};
+inline constexpr std::size_t kNumBuiltins = 9;
+
+// Which operand min(x, y) and max(x, y) return. A NaN yields the other operand, as with
+// fmin and fmax; but where C leaves the sign of fmin(+0, -0) unspecified (and libm
+// versions differ), -0 counts as below +0 in either order. Other ties go to the
+// second operand. The scalar built-ins, the batch kernels (see batch_math.h) and the
+// gradient (see gradient.cpp) all follow this.
+[[nodiscard]] constexpr bool min_selects_first(double x, double y) {
+    if (x != x || y != y) {
+        return y != y;
+    }
+    return x == y ? std::bit_cast<std::int64_t>(x) < 0 && std::bit_cast<std::int64_t>(y) >= 0 : x < y;
+}
+[[nodiscard]] constexpr bool max_selects_first(double x, double y) {
+    if (x != x || y != y) {
+        return y != y;
+    }
+    return x == y ? std::bit_cast<std::int64_t>(x) >= 0 && std::bit_cast<std::int64_t>(y) < 0 : x > y;
+}
+[[nodiscard]] constexpr double min_value(double x, double y) { return min_selects_first(x, y) ? x : y; }
+[[nodiscard]] constexpr double max_value(double x, double y) { return max_selects_first(x, y) ? x : y; }
+
+// All built-ins; a function's id is its index in this table. Defined here, and usable in
+// constant expressions, so the compile-time parser (see static_expression.h) accepts
+// exactly the same functions as the runtime one.
+inline constexpr Builtin builtin_table[] = {
+    {"sqrt", 1, [](double x, double) { return std::sqrt(x); }},
+    {"exp", 1, [](double x, double) { return std::exp(x); }},
+    {"log", 1, [](double x, double) { return std::log(x); }},
+    {"abs", 1, [](double x, double) { return std::fabs(x); }},
+    {"sin", 1, [](double x, double) { return std::sin(x); }},
+    {"cos", 1, [](double x, double) { return std::cos(x); }},
+    {"pow", 2, [](double x, double y) { return std::pow(x, y); }},
+    {"min", 2, [](double x, double y) { return min_value(x, y); }},
+    {"max", 2, [](double x, double y) { return max_value(x, y); }},
+};
+static_assert(std::size(builtin_table) == kNumBuiltins);
+
+[[nodiscard]] constexpr std::span<const Builtin> builtins() { return builtin_table; }
+[[nodiscard]] constexpr const Builtin& get_builtin(std::uint32_t id) { return builtin_table[id]; }
+
+// Id of the built-in called `name`, or -1 if there is none.
+[[nodiscard]] constexpr int find_builtin(std::string_view name) {
+    for (std::size_t i = 0; i < kNumBuiltins; ++i) {
+        if (builtin_table[i].name == name) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+#endif // FUNCTIONS_H
@@ -0,0 +1,206 @@
+#include "gradient.h"
+#include "batch_kernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr std::uint32_t kNoTangent = std::numeric_limits<std::uint32_t>::max();
+
+// A node's value with its partial derivatives with respect to its left and right
+// operands (right is 0 for unary nodes).
+struct Partials {
+    double value;
+    double left;
+    double right;
+};
+
+Partials power_partials(double value, double x, double y) {
+    // d/dx x^y = y x^(y-1), taken as 0 for y = 0 so that x^0 is constant even at x = 0.
+    // d/dy x^y = x^y ln x, taken as 0 where x^y is 0 (0 * -inf otherwise).
+    double dx = y == 0.0 ? 0.0 : y * std::pow(x, y - 1.0);
+    double dy = value == 0.0 ? 0.0 : value * std::log(x);
+    return {value, dx, dy};
+}
+
+// The value is apply_node()'s, so it matches the other evaluators exactly (and
+// division by zero throws the same error).
+Partials differentiate(const AstNode& node, double x, double y) {
+    const double value = apply_node(node, x, y);
+    if (node.kind == NodeKind::Negate) {
+        return {value, -1.0, 0.0};
+    }
+    if (node.kind == NodeKind::Call) {
+        switch (static_cast<BuiltinId>(node.slot)) {
+            case BuiltinId::Sqrt: return {value, 0.5 / value, 0.0};
+            case BuiltinId::Exp: return {value, value, 0.0};
+            case BuiltinId::Log: return {value, 1.0 / x, 0.0};
+            case BuiltinId::Abs: return {value, x > 0.0 ? 1.0 : x < 0.0 ? -1.0 : 0.0, 0.0};
+            case BuiltinId::Sin: return {value, std::cos(x), 0.0};
+            case BuiltinId::Cos: return {value, -std::sin(x), 0.0};
+            case BuiltinId::Pow: return power_partials(value, x, y);
+            // The derivative is that of the operand min or max returns.
+            case BuiltinId::Min: {
+                bool first = min_selects_first(x, y);
+                return {value, first ? 1.0 : 0.0, first ? 0.0 : 1.0};
+            }
+            case BuiltinId::Max: {
+                bool first = max_selects_first(x, y);
+                return {value, first ? 1.0 : 0.0, first ? 0.0 : 1.0};
+            }
+        }
+    }
+    switch (node.op) {
+        case '+': return {value, 1.0, 1.0};
+        case '-': return {value, 1.0, -1.0};
+        case '*': return {value, y, x};
+        case '/': return {value, 1.0 / y, -value / y};
+        default: return power_partials(value, x, y);
+    }
+}
+
+bool is_interior(const AstNode& node) {
+    return node.kind != NodeKind::Number && node.kind != NodeKind::Integer && node.kind != NodeKind::Variable;
+}
+
+bool is_unary(const AstNode& node) {
+    return node.kind == NodeKind::Negate || (node.kind == NodeKind::Call && get_builtin(node.slot).arity == 1);
+}
+
+// Marks the nodes reachable from `index`: children precede parents, so one backward
+// sweep suffices (as in Ast::evaluate).
+void mark_reachable(const Ast& ast, std::uint32_t index, std::vector<char>& reachable) {
+    reachable.assign(index + 1, 0);
+    reachable[index] = 1;
+    for (std::uint32_t i = index + 1; i-- > 0;) {
+        if (reachable[i] && is_interior(ast[i])) {
+            reachable[ast[i].left] = 1;
+            reachable[ast[i].right] = 1;
+        }
+    }
+}
+
+[[noreturn]] void throw_unbound(const Ast& ast, std::uint32_t slot) {
+    throw std::runtime_error("Unbound variable '" + ast.get_variables()[slot] + "'");
+}
+
+double constant_value(const AstNode& node) {
+    return node.kind == NodeKind::Number ? node.value : static_cast<double>(node.integer);
+}
+
+} // namespace
+
+Dual Ast::evaluate(std::uint32_t index, std::span<const Dual> bindings) const {
+    thread_local std::vector<char> reachable;
+    thread_local std::vector<Dual> duals;
+    mark_reachable(*this, index, reachable);
+    duals.resize(index + 1);
+
+    for (std::uint32_t i = 0; i <= index; ++i) {
+        if (!reachable[i]) {
+            continue;
+        }
+        const AstNode& node = nodes[i];
+        if (node.kind == NodeKind::Variable) {
+            if (node.slot >= bindings.size()) {
+                throw_unbound(*this, node.slot);
+            }
+            duals[i] = bindings[node.slot];
+        } else if (!is_interior(node)) {
+            duals[i] = {constant_value(node), 0.0};
+        } else {
+            const Dual& x = duals[node.left];
+            const Dual& y = duals[node.right];
+            Partials d = differentiate(node, x.value, y.value);
+            double tangent = is_unary(node) ? tangent_term(d.left, x.tangent)
+                                            : tangent_term(d.left, x.tangent) + tangent_term(d.right, y.tangent);
+            duals[i] = {d.value, tangent};
+        }
+    }
+    return duals[index];
+}
+
+double Ast::evaluate_gradient(std::uint32_t index, std::span<const double> bindings,
+                              std::span<double> gradient) const {
+    return ::evaluate_gradient(*this, index, bindings, gradient, detect_simd_level());
+}
+
+double evaluate_gradient(const Ast& ast, std::uint32_t index, std::span<const double> bindings,
+                         std::span<double> gradient, SimdLevel level) {
+    const std::size_t lanes = ast.get_variables().size();
+    if (gradient.size() < lanes) {
+        throw std::runtime_error("Gradient has room for " + std::to_string(gradient.size()) + " of " +
+                                 std::to_string(lanes) + " variables");
+    }
+    const BatchKernels& kernels = kernels_for(level);
+
+    // Per-thread scratch, reused across calls. `rows[i]` is the row of `tangents`
+    // holding node i's tangent vector, or kNoTangent for nodes without variables.
+    thread_local std::vector<char> reachable;
+    thread_local std::vector<double> values;
+    thread_local std::vector<std::uint32_t> rows;
+    thread_local std::vector<double> tangents;
+    mark_reachable(ast, index, reachable);
+    values.resize(index + 1);
+    rows.resize(index + 1);
+    tangents.clear();
+
+    std::uint32_t next_row = 0;
+    auto new_row = [&] {
+        tangents.resize((std::size_t{next_row} + 1) * lanes);
+        return next_row++;
+    };
+    for (std::uint32_t i = 0; i <= index; ++i) {
+        if (!reachable[i]) {
+            continue;
+        }
+        const AstNode& node = ast[i];
+        if (node.kind == NodeKind::Variable) {
+            if (node.slot >= bindings.size()) {
+                throw_unbound(ast, node.slot);
+            }
+            values[i] = bindings[node.slot];
+            rows[i] = new_row();
+            double* seed = tangents.data() + std::size_t{rows[i]} * lanes;
+            std::fill_n(seed, lanes, 0.0);
+            seed[node.slot] = 1.0;
+            continue;
+        }
+        if (!is_interior(node)) {
+            values[i] = constant_value(node);
+            rows[i] = kNoTangent;
+            continue;
+        }
+
+        Partials d = differentiate(node, values[node.left], values[node.right]);
+        values[i] = d.value;
+        std::uint32_t left = rows[node.left];
+        std::uint32_t right = is_unary(node) ? kNoTangent : rows[node.right];
+        if (left == kNoTangent && right == kNoTangent) {
+            rows[i] = kNoTangent;
+            continue;
+        }
+        rows[i] = new_row();
+        // Rows are addressed after new_row(), which may have moved the buffer.
+        double* dst = tangents.data() + std::size_t{rows[i]} * lanes;
+        auto row = [&](std::uint32_t r) { return tangents.data() + std::size_t{r} * lanes; };
+        if (right == kNoTangent) {
+            kernels.scale(d.left, row(left), dst, lanes);
+        } else if (left == kNoTangent) {
+            kernels.scale(d.right, row(right), dst, lanes);
+        } else {
+            kernels.combine(d.left, row(left), d.right, row(right), dst, lanes);
+        }
+    }
+
+    if (rows[index] == kNoTangent) {
+        std::fill_n(gradient.begin(), lanes, 0.0);
+    } else {
+        std::copy_n(tangents.begin() + std::size_t{rows[index]} * lanes, lanes, gradient.begin());
+    }
+    return values[index];
+}
@@ -0,0 +1,34 @@
+#ifndef GRADIENT_H
+#define GRADIENT_H
+
+#include "batch.h"
+#include "expression.h"
+
+#include <cstdint>
+#include <span>
+
+// Forward-mode automatic differentiation.
+//
+// Every node carries its value and a tangent vector with one lane per variable slot,
+// seeded with the unit vector of the slot at each variable. One sweep over the tree
+// yields the value and the exact gradient (up to rounding), where finite differences
+// need one evaluation per variable plus one and lose about half the digits. A node's
+// tangent is a combination of its operands' tangents, a * left + b * right, with a
+// and b its partial derivatives; that combination runs over all lanes at once on the
+// SIMD kernels of `level` (see batch_kernels.h). Subtrees that mention no variable
+// carry no tangent at all.
+//
+// Conventions where the derivative does not exist: abs'(0) is 0; min and max follow
+// the operand they return; x^y contributes nothing through the exponent when the
+// result is 0, and NaN when x is negative. A partial derivative only matters where
+// its operand's tangent is non-zero, so x^2 is differentiable at x = -1 and sqrt(c)
+// for a constant c = 0 does not poison the gradient with 0 * inf.
+//
+// Lane k of the gradient equals the tangent Ast::evaluate() returns when only slot k
+// is seeded with 1, at every level: the same products and sums, in the same order.
+// Throws like Ast::evaluate(), and if `gradient` has fewer entries than the tree has
+// variables.
+[[nodiscard]] double evaluate_gradient(const Ast& ast, std::uint32_t index, std::span<const double> bindings,
+                                       std::span<double> gradient, SimdLevel level);
+
+#endif // GRADIENT_H
@@ -0,0 +1,320 @@
+#include "jit.h"
+
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+
+#if defined(__x86_64__)
+
+double pow_function(double x, double y) { return std::pow(x, y); }
+
+// Where an operand lives.
+struct Location {
+    enum Kind { Xmm, Constant, Variable, Temporary } kind;
+    std::uint32_t index;     // xmm register, constant, variable slot or temporary
+};
+
+// Just enough of an x86-64 assembler for scalar double code. Memory operands are
+// [rip + pool], [rbp + 8*slot] (bindings) or [rbx + 8 + 8*temporary] (scratch).
+class Assembler {
+public:
+    std::vector<std::uint8_t> code;
+
+    void emit(std::initializer_list<std::uint8_t> bytes) { code.insert(code.end(), bytes); }
+    void emit32(std::uint32_t value) {
+        for (int i = 0; i < 4; ++i) code.push_back(static_cast<std::uint8_t>(value >> (8 * i)));
+    }
+    void emit64(std::uint64_t value) {
+        for (int i = 0; i < 8; ++i) code.push_back(static_cast<std::uint8_t>(value >> (8 * i)));
+    }
+
+    // prefix 0F opcode with xmm `reg` and operand `rm`.
+    void sse(std::uint8_t prefix, std::uint8_t opcode, std::uint32_t reg, Location rm) {
+        emit({prefix, 0x0F, opcode});
+        auto r = static_cast<std::uint8_t>(reg << 3);
+        switch (rm.kind) {
+            case Location::Xmm:
+                emit({static_cast<std::uint8_t>(0xC0 | r | rm.index)});
+                break;
+            case Location::Constant:
+                // Pool layout: a 16-byte sign mask, then the constants.
+                emit({static_cast<std::uint8_t>(0x05 | r)});
+                pool_fixups.push_back({code.size(), 16 + 8 * rm.index});
+                emit32(0);
+                break;
+            case Location::Variable:
+                emit({static_cast<std::uint8_t>(0x85 | r)});
+                emit32(8 * rm.index);
+                break;
+            case Location::Temporary:
+                emit({static_cast<std::uint8_t>(0x83 | r)});
+                emit32(8 + 8 * rm.index);
+                break;
+        }
+    }
+    void movsd_load(std::uint32_t reg, Location from) { sse(0xF2, 0x10, reg, from); }
+    void movsd_store(Location to, std::uint32_t reg) { sse(0xF2, 0x11, reg, to); }
+    void movapd(std::uint32_t to, std::uint32_t from) { sse(0x66, 0x28, to, {Location::Xmm, from}); }
+    void xorpd_sign_mask(std::uint32_t reg) {
+        emit({0x66, 0x0F, 0x57, static_cast<std::uint8_t>(0x05 | reg << 3)});
+        pool_fixups.push_back({code.size(), 0});
+        emit32(0);
+    }
+
+    // je to the division-by-zero exit unless xmm1 is nonzero or NaN.
+    void jump_if_xmm1_zero() {
+        emit({0x66, 0x0F, 0x57, 0xD2});          // xorpd xmm2, xmm2
+        emit({0x66, 0x0F, 0x2E, 0xCA});          // ucomisd xmm1, xmm2
+        emit({0x7A, 0x06});                      // jp +6 (unordered: NaN is not zero)
+        emit({0x0F, 0x84});                      // je rel32
+        zero_fixups.push_back(code.size());
+        emit32(0);
+    }
+
+    void call(const void* function) {
+        emit({0x48, 0xB8});                      // mov rax, imm64
+        emit64(reinterpret_cast<std::uint64_t>(function));
+        emit({0xFF, 0xD0});                      // call rax
+    }
+
+    void prologue() {
+        emit({0x55, 0x53});                      // push rbp; push rbx
+        emit({0x48, 0x83, 0xEC, 0x08});          // sub rsp, 8 (16-byte aligned for calls)
+        emit({0x48, 0x89, 0xFD});                // mov rbp, rdi (bindings)
+        emit({0x48, 0x89, 0xF3});                // mov rbx, rsi (scratch)
+    }
+    void epilogue() {
+        emit({0x48, 0x83, 0xC4, 0x08});          // add rsp, 8
+        emit({0x5B, 0x5D, 0xC3});                // pop rbx; pop rbp; ret
+    }
+
+    // Appends the division-by-zero exit and the constant pool, and resolves fixups.
+    void finish(const std::vector<double>& constants) {
+        std::size_t zero_exit = code.size();
+        emit({0x48, 0xC7, 0x03, 0x01, 0x00, 0x00, 0x00});   // mov qword [rbx], 1
+        epilogue();
+        for (std::size_t at : zero_fixups) {
+            patch(at, zero_exit);
+        }
+
+        code.resize((code.size() + 15) & ~std::size_t{15}, 0xCC);
+        std::size_t pool = code.size();
+        emit64(0x8000000000000000ull);
+        emit64(0);
+        for (double constant : constants) {
+            std::uint64_t bits;
+            std::memcpy(&bits, &constant, sizeof bits);
+            emit64(bits);
+        }
+        for (auto [at, offset] : pool_fixups) {
+            patch(at, pool + offset);
+        }
+    }
+private:
+    // rel32 at `at`, relative to the end of the instruction (the field is always last).
+    void patch(std::size_t at, std::size_t target) {
+        auto rel = static_cast<std::uint32_t>(static_cast<std::int64_t>(target) - static_cast<std::int64_t>(at + 4));
+        std::memcpy(&code[at], &rel, sizeof rel);
+    }
+
+    std::vector<std::pair<std::size_t, std::size_t>> pool_fixups;
+    std::vector<std::size_t> zero_fixups;
+};
+
+std::vector<std::uint8_t> generate(const Program& program) {
+    auto first_variable = static_cast<std::uint32_t>(program.constants.size());
+    std::uint32_t first_temporary = first_variable + program.num_variables;
+    auto location = [&](std::uint32_t reg) -> Location {
+        if (reg < first_variable) return {Location::Constant, reg};
+        if (reg < first_temporary) return {Location::Variable, reg - first_variable};
+        return {Location::Temporary, reg - first_temporary};
+    };
+    constexpr Location xmm0{Location::Xmm, 0};
+    constexpr Location xmm1{Location::Xmm, 1};
+
+    // A temporary read once, by the very next instruction, never touches memory.
+    std::vector<std::uint32_t> uses(program.num_registers, 0);
+    for (const Instruction& ins : program.code) {
+        ++uses[ins.lhs];
+        if (ins.rhs != ins.lhs) ++uses[ins.rhs];
+    }
+    ++uses[program.result];
+
+    Assembler a;
+    a.prologue();
+    constexpr std::uint32_t kNone = UINT32_MAX;
+    std::uint32_t cached = kNone;        // register whose value is in xmm0
+    for (std::size_t i = 0; i < program.code.size(); ++i) {
+        const Instruction& ins = program.code[i];
+        std::uint32_t lhs = ins.lhs;
+        std::uint32_t rhs = ins.rhs;
+        switch (ins.op) {
+            case OpCode::Add: case OpCode::Sub: case OpCode::Mul: case OpCode::Div: {
+                bool commutative = ins.op == OpCode::Add || ins.op == OpCode::Mul;
+                if (cached != lhs && cached == rhs && commutative) {
+                    std::swap(lhs, rhs);
+                }
+                Location right = rhs == lhs && cached == lhs ? xmm0 : location(rhs);
+                if (cached != lhs) {
+                    if (cached == rhs) {
+                        a.movapd(1, 0);
+                        right = xmm1;
+                    }
+                    a.movsd_load(0, location(lhs));
+                    if (rhs == lhs) right = xmm0;
+                }
+                if (ins.op == OpCode::Div) {
+                    if (right.kind == Location::Xmm && right.index == 0) {
+                        a.movapd(1, 0);
+                    } else if (right.kind != Location::Xmm) {
+                        a.movsd_load(1, right);
+                    }
+                    right = xmm1;
+                    a.jump_if_xmm1_zero();
+                }
+                static constexpr std::uint8_t opcodes[] = {0x58, 0x5C, 0x59, 0x5E};  // add sub mul div
+                a.sse(0xF2, opcodes[static_cast<int>(ins.op)], 0, right);
+                break;
+            }
+            case OpCode::Neg:
+                if (cached != lhs) a.movsd_load(0, location(lhs));
+                a.xorpd_sign_mask(0);
+                break;
+            case OpCode::Pow: case OpCode::Call:
+                if (rhs == lhs) {
+                    if (cached != lhs) a.movsd_load(0, location(lhs));
+                    a.movapd(1, 0);
+                } else if (cached == rhs) {
+                    a.movapd(1, 0);
+                    a.movsd_load(0, location(lhs));
+                } else {
+                    if (cached != lhs) a.movsd_load(0, location(lhs));
+                    a.movsd_load(1, location(rhs));
+                }
+                a.call(ins.op == OpCode::Pow ? reinterpret_cast<const void*>(&pow_function)
+                                             : reinterpret_cast<const void*>(get_builtin(ins.builtin).scalar));
+                break;
+        }
+        cached = ins.dst;
+        bool consumed_next = uses[ins.dst] == 1 &&
+                             (i + 1 < program.code.size()
+                                  ? program.code[i + 1].lhs == ins.dst || program.code[i + 1].rhs == ins.dst
+                                  : program.result == ins.dst);
+        if (!consumed_next) {
+            a.movsd_store(location(ins.dst), 0);
+        }
+    }
+    if (cached != program.result) {
+        a.movsd_load(0, location(program.result));
+    }
+    a.epilogue();
+    a.finish(program.constants);
+    return std::move(a.code);
+}
+
+#endif
+
+} // namespace
+
+bool JitFunction::is_supported() {
+#if defined(__x86_64__)
+    return true;
+#else
+    return false;
+#endif
+}
+
+JitFunction::JitFunction(const Program& program)
+    : num_variables(program.num_variables),
+      num_temporaries(program.num_registers - static_cast<std::uint32_t>(program.constants.size()) -
+                      program.num_variables) {
+#if defined(__x86_64__)
+    std::vector<std::uint8_t> code = generate(program);
+    auto page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    size = code.size();
+    mapping_size = (size + page - 1) / page * page;
+    mapping = ::mmap(nullptr, mapping_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) {
+        mapping = nullptr;
+        throw std::runtime_error(std::string("Cannot map JIT code: ") + std::strerror(errno));
+    }
+    std::memcpy(mapping, code.data(), size);
+    if (::mprotect(mapping, mapping_size, PROT_READ | PROT_EXEC) != 0) {
+        int error = errno;
+        release();
+        throw std::runtime_error(std::string("Cannot make JIT code executable: ") + std::strerror(error));
+    }
+    entry = reinterpret_cast<Entry>(mapping);
+#else
+    (void)program;
+    throw std::runtime_error("JIT compilation is only supported on x86-64");
+#endif
+}
+
+JitFunction::~JitFunction() {
+    release();
+}
+
+JitFunction::JitFunction(JitFunction&& other) noexcept
+    : mapping(std::exchange(other.mapping, nullptr)), mapping_size(std::exchange(other.mapping_size, 0)),
+      size(std::exchange(other.size, 0)), entry(std::exchange(other.entry, nullptr)),
+      num_variables(other.num_variables), num_temporaries(other.num_temporaries) {}
+
+JitFunction& JitFunction::operator=(JitFunction&& other) noexcept {
+    if (this != &other) {
+        release();
+        mapping = std::exchange(other.mapping, nullptr);
+        mapping_size = std::exchange(other.mapping_size, 0);
+        size = std::exchange(other.size, 0);
+        entry = std::exchange(other.entry, nullptr);
+        num_variables = other.num_variables;
+        num_temporaries = other.num_temporaries;
+    }
+    return *this;
+}
+
+void JitFunction::release() {
+    if (mapping != nullptr) {
+        ::munmap(mapping, mapping_size);
+        mapping = nullptr;
+        mapping_size = 0;
+        entry = nullptr;
+    }
+}
+
+double JitFunction::run(std::span<const double> bindings) const {
+    if (bindings.size() < num_variables) {
+        throw std::runtime_error("Expected " + std::to_string(num_variables) + " variable bindings, got " +
+                                 std::to_string(bindings.size()));
+    }
+    Result<double> result = try_run(bindings);
+    if (!result) {
+        throw std::runtime_error("Division by zero!");
+    }
+    return *result;
+}
+
+Result<double> JitFunction::try_run(std::span<const double> bindings) const {
+    if (bindings.size() < num_variables) {
+        return Error{ErrorCode::UnboundVariable, 0};
+    }
+    thread_local std::vector<double> scratch;
+    if (scratch.size() < num_temporaries + 1) {
+        scratch.resize(num_temporaries + 1);
+    }
+    scratch[0] = 0.0;
+    double result = entry(bindings.data(), scratch.data());
+    if (scratch[0] != 0.0) {
+        return Error{ErrorCode::DivisionByZero, 0};
+    }
+    return result;
+}
@@ -0,0 +1,58 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "bytecode.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+// Evaluations after which CompiledExpression compiles an expression to native code.
+// Below it, compiling would cost more than it saves.
+inline constexpr std::uint64_t kJitThreshold = 1000;
+
+// RAII: Native x86-64 code for one Program, in its own executable mapping.
+//
+// Each instruction becomes a few scalar SSE2 instructions. Variables are read through
+// a pointer to the bindings, constants through RIP-relative loads from a pool after
+// the code, and temporaries live in a per-thread scratch array; a temporary consumed
+// only by the next instruction stays in a register instead. Pow and calls go out to
+// the same C functions the interpreter uses, so results are bit-for-bit identical.
+// The mapping is writable only while the code is emitted, then read + execute.
+class JitFunction {
+public:
+    // Whether this build can generate native code (x86-64 only).
+    [[nodiscard]] static bool is_supported();
+
+    // Throws std::runtime_error if unsupported or the mapping cannot be created.
+    explicit JitFunction(const Program& program);
+    ~JitFunction();
+
+    JitFunction(const JitFunction&) = delete;
+    JitFunction& operator=(const JitFunction&) = delete;
+    JitFunction(JitFunction&& other) noexcept;
+    JitFunction& operator=(JitFunction&& other) noexcept;
+
+    // `bindings[i]` is the value of variable slot i; it must cover every slot. Throws
+    // "Division by zero!" like the interpreter. Thread-safe.
+    [[nodiscard]] double run(std::span<const double> bindings = {}) const;
+    // Same, reporting errors as VirtualMachine::try_run() does.
+    [[nodiscard]] Result<double> try_run(std::span<const double> bindings = {}) const;
+
+    // Bytes of machine code and constant pool.
+    [[nodiscard]] std::size_t code_size() const { return size; }
+private:
+    // scratch[0] is set to nonzero on division by zero; temporaries follow.
+    using Entry = double (*)(const double* bindings, double* scratch);
+
+    void release();
+
+    void* mapping = nullptr;
+    std::size_t mapping_size = 0;
+    std::size_t size = 0;
+    Entry entry = nullptr;
+    std::uint32_t num_variables = 0;
+    std::uint32_t num_temporaries = 0;
+};
+
+#endif // JIT_H
@@ -0,0 +1,58 @@
+#include "lexer.h"
+
+#include <algorithm>
+#include <charconv>
+#include <system_error>
+
+namespace {
+
+// ASCII-only classification: the grammar is ASCII and <cctype> is locale-aware.
+bool is_space(char c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+bool is_digit(char c) { return c >= '0' && c <= '9'; }
+bool is_alpha(char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); }
+bool is_identifier_start(char c) { return is_alpha(c) || c == '_'; }
+bool is_identifier_char(char c) { return is_identifier_start(c) || is_digit(c); }
+
+} // namespace
+
+void tokenize(std::string_view source, std::vector<Token>& tokens) {
+    tokens.clear();
+    const char* begin = source.data();
+    const char* end = begin + source.size();
+
+    for (const char* p = begin; p < end;) {
+        char c = *p;
+        auto offset = static_cast<std::uint32_t>(p - begin);
+        if (is_space(c)) {
+            ++p;
+        } else if (is_digit(c) || (c == '.' && p + 1 < end && is_digit(p[1]))) {
+            double value = 0.0;
+            auto [next, ec] = std::from_chars(p, end, value);
+            auto length = static_cast<std::uint32_t>(next - p);
+            Token& token = tokens.emplace_back(
+                Token{value, offset, length, ec == std::errc() ? TokenKind::Number : TokenKind::Invalid, 0});
+            if (std::all_of(p, next, is_digit)) {
+                auto [int_end, int_ec] = std::from_chars(p, next, token.integer);
+                token.is_integer = int_ec == std::errc() && int_end == next;
+            }
+            p = next;
+        } else if (is_identifier_start(c)) {
+            const char* start = p;
+            while (p < end && is_identifier_char(*p)) {
+                ++p;
+            }
+            tokens.push_back({0.0, offset, static_cast<std::uint32_t>(p - start), TokenKind::Identifier, 0});
+        } else {
+            TokenKind kind = TokenKind::Invalid;
+            switch (c) {
+                case '+': case '-': case '*': case '/': case '^': kind = TokenKind::Operator; break;
+                case '(': kind = TokenKind::LeftParen; break;
+                case ')': kind = TokenKind::RightParen; break;
+                case ',': kind = TokenKind::Comma; break;
+                default: break;
+            }
+            tokens.push_back({0.0, offset, 1, kind, c});
+            ++p;
+        }
+    }
+}
@@ -0,0 +1,37 @@
+#ifndef LEXER_H
+#define LEXER_H
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+enum class TokenKind : std::uint8_t {
+    Number,
+    Identifier,
+    Operator,       // + - * / ^
+    LeftParen,
+    RightParen,
+    Comma,
+    Invalid,        // unknown character or unrepresentable number
+};
+
+// A token refers back into the source text by offset; it never owns characters.
+struct Token {
+    double value;            // Number
+    std::uint32_t offset;
+    std::uint32_t length;
+    TokenKind kind;
+    char op;                 // Operator
+    bool is_integer = false;  // Number: digits only, and fits in an int64
+    std::int64_t integer = 0; // Number: exact value when is_integer
+
+    [[nodiscard]] constexpr std::string_view text(std::string_view source) const { return source.substr(offset, length); }
+};
+
+// Splits `source` into tokens, replacing the contents of `tokens`. Numbers are parsed
+// with std::from_chars (locale-independent, scientific notation allowed), so once
+// `tokens` has enough capacity a call performs no heap allocation. Integer literals
+// also keep their exact int64 value, which `value` cannot hold above 2^53.
+void tokenize(std::string_view source, std::vector<Token>& tokens);
+
+#endif // LEXER_H
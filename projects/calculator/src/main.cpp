@@ -1,178 +1,180 @@
 #include "stack_trace.cpp"
+#include "aggregate.h"
+#include "batch_file.h"
+#include "csv_file.h"
+#include "expression_cache.h"
+#include "phase_stats.h"
+#include "server.h"
+#include <csignal>
+#include <cstdio>
 #include <iostream>
 #include <string>
-#include <vector>
-#include <stack>
-#include <functional>
-#include <stdexcept>
-#include <memory>
-#include <map>
-
-// --- Remaining Calculator Code (Unchanged from before) ---
+#include <string_view>
+
+namespace {
+
+void print_usage(const char* program) {
+    std::cerr << "Usage: " << program << " [--batch <file> | --csv <file> <expression>] [--threads N] [--stats]\n"
+              << "       " << program << " [--serve <socket> | --debug-traces] [--stats]\n"
+              << "  Without options, starts an interactive REPL.\n"
+              << "  --batch <file>   evaluate every line of <file>, one result per line on stdout\n"
+              << "  --csv <file> <expression>\n"
+              << "                   evaluate <expression> for every row of a CSV file, variables\n"
+              << "                   bound to the header's column names; one result per row on stdout\n"
+              << "  --threads N      evaluate --batch or --csv input on N threads (0 = all cores)\n"
+              << "  --serve <socket> answer expression requests on a UNIX domain socket until\n"
+              << "                   SIGINT or SIGTERM\n"
+              << "  --debug-traces   print a stack trace after each REPL error\n"
+              << "  --stats          print time spent per phase (parse, build, evaluate) at exit;\n"
+              << "                   in the REPL, ':stats' prints it at any time" << std::endl;
+}
 
-// RAII: Base class for expression tree nodes.
-class Node {
-public:
-    [[nodiscard]] virtual double evaluate() const = 0;
-    virtual ~Node() = default;
-};
+Server* active_server = nullptr;
+
+int run_server(const std::string& socket_path) {
+    Server server({socket_path});
+    active_server = &server;
+    auto stop = [](int) { active_server->stop(); };
+    std::signal(SIGINT, stop);
+    std::signal(SIGTERM, stop);
+    std::cerr << "Listening on " << socket_path << std::endl;
+    server.run();
+    active_server = nullptr;
+
+    const ServerStats& stats = server.get_stats();
+    std::cerr << "Served " << stats.requests << " requests (" << stats.errors << " errors) from "
+              << stats.connections << " connections in " << stats.wakeups << " wakeups" << std::endl;
+    return 0;
+}
 
-// RAII: Node to represent a number.
-class NumberNode : public Node {
-public:
-    // `auto` used here for parameter type deduction (a more common use is with iterators).
-    explicit NumberNode(auto val) : value(val) {}
-    [[nodiscard]] double evaluate() const override { return value; }
-private:
-    double value;
-};
+int run_repl(bool debug_traces) {
+    std::cout << "C++ Expression Calculator REPL" << std::endl;
+    std::cout << "Enter an expression (e.g., 2 + 3 * (4 - 1)) or 'quit' to exit." << std::endl;
 
-// RAII: Node to represent a binary operation.
-class OperationNode : public Node {
-public:
-    // We use std::unique_ptr for RAII, ensuring child nodes are automatically deleted.
-    OperationNode(char op, std::unique_ptr<Node> left, std::unique_ptr<Node> right)
-        : op_char(op), left_child(std::move(left)), right_child(std::move(right)) {}
+    // Repeated lines skip lexing and parsing entirely.
+    ExpressionCache cache;
+    // Aggregates such as sum(i, 1, 1e6, 1 / i^2) run on every core.
+    ThreadPool pool;
 
-    [[nodiscard]] double evaluate() const override {
-        // `auto` used to automatically deduce the type of the evaluated children.
-        auto left_val = left_child->evaluate();
-        auto right_val = right_child->evaluate();
+    // RAII for input loop
+    for (std::string line; std::getline(std::cin, line); ) {
+        if (line == "quit") {
+            break;
+        }
+        if (line == ":stats") {
+            print_phase_stats(std::cout);
+            continue;
+        }
 
-        // Lambda function to perform the operation.
-        // We capture the operator character by value.
-        auto operation = [this, left_val, right_val]() -> double {
-            switch (op_char) {
-                case '+': return left_val + right_val;
-                case '-': return left_val - right_val;
-                case '*': return left_val * right_val;
-                case '/':
-                    if (right_val == 0.0) {
-                        throw std::runtime_error("Division by zero!");
-                    }
-                    return left_val / right_val;
-                default:
-                    throw std::runtime_error("Unknown operator");
+        if (has_aggregate(line)) {
+            try {
+                const double value = parse_aggregate(line).evaluate(std::span<const double>{}, pool);
+                std::cout << "Result: " << value << std::endl;
+            } catch (const std::exception& e) {
+                std::cerr << "Error: " << e.what() << std::endl;
             }
-        };
-
-        // We use decltype here to get the return type of the lambda.
-        decltype(operation()) result = operation();
-        return result;
-    }
-private:
-    char op_char;
-    std::unique_ptr<Node> left_child;
-    std::unique_ptr<Node> right_child;
-};
+            continue;
+        }
 
-// Function Object (Functor) to define operator precedence.
-struct OperatorPrecedence {
-    std::map<char, int> precedence_map;
-    // Constructor to initialize the map.
-    OperatorPrecedence() {
-        precedence_map['+'] = 1;
-        precedence_map['-'] = 1;
-        precedence_map['*'] = 2;
-        precedence_map['/'] = 2;
-    }
-    // Overload the function call operator `()`
-    // to check the precedence of an operator.
-    int operator()(char op) const {
-        auto it = precedence_map.find(op);
-        if (it != precedence_map.end()) {
-            return it->second;
+        // Errors come back as values: a mistyped line costs no unwinding.
+        auto result = cache.try_evaluate_exact(line);
+        if (!result) {
+            std::cerr << "Error: " << describe(result.error()) << std::endl;
+            if (debug_traces) {
+                print_stack_trace();
+            }
+        } else if (result->is_integer) {
+            std::cout << "Result: " << result->integer << std::endl; // exact, even above 2^53
+        } else {
+            std::cout << "Result: " << result->value << std::endl;
         }
-        return 0; // Low precedence for unknown operators.
     }
-};
-
-// Function to check if a character is an operator.
-bool is_operator(char c) {
-    return c == '+' || c == '-' || c == '*' || c == '/';
+    return 0;
 }
 
-// Parses an infix expression and builds an expression tree.
-std::unique_ptr<Node> parse_expression(const std::string& expression) {
-    std::stack<std::unique_ptr<Node>> values;
-    std::stack<char> ops;
-    OperatorPrecedence get_precedence;
-
-    for (int i = 0; i < expression.length(); ++i) {
-        char c = expression[i];
-        if (isspace(c)) {
-            continue;
-        } else if (isdigit(c)) {
-            std::string num_str;
-            while (i < expression.length() && (isdigit(expression[i]) || expression[i] == '.')) {
-                num_str += expression[i];
-                i++;
+} // namespace
+
+int main(int argc, char** argv) {
+    BatchFileOptions batch;
+    bool batch_mode = false;
+    CsvFileOptions csv;
+    bool csv_mode = false;
+    std::string socket_path;
+    bool debug_traces = false;
+    bool print_stats = false;
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string_view arg = argv[i];
+            if (arg == "--batch" && i + 1 < argc) {
+                batch_mode = true;
+                batch.input_path = argv[++i];
+            } else if (arg == "--csv" && i + 2 < argc) {
+                csv_mode = true;
+                csv.input_path = argv[++i];
+                csv.expression = argv[++i];
+            } else if (arg == "--serve" && i + 1 < argc) {
+                socket_path = argv[++i];
+            } else if (arg == "--debug-traces") {
+                debug_traces = true;
+            } else if (arg == "--stats") {
+                print_stats = true;
+            } else if (arg == "--threads" && i + 1 < argc) {
+                batch.threads = static_cast<unsigned>(std::stoul(argv[++i]));
+                csv.threads = batch.threads;
+            } else {
+                print_usage(argv[0]);
+                return 2;
             }
-            i--;
-            values.push(std::make_unique<NumberNode>(std::stod(num_str)));
-        } else if (c == '(') {
-            ops.push(c);
-        } else if (c == ')') {
-            while (!ops.empty() && ops.top() != '(') {
-                char op = ops.top();
-                ops.pop();
-                std::unique_ptr<Node> right = std::move(values.top());
-                values.pop();
-                std::unique_ptr<Node> left = std::move(values.top());
-                values.pop();
-                values.push(std::make_unique<OperationNode>(op, std::move(left), std::move(right)));
-            }
-            if (!ops.empty()) {
-                ops.pop();
-            }
-        } else if (is_operator(c)) {
-            while (!ops.empty() && ops.top() != '(' && get_precedence(ops.top()) >= get_precedence(c)) {
-                char op = ops.top();
-                ops.pop();
-                std::unique_ptr<Node> right = std::move(values.top());
-                values.pop();
-                std::unique_ptr<Node> left = std::move(values.top());
-                values.pop();
-                values.push(std::make_unique<OperationNode>(op, std::move(left), std::move(right)));
-            }
-            ops.push(c);
         }
+    } catch (const std::exception&) {
+        print_usage(argv[0]);
+        return 2;
     }
 
-    while (!ops.empty()) {
-        char op = ops.top();
-        ops.pop();
-        std::unique_ptr<Node> right = std::move(values.top());
-        values.pop();
-        std::unique_ptr<Node> left = std::move(values.top());
-        values.pop();
-        values.push(std::make_unique<OperationNode>(op, std::move(left), std::move(right)));
-    }
-
-    return std::move(values.top());
-}
-
-int main() {
-    std::cout << "C++ Expression Calculator REPL" << std::endl;
-    std::cout << "Enter an expression (e.g., 2 + 3 * (4 - 1)) or 'quit' to exit." << std::endl;
-
-    // RAII for input loop
-    for (std::string line; std::getline(std::cin, line); ) {
-        if (line == "quit") {
-            break;
+    // RAII: dumps the phase counters however main returns.
+    struct StatsAtExit {
+        bool enabled;
+        ~StatsAtExit() {
+            if (enabled) {
+                print_phase_stats(std::cerr);
+            }
         }
+    } stats_at_exit{print_stats};
 
+    if (batch_mode && csv_mode) {
+        print_usage(argv[0]);
+        return 2;
+    }
+    if (!socket_path.empty()) {
+        if (batch_mode || csv_mode) {
+            print_usage(argv[0]);
+            return 2;
+        }
         try {
-            // The `unique_ptr` here will automatically manage the memory for the entire tree.
-            std::unique_ptr<Node> root_node = parse_expression(line);
-
-            // `auto` simplifies the type of the result variable.
-            auto result = root_node->evaluate();
-            std::cout << "Result: " << result << std::endl;
+            return run_server(socket_path);
         } catch (const std::exception& e) {
             std::cerr << "Error: " << e.what() << std::endl;
-            print_stack_trace(); // Call the stack trace function on error.
+            return 1;
+        }
+    }
+    if (!batch_mode && !csv_mode) {
+        return run_repl(debug_traces);
+    }
+    try {
+        if (csv_mode) {
+            std::size_t failures = run_csv_file(csv, stdout);
+            if (failures != 0) {
+                std::cerr << failures << " row(s) could not be evaluated" << std::endl;
+            }
+            return 0;
+        }
+        std::size_t failures = run_batch_file(batch, stdout);
+        if (failures != 0) {
+            std::cerr << failures << " line(s) could not be evaluated" << std::endl;
         }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
     }
     return 0;
 }
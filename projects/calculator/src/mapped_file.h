@@ -0,0 +1,30 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// RAII: A read-only memory mapping of a whole file. The contents are paged in by the
+// kernel on demand instead of being copied through a read buffer.
+class MappedFile {
+public:
+    // Throws std::runtime_error if the file cannot be opened or mapped.
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    [[nodiscard]] std::string_view contents() const { return {data, size}; }
+    [[nodiscard]] std::size_t get_size() const { return size; }
+private:
+    void release();
+
+    const char* data = nullptr;
+    std::size_t size = 0;
+};
+
+#endif // MAPPED_FILE_H
@@ -0,0 +1,173 @@
+#include "optimizer.h"
+
+#include <cmath>
+#include <optional>
+#include <vector>
+
+namespace {
+
+// A subtree after folding: either a constant not yet written to the output arena, or
+// the index of an output node. Constants are materialized only when a parent cannot
+// absorb them, so folded subtrees leave no dead nodes behind.
+struct Folded {
+    bool is_constant;
+    double value;
+    std::uint32_t index;
+    bool is_integer = false;  // constant with an exact int64 value
+    std::int64_t integer = 0;
+};
+
+Folded integer_constant(std::int64_t value) {
+    return {true, static_cast<double>(value), 0, true, value};
+}
+
+bool is_positive_zero(const Folded& f) { return f.is_constant && f.value == 0.0 && !std::signbit(f.value); }
+bool is_negative_zero(const Folded& f) { return f.is_constant && f.value == 0.0 && std::signbit(f.value); }
+bool is_one(const Folded& f) { return f.is_constant && f.value == 1.0; }
+
+class Simplifier {
+public:
+    Simplifier(const Ast& in, OptimizerStats& stats) : in(in), stats(stats) {}
+
+    Ast run() {
+        for (const std::string& name : in.get_variables()) {
+            out.declare_variable(name);
+        }
+        out.reserve(in.size());
+        // Children are stored before their parents, so one backward pass finds the nodes
+        // the root reaches and one forward pass folds them, every child before its
+        // parents. No recursion: a chain of 100,000 terms needs no more stack than one.
+        // Shared (hash-consed) subtrees are folded once.
+        const std::uint32_t root = in.get_root();
+        std::vector<char> reachable(root + 1, 0);
+        reachable[root] = 1;
+        for (std::uint32_t index = root + 1; index-- > 0;) {
+            const AstNode& node = in[index];
+            if (reachable[index] && has_operands(node)) {
+                reachable[node.left] = 1;
+                reachable[node.right] = 1;
+            }
+        }
+        folded.resize(root + 1);
+        for (std::uint32_t index = 0; index <= root; ++index) {
+            if (reachable[index]) {
+                folded[index] = fold_node(index);
+            }
+        }
+        out.set_root(materialize(*folded[root]));
+        return std::move(out);
+    }
+private:
+    static bool has_operands(const AstNode& node) {
+        return node.kind != NodeKind::Number && node.kind != NodeKind::Integer && node.kind != NodeKind::Variable;
+    }
+
+    Folded fold_node(std::uint32_t index) {
+        const AstNode& node = in[index];
+        switch (node.kind) {
+            case NodeKind::Number:
+                return {true, node.value, 0};
+            case NodeKind::Integer:
+                return integer_constant(node.integer);
+            case NodeKind::Variable:
+                return {false, 0.0, record(out.add_variable(in.get_variables()[node.slot]), true)};
+            default:
+                break;
+        }
+        const Folded left = *folded[node.left];
+        const Folded right = *folded[node.right];
+
+        bool divides_by_zero = node.kind == NodeKind::Operation && node.op == '/' && right.value == 0.0;
+        if (left.is_constant && right.is_constant && !divides_by_zero) {
+            ++stats.constants_folded;
+            // Integer operands fold exactly when the int64 path would; anything it
+            // rejects (overflow, inexact division, -0) folds in double.
+            std::int64_t exact = 0;
+            if (left.is_integer && right.is_integer &&
+                (node.kind == NodeKind::Negate ? negate_integer(left.integer, exact)
+                 : node.kind == NodeKind::Operation && apply_integer_operator(node.op, left.integer, right.integer, exact))) {
+                return integer_constant(exact);
+            }
+            return {true, apply_node(node, left.value, right.value), 0};
+        }
+        if (node.kind == NodeKind::Negate) {
+            return {false, 0.0, record(out.add_negate(materialize(left)), true)};
+        }
+        if (node.kind == NodeKind::Call) {
+            std::uint32_t l = materialize(left);
+            std::uint32_t r = node.right == node.left ? l : materialize(right);
+            return {false, 0.0, record(out.add_call(node.slot, l, r), true)};
+        }
+        if (const Folded* kept = identity_operand(node.op, left, right)) {
+            ++stats.identities_removed;
+            return *kept;
+        }
+        std::uint32_t l = materialize(left);
+        std::uint32_t r = materialize(right);
+        // a + b is -0 only if both are -0; a - b only if a is -0 (and b is +0).
+        bool negative_zero = node.op == '+'   ? negative_zero_possible[l] && negative_zero_possible[r]
+                             : node.op == '-' ? negative_zero_possible[l]
+                                              : true;
+        return {false, 0.0, record(out.add_operation(node.op, l, r), negative_zero)};
+    }
+
+    // The operand `op` reduces to, if the operation is an exact identity.
+    const Folded* identity_operand(char op, const Folded& left, const Folded& right) const {
+        switch (op) {
+            case '*':
+                if (is_one(right)) return &left;
+                if (is_one(left)) return &right;
+                break;
+            case '/':
+                if (is_one(right)) return &left;
+                break;
+            case '-':
+                if (is_positive_zero(right)) return &left;
+                break;
+            case '+':
+                if (is_negative_zero(right) || (is_positive_zero(right) && !may_be_negative_zero(left))) return &left;
+                if (is_negative_zero(left) || (is_positive_zero(left) && !may_be_negative_zero(right))) return &right;
+                break;
+        }
+        return nullptr;
+    }
+
+    // Conservative: false only when the value can never be -0 for any binding.
+    bool may_be_negative_zero(const Folded& f) const {
+        return f.is_constant ? is_negative_zero(f) : negative_zero_possible[f.index];
+    }
+
+    std::uint32_t materialize(const Folded& f) {
+        if (!f.is_constant) {
+            return f.index;
+        }
+        return f.is_integer ? record(out.add_integer(f.integer), false)
+                            : record(out.add_number(f.value), is_negative_zero(f));
+    }
+
+    // Tracks -0 reachability for each output node as it is created (hash-consing may
+    // hand back an existing node instead).
+    std::uint32_t record(std::uint32_t index, bool negative_zero) {
+        if (index == negative_zero_possible.size()) {
+            negative_zero_possible.push_back(negative_zero);
+        }
+        return index;
+    }
+
+    const Ast& in;
+    OptimizerStats& stats;
+    Ast out;
+    std::vector<std::optional<Folded>> folded;
+    std::vector<char> negative_zero_possible;
+};
+
+} // namespace
+
+Ast simplify(const Ast& ast, OptimizerStats& stats) {
+    stats = OptimizerStats{};
+    stats.nodes_before = ast.size();
+    Ast result = ast.empty() ? ast : Simplifier(ast, stats).run();
+    stats.nodes_after = result.size();
+    stats.nodes_deduplicated = ast.get_deduplicated() + result.get_deduplicated();
+    return result;
+}
@@ -0,0 +1,33 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include "expression.h"
+
+#include <cstddef>
+
+// What an optimization pass did to a tree.
+struct OptimizerStats {
+    std::size_t nodes_before = 0;
+    std::size_t nodes_after = 0;
+    std::size_t constants_folded = 0;     // operations replaced by their constant result
+    std::size_t identities_removed = 0;   // x*1, x/1, x-0, x+0 ... rewritten to x
+    std::size_t nodes_deduplicated = 0;   // repeated subtrees shared by hash-consing
+
+    [[nodiscard]] std::size_t eliminated() const { return nodes_before - nodes_after; }
+};
+
+// Constant folding and algebraic simplification. Returns a new, compacted tree that
+// evaluates bit-for-bit identically to `ast` for every binding, except that integer
+// constant subtrees are computed exactly instead of rounding above 2^53:
+//  - constant subtrees are evaluated once, here, with the same IEEE operations the
+//    evaluators use, or with the int64 operations of the exact integer path when the
+//    whole subtree is integer (see compile_integer());
+//  - a division whose constant divisor is zero is left in place, so evaluation still
+//    raises "Division by zero!";
+//  - only exact identities are removed: x*1, 1*x, x/1, x-0, x+(-0), and x+0 / 0+x
+//    when x provably cannot be -0 (since -0 + 0 is +0).
+// Variable slots keep their numbering even if a variable disappears. `stats` is
+// overwritten.
+[[nodiscard]] Ast simplify(const Ast& ast, OptimizerStats& stats);
+
+#endif // OPTIMIZER_H
@@ -0,0 +1,163 @@
+#include "phase_stats.h"
+
+#include <algorithm>
+#include <bit>
+#include <iomanip>
+#include <mutex>
+#include <vector>
+
+constinit thread_local PhaseCounters phase_counters;
+
+namespace {
+
+// Counters of running threads, and the sums of threads that have exited.
+std::mutex registry_mutex;
+std::vector<PhaseCounters*> live_threads;
+PhaseCounters exited_threads;
+
+std::size_t bucket_of(std::uint64_t cycles) {
+    constexpr std::size_t sub = PhaseCounters::kSubBuckets;
+    if (cycles < sub) {
+        return static_cast<std::size_t>(cycles);
+    }
+    const auto exponent = static_cast<std::size_t>(std::bit_width(cycles) - 1);
+    return (exponent - 2) * sub + static_cast<std::size_t>((cycles >> (exponent - 3)) & (sub - 1));
+}
+
+// The middle of a bucket's range of cycles.
+double bucket_value(std::size_t bucket) {
+    constexpr std::size_t sub = PhaseCounters::kSubBuckets;
+    if (bucket < sub) {
+        return static_cast<double>(bucket);
+    }
+    const std::size_t exponent = bucket / sub + 2;
+    const double width = static_cast<double>(std::uint64_t{1} << (exponent - 3));
+    return (static_cast<double>(sub + bucket % sub) + 0.5) * width;
+}
+
+void add(std::atomic<std::uint64_t>& to, const std::atomic<std::uint64_t>& from) {
+    to.store(to.load(std::memory_order_relaxed) + from.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+void add(PhaseCounters& to, const PhaseCounters& from) {
+    for (std::size_t p = 0; p < kNumPhases; ++p) {
+        add(to.count[p], from.count[p]);
+        add(to.sampled[p], from.sampled[p]);
+        add(to.cycles[p], from.cycles[p]);
+        for (std::size_t b = 0; b < PhaseCounters::kBuckets; ++b) {
+            add(to.histogram[p][b], from.histogram[p][b]);
+        }
+    }
+}
+
+// RAII: Lists this thread's counters while it runs and folds them into
+// `exited_threads` when it exits.
+struct Registration {
+    Registration() {
+        std::lock_guard lock(registry_mutex);
+        live_threads.push_back(&phase_counters);
+        phase_counters.registered = true;
+    }
+    ~Registration() {
+        std::lock_guard lock(registry_mutex);
+        add(exited_threads, phase_counters);
+        live_threads.erase(std::find(live_threads.begin(), live_threads.end(), &phase_counters));
+    }
+};
+
+// Nanoseconds per read_cycles() tick, measured once against the steady clock.
+double nanoseconds_per_cycle() {
+#if defined(__x86_64__)
+    static const double ratio = [] {
+        const auto start_time = std::chrono::steady_clock::now();
+        const std::uint64_t start = read_cycles();
+        auto elapsed = std::chrono::steady_clock::duration::zero();
+        while (elapsed < std::chrono::milliseconds(20)) {
+            elapsed = std::chrono::steady_clock::now() - start_time;
+        }
+        const std::uint64_t cycles = read_cycles() - start;
+        return std::chrono::duration<double, std::nano>(elapsed).count() / static_cast<double>(cycles);
+    }();
+    return ratio;
+#else
+    return 1.0;
+#endif
+}
+
+} // namespace
+
+void record_phase_sample(Phase phase, std::uint64_t cycles) {
+    if (!phase_counters.registered) {
+        thread_local Registration registration;
+    }
+    const auto p = static_cast<std::size_t>(phase);
+    auto bump = [](std::atomic<std::uint64_t>& counter, std::uint64_t by) {
+        counter.store(counter.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+    };
+    bump(phase_counters.sampled[p], 1);
+    bump(phase_counters.cycles[p], cycles);
+    bump(phase_counters.histogram[p][bucket_of(cycles)], 1);
+}
+
+const char* to_string(Phase phase) {
+    switch (phase) {
+        case Phase::Parse: return "parse";
+        case Phase::Build: return "build";
+        case Phase::Evaluate: return "evaluate";
+    }
+    return "unknown";
+}
+
+std::array<PhaseSummary, kNumPhases> collect_phase_stats() {
+    PhaseCounters total;
+    {
+        std::lock_guard lock(registry_mutex);
+        add(total, exited_threads);
+        for (const PhaseCounters* counters : live_threads) {
+            add(total, *counters);
+        }
+    }
+
+    const double scale = nanoseconds_per_cycle();
+    std::array<PhaseSummary, kNumPhases> summaries;
+    for (std::size_t p = 0; p < kNumPhases; ++p) {
+        PhaseSummary& summary = summaries[p];
+        summary.count = total.count[p].load(std::memory_order_relaxed);
+        summary.sampled = total.sampled[p].load(std::memory_order_relaxed);
+        if (summary.sampled == 0) {
+            continue;
+        }
+        summary.mean_ns = static_cast<double>(total.cycles[p].load(std::memory_order_relaxed)) * scale /
+                          static_cast<double>(summary.sampled);
+        summary.total_ns = summary.mean_ns * static_cast<double>(summary.count);
+        // The smallest bucket with at least 99% of the samples at or below it.
+        const std::uint64_t rank = summary.sampled - summary.sampled / 100;
+        std::uint64_t seen = 0;
+        for (std::size_t b = 0; b < PhaseCounters::kBuckets; ++b) {
+            seen += total.histogram[p][b].load(std::memory_order_relaxed);
+            if (seen >= rank) {
+                summary.p99_ns = bucket_value(b) * scale;
+                break;
+            }
+        }
+    }
+    return summaries;
+}
+
+void print_phase_stats(std::ostream& out) {
+    const std::array<PhaseSummary, kNumPhases> summaries = collect_phase_stats();
+    const auto flags = out.flags();
+    const auto precision = out.precision();
+    out << std::left << std::setw(10) << "phase" << std::right << std::setw(12) << "count" << std::setw(10)
+        << "timed" << std::setw(12) << "total ms" << std::setw(12) << "mean ns" << std::setw(12) << "p99 ns" << "\n"
+        << std::fixed;
+    for (std::size_t p = 0; p < kNumPhases; ++p) {
+        const PhaseSummary& summary = summaries[p];
+        out << std::left << std::setw(10) << to_string(static_cast<Phase>(p)) << std::right << std::setw(12)
+            << summary.count << std::setw(10) << summary.sampled << std::setprecision(3) << std::setw(12)
+            << summary.total_ns / 1e6 << std::setprecision(0) << std::setw(12) << summary.mean_ns << std::setw(12)
+            << summary.p99_ns << "\n";
+    }
+    out.flags(flags);
+    out.precision(precision);
+}
@@ -0,0 +1,103 @@
+#ifndef PHASE_STATS_H
+#define PHASE_STATS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+// Where the time of an expression goes, split into the phases a caller can act on:
+//   Parse     lexing and parsing source text into a tree (parse_expression())
+//   Build     simplifying and compiling the tree into a CompiledExpression
+//   Evaluate  CompiledExpression::evaluate() and its variants
+enum class Phase : std::uint8_t {
+    Parse,
+    Build,
+    Evaluate,
+};
+inline constexpr std::size_t kNumPhases = 3;
+
+// Every occurrence is counted but only one in this many is timed, to keep the
+// counters under 2% of what they measure: two timestamp reads and a histogram update
+// cost about as much as evaluating a small expression, and a tenth of parsing one.
+inline constexpr std::uint64_t kParseSampling = 16;      // Parse and Build
+inline constexpr std::uint64_t kEvaluateSampling = 1024;
+
+// Per-thread counters, written only by their own thread with plain loads and stores
+// (no locked instructions) and read by collect_phase_stats() from any thread.
+// Durations are in cycles (see read_cycles()), kept in a log-linear histogram: eight
+// buckets per power of two, so percentiles are within 9%.
+struct PhaseCounters {
+    static constexpr std::size_t kSubBuckets = 8;
+    static constexpr std::size_t kBuckets = 62 * kSubBuckets;
+
+    std::atomic<std::uint64_t> count[kNumPhases] = {};
+    std::atomic<std::uint64_t> sampled[kNumPhases] = {};
+    std::atomic<std::uint64_t> cycles[kNumPhases] = {};
+    std::atomic<std::uint64_t> histogram[kNumPhases][kBuckets] = {};
+    bool registered = false;
+};
+
+extern constinit thread_local PhaseCounters phase_counters;
+
+// A timestamp: the CPU's time-stamp counter where there is one, nanoseconds otherwise.
+inline std::uint64_t read_cycles() {
+#if defined(__x86_64__)
+    return __rdtsc();
+#else
+    return static_cast<std::uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+}
+
+// Adds one timed occurrence of `phase` to this thread's histogram. Out of line: it is
+// the rare path for evaluations.
+void record_phase_sample(Phase phase, std::uint64_t cycles);
+
+// RAII: Counts the enclosing scope as one occurrence of `phase` and times one in
+// `sampling` of them.
+template <std::uint64_t sampling>
+class PhaseTimer {
+public:
+    explicit PhaseTimer(Phase phase) : phase(phase) {
+        std::atomic<std::uint64_t>& count = phase_counters.count[static_cast<std::size_t>(phase)];
+        std::uint64_t n = count.load(std::memory_order_relaxed);
+        count.store(n + 1, std::memory_order_relaxed);
+        // The first occurrence is always timed, which also registers the thread.
+        start = n % sampling == 0 ? read_cycles() : 0;
+    }
+    ~PhaseTimer() {
+        if (start != 0) {
+            record_phase_sample(phase, read_cycles() - start);
+        }
+    }
+
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+private:
+    Phase phase;
+    std::uint64_t start;
+};
+
+struct PhaseSummary {
+    std::uint64_t count = 0;     // occurrences
+    std::uint64_t sampled = 0;   // occurrences that were timed
+    double mean_ns = 0.0;        // over the timed ones
+    double p99_ns = 0.0;
+    double total_ns = 0.0;       // mean_ns * count: an estimate, as not every occurrence is timed
+};
+
+[[nodiscard]] const char* to_string(Phase phase);
+
+// Sums the counters of every thread, running or exited, since the process started.
+[[nodiscard]] std::array<PhaseSummary, kNumPhases> collect_phase_stats();
+
+// One line per phase: count, how many were timed, total, mean and p99.
+void print_phase_stats(std::ostream& out);
+
+#endif // PHASE_STATS_H
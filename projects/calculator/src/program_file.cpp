@@ -0,0 +1,309 @@
+#include "program_file.h"
+#include "optimizer.h"
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+constexpr char kMagic[8] = "CALCPRG";
+// Written as a native integer: reads back differently on a machine of the other
+// byte order.
+constexpr std::uint32_t kByteOrderMark = 0x01020304;
+
+struct Header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byte_order;
+    std::uint64_t count;
+    std::uint64_t strings;   // offset of the string section
+    std::uint64_t file_size;
+};
+
+// Instructions are stored exactly as they sit in memory, so program() can point the
+// VM at them; pin that layout down.
+static_assert(sizeof(Instruction) == 16 && offsetof(Instruction, op) == 0 && offsetof(Instruction, builtin) == 1 &&
+              offsetof(Instruction, dst) == 4 && offsetof(Instruction, lhs) == 8 && offsetof(Instruction, rhs) == 12);
+
+template <typename T>
+void put(std::string& out, std::size_t offset, const T& value) {
+    std::memcpy(out.data() + offset, &value, sizeof value);
+}
+
+void align(std::string& out) {
+    out.resize((out.size() + 7) & ~std::size_t{7}, '\0');
+}
+
+void append_code(std::string& out, std::span<const Instruction> code) {
+    for (const Instruction& ins : code) {
+        // Field by field: the struct's padding byte is indeterminate.
+        char record[sizeof(Instruction)] = {};
+        std::memcpy(record + offsetof(Instruction, op), &ins.op, sizeof ins.op);
+        std::memcpy(record + offsetof(Instruction, builtin), &ins.builtin, sizeof ins.builtin);
+        std::memcpy(record + offsetof(Instruction, dst), &ins.dst, sizeof ins.dst);
+        std::memcpy(record + offsetof(Instruction, lhs), &ins.lhs, sizeof ins.lhs);
+        std::memcpy(record + offsetof(Instruction, rhs), &ins.rhs, sizeof ins.rhs);
+        out.append(record, sizeof record);
+    }
+}
+
+} // namespace
+
+struct ProgramFile::StringRef {
+    std::uint64_t offset;   // from the start of the string section
+    std::uint64_t length;
+};
+
+struct ProgramFile::Entry {
+    std::uint64_t constants;  // file offsets of the parts
+    std::uint64_t code;
+    std::uint64_t variables;  // num_variables StringRefs
+    std::uint64_t integer_constants;   // the integer program's parts, if has_integer
+    std::uint64_t integer_code;
+    StringRef source;
+    std::uint32_t num_constants;
+    std::uint32_t num_instructions;
+    std::uint32_t num_variables;
+    std::uint32_t num_registers;
+    std::uint32_t result;
+    std::uint32_t has_integer;         // 1 if compile_integer() gave a program, else 0
+    std::uint32_t num_integer_constants;
+    std::uint32_t num_integer_instructions;
+    std::uint32_t integer_registers;
+    std::uint32_t integer_result;
+};
+
+void write_program_file(const std::string& path, std::span<const std::string> sources) {
+    std::string out(sizeof(Header) + sources.size() * sizeof(ProgramFile::Entry), '\0');
+    std::string strings;
+    auto add_string = [&strings](std::string_view text) {
+        ProgramFile::StringRef ref{strings.size(), text.size()};
+        strings += text;
+        return ref;
+    };
+
+    for (std::size_t i = 0; i < sources.size(); ++i) {
+        Ast tree;
+        Program program;
+        std::optional<IntegerProgram> integer;
+        try {
+            OptimizerStats stats;
+            tree = simplify(parse_tree(sources[i]), stats);
+            program = compile(tree);
+            integer = compile_integer(tree);
+        } catch (const std::exception& e) {
+            throw std::runtime_error("Expression " + std::to_string(i + 1) + ": " + e.what());
+        }
+
+        ProgramFile::Entry entry{};
+        entry.num_constants = static_cast<std::uint32_t>(program.constants.size());
+        entry.num_instructions = static_cast<std::uint32_t>(program.code.size());
+        entry.num_variables = program.num_variables;
+        entry.num_registers = program.num_registers;
+        entry.result = program.result;
+        entry.source = add_string(sources[i]);
+
+        align(out);
+        entry.constants = out.size();
+        out.append(reinterpret_cast<const char*>(program.constants.data()),
+                   program.constants.size() * sizeof(double));
+        entry.code = out.size();
+        append_code(out, program.code);
+        entry.variables = out.size();
+        for (const std::string& name : tree.get_variables()) {
+            ProgramFile::StringRef ref = add_string(name);
+            out.append(reinterpret_cast<const char*>(&ref), sizeof ref);
+        }
+        if (integer) {
+            // Same tree, so the same variable slots as the double program.
+            entry.has_integer = 1;
+            entry.num_integer_constants = static_cast<std::uint32_t>(integer->constants.size());
+            entry.num_integer_instructions = static_cast<std::uint32_t>(integer->code.size());
+            entry.integer_registers = integer->num_registers;
+            entry.integer_result = integer->result;
+            entry.integer_constants = out.size();
+            out.append(reinterpret_cast<const char*>(integer->constants.data()),
+                       integer->constants.size() * sizeof(std::int64_t));
+            entry.integer_code = out.size();
+            append_code(out, integer->code);
+        }
+        put(out, sizeof(Header) + i * sizeof(ProgramFile::Entry), entry);
+    }
+
+    align(out);
+    Header header{};
+    std::memcpy(header.magic, kMagic, sizeof kMagic);
+    header.version = kProgramFileVersion;
+    header.byte_order = kByteOrderMark;
+    header.count = sources.size();
+    header.strings = out.size();
+    header.file_size = out.size() + strings.size();
+    put(out, 0, header);
+
+    const std::string temporary = path + ".tmp";
+    std::FILE* file = std::fopen(temporary.c_str(), "wb");
+    if (file == nullptr) {
+        throw std::runtime_error("Cannot create '" + temporary + "': " + std::strerror(errno));
+    }
+    bool written = std::fwrite(out.data(), 1, out.size(), file) == out.size() &&
+                   std::fwrite(strings.data(), 1, strings.size(), file) == strings.size();
+    written = std::fclose(file) == 0 && written;
+    if (!written || std::rename(temporary.c_str(), path.c_str()) != 0) {
+        std::remove(temporary.c_str());
+        throw std::runtime_error("Cannot write '" + path + "'");
+    }
+}
+
+ProgramFile::ProgramFile(const std::string& path) : file(path) {
+    std::string_view contents = file.contents();
+    auto corrupt = [&path](const std::string& what) {
+        return std::runtime_error("Corrupt program file '" + path + "': " + what);
+    };
+    if (contents.size() < sizeof(Header) || std::memcmp(contents.data(), kMagic, sizeof kMagic) != 0) {
+        throw std::runtime_error("'" + path + "' is not a program file");
+    }
+    const auto& header = *reinterpret_cast<const Header*>(contents.data());
+    if (header.version != kProgramFileVersion) {
+        throw std::runtime_error("'" + path + "' is a version " + std::to_string(header.version) +
+                                 " program file; this build reads version " + std::to_string(kProgramFileVersion));
+    }
+    if (header.byte_order != kByteOrderMark) {
+        throw std::runtime_error("'" + path + "' was written on a machine of the other byte order");
+    }
+    if (header.file_size != contents.size()) {
+        throw corrupt("expected " + std::to_string(header.file_size) + " bytes, found " +
+                      std::to_string(contents.size()));
+    }
+    if (header.count > (contents.size() - sizeof(Header)) / sizeof(Entry) ||
+        header.strings < sizeof(Header) + header.count * sizeof(Entry) || header.strings > contents.size()) {
+        throw corrupt("bad section offsets");
+    }
+    count = header.count;
+
+    // Everything the VMs rely on, so that program() and integer_program() need no
+    // checks: parts inside the file and aligned, names and sources inside the string
+    // section, and code shaped the way compile() and compile_integer() emit it (one new
+    // temporary per instruction, operands read only registers already written, valid
+    // opcodes and built-ins, no Call in integer code).
+    const std::uint64_t programs_begin = sizeof(Header) + header.count * sizeof(Entry);
+    auto in_programs = [&](std::uint64_t offset, std::uint64_t items, std::uint64_t item_size) {
+        return offset % 8 == 0 && offset >= programs_begin && offset <= header.strings &&
+               items * item_size <= header.strings - offset;
+    };
+    const std::uint64_t strings_size = contents.size() - header.strings;
+    auto in_strings = [&](const StringRef& ref) {
+        return ref.offset <= strings_size && ref.length <= strings_size - ref.offset;
+    };
+    // Index of the first malformed instruction, or `size` if there is none.
+    auto check_code = [&](std::uint64_t offset, std::uint32_t size, std::uint64_t first_temporary, OpCode last) {
+        const auto* code = reinterpret_cast<const Instruction*>(contents.data() + offset);
+        for (std::uint32_t k = 0; k < size; ++k) {
+            const Instruction& ins = code[k];
+            if (ins.op > last || (ins.op == OpCode::Call && ins.builtin >= kNumBuiltins) ||
+                ins.dst != first_temporary + k || ins.lhs >= ins.dst || ins.rhs >= ins.dst) {
+                return k;
+            }
+        }
+        return size;
+    };
+    for (std::size_t i = 0; i < count; ++i) {
+        const Entry& e = entry(i);
+        // Built only on failure: validation must not allocate per program.
+        auto where = [i] { return "program " + std::to_string(i + 1) + ": "; };
+        if (!in_programs(e.constants, e.num_constants, sizeof(double)) ||
+            !in_programs(e.code, e.num_instructions, sizeof(Instruction)) ||
+            !in_programs(e.variables, e.num_variables, sizeof(StringRef)) || !in_strings(e.source)) {
+            throw corrupt(where() + "out of bounds");
+        }
+        const auto* names = reinterpret_cast<const StringRef*>(contents.data() + e.variables);
+        for (std::uint32_t v = 0; v < e.num_variables; ++v) {
+            if (!in_strings(names[v])) {
+                throw corrupt(where() + "variable name out of bounds");
+            }
+        }
+        const std::uint64_t first_temporary = std::uint64_t{e.num_constants} + e.num_variables;
+        if (e.num_registers != first_temporary + e.num_instructions || e.result >= e.num_registers) {
+            throw corrupt(where() + "bad register count");
+        }
+        if (std::uint32_t k = check_code(e.code, e.num_instructions, first_temporary, OpCode::Call);
+            k != e.num_instructions) {
+            throw corrupt(where() + "bad instruction " + std::to_string(k + 1));
+        }
+
+        if (e.has_integer > 1) {
+            throw corrupt(where() + "bad integer program flag");
+        }
+        if (e.has_integer == 0) {
+            continue;
+        }
+        if (!in_programs(e.integer_constants, e.num_integer_constants, sizeof(std::int64_t)) ||
+            !in_programs(e.integer_code, e.num_integer_instructions, sizeof(Instruction))) {
+            throw corrupt(where() + "integer program out of bounds");
+        }
+        const std::uint64_t first_integer_temporary = std::uint64_t{e.num_integer_constants} + e.num_variables;
+        if (e.integer_registers != first_integer_temporary + e.num_integer_instructions ||
+            e.integer_result >= e.integer_registers) {
+            throw corrupt(where() + "bad integer register count");
+        }
+        if (std::uint32_t k = check_code(e.integer_code, e.num_integer_instructions, first_integer_temporary,
+                                         OpCode::Neg);
+            k != e.num_integer_instructions) {
+            throw corrupt(where() + "bad integer instruction " + std::to_string(k + 1));
+        }
+    }
+}
+
+const ProgramFile::Entry& ProgramFile::entry(std::size_t index) const {
+    return reinterpret_cast<const Entry*>(file.contents().data() + sizeof(Header))[index];
+}
+
+std::string_view ProgramFile::string(const StringRef& ref) const {
+    const auto& header = *reinterpret_cast<const Header*>(file.contents().data());
+    return file.contents().substr(header.strings + ref.offset, ref.length);
+}
+
+ProgramView ProgramFile::program(std::size_t index) const {
+    const Entry& e = entry(index);
+    const char* data = file.contents().data();
+    return {{reinterpret_cast<const double*>(data + e.constants), e.num_constants},
+            e.num_variables,
+            {reinterpret_cast<const Instruction*>(data + e.code), e.num_instructions},
+            e.num_registers,
+            e.result};
+}
+
+std::optional<IntegerProgramView> ProgramFile::integer_program(std::size_t index) const {
+    const Entry& e = entry(index);
+    if (e.has_integer == 0) {
+        return std::nullopt;
+    }
+    const char* data = file.contents().data();
+    return IntegerProgramView{{reinterpret_cast<const std::int64_t*>(data + e.integer_constants),
+                               e.num_integer_constants},
+                              e.num_variables,
+                              {reinterpret_cast<const Instruction*>(data + e.integer_code), e.num_integer_instructions},
+                              e.integer_registers,
+                              e.integer_result};
+}
+
+std::string_view ProgramFile::source(std::size_t index) const {
+    return string(entry(index).source);
+}
+
+std::string_view ProgramFile::variable(std::size_t index, std::uint32_t slot) const {
+    const Entry& e = entry(index);
+    return string(reinterpret_cast<const StringRef*>(file.contents().data() + e.variables)[slot]);
+}
+
+std::optional<std::uint32_t> ProgramFile::slot(std::size_t index, std::string_view name) const {
+    for (std::uint32_t slot = 0; slot < entry(index).num_variables; ++slot) {
+        if (variable(index, slot) == name) {
+            return slot;
+        }
+    }
+    return std::nullopt;
+}
@@ -0,0 +1,70 @@
+#ifndef PROGRAM_FILE_H
+#define PROGRAM_FILE_H
+
+#include "bytecode.h"
+#include "mapped_file.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+// Bumped whenever the layout of a program file or the meaning of its contents
+// changes; files of any other version are rejected rather than misread.
+inline constexpr std::uint32_t kProgramFileVersion = 2;
+
+// Parses, simplifies and compiles every expression of `sources` and writes the
+// Programs to `path` in the program file format, in order, together with their source
+// text, variable names and, for expressions that are integer throughout, the
+// IntegerProgram that CompiledExpression would run first (see compile_integer()).
+// The file is written under a temporary name and renamed into place, so readers never
+// see a partial file. Throws std::runtime_error naming the first expression that does
+// not parse, or if the file cannot be written.
+void write_program_file(const std::string& path, std::span<const std::string> sources);
+
+// RAII: A program file mapped read-only. Opening it checks the header and every
+// program once (bounds, register numbers, opcodes), so a truncated or corrupt file is
+// reported up front instead of crashing the VM later. After that, program(i) hands
+// out views straight into the mapping: loading performs no parsing and no
+// per-expression allocation, and pages are read in by the kernel as they are used.
+//
+// Format, little-endian, every section aligned to 8 bytes:
+//   header    magic "CALCPRG", version, byte-order mark, program count, file size
+//   entries   one fixed-size record per program: offsets and counts of the parts below
+//   programs  per program: constants (doubles), code (Instruction records, as in
+//             memory), the offset and length of each variable name, then the
+//             integer program's constants (int64) and code, if it has one
+//   strings   the source texts and variable names, not NUL-terminated
+class ProgramFile {
+public:
+    // Throws std::runtime_error if the file cannot be mapped, has another version, or
+    // fails validation.
+    explicit ProgramFile(const std::string& path);
+
+    [[nodiscard]] std::size_t size() const { return count; }
+    // Runs on VirtualMachine::run() like a Program.
+    [[nodiscard]] ProgramView program(std::size_t index) const;
+    // The exact int64 form, nullopt unless the expression is integer throughout. To get
+    // what CompiledExpression::evaluate_exact() gives, run this on IntegerMachine first
+    // and fall back to program() when it returns nullopt.
+    [[nodiscard]] std::optional<IntegerProgramView> integer_program(std::size_t index) const;
+    [[nodiscard]] std::string_view source(std::size_t index) const;
+    [[nodiscard]] std::string_view variable(std::size_t index, std::uint32_t slot) const;
+    // Slot of the variable called `name` in program `index`, if it has one.
+    [[nodiscard]] std::optional<std::uint32_t> slot(std::size_t index, std::string_view name) const;
+    [[nodiscard]] std::size_t get_file_size() const { return file.get_size(); }
+private:
+    struct Entry;
+    struct StringRef;
+    friend void write_program_file(const std::string& path, std::span<const std::string> sources);
+
+    [[nodiscard]] const Entry& entry(std::size_t index) const;
+    [[nodiscard]] std::string_view string(const StringRef& ref) const;
+
+    MappedFile file;
+    std::size_t count = 0;
+};
+
+#endif // PROGRAM_FILE_H
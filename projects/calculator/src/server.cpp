@@ -0,0 +1,262 @@
+#include "server.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr std::size_t kReadBytes = 64u << 10;
+// Answers queued for a client beyond this stop us reading from it.
+constexpr std::size_t kMaxPendingOutput = 4u << 20;
+constexpr int kMaxEvents = 256;
+
+[[noreturn]] void throw_system_error(const std::string& what) {
+    throw std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+} // namespace
+
+Server::Server(ServerOptions options) : options(std::move(options)), cache(this->options.cache_bytes) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    const std::string& path = this->options.socket_path;
+    if (path.empty() || path.size() >= sizeof address.sun_path) {
+        throw std::runtime_error("Invalid socket path '" + path + "'");
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+    try {
+        listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listener < 0) {
+            throw_system_error("Cannot create socket");
+        }
+        ::unlink(path.c_str());
+        if (::bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof address) != 0) {
+            throw_system_error("Cannot bind '" + path + "'");
+        }
+        if (::listen(listener, SOMAXCONN) != 0) {
+            throw_system_error("Cannot listen on '" + path + "'");
+        }
+        epoll = ::epoll_create1(EPOLL_CLOEXEC);
+        wake = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (epoll < 0 || wake < 0) {
+            throw_system_error("Cannot create event loop");
+        }
+        // Events carry a Connection*, or the address of `listener` or `wake`.
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.ptr = &listener;
+        ::epoll_ctl(epoll, EPOLL_CTL_ADD, listener, &event);
+        event.data.ptr = &wake;
+        ::epoll_ctl(epoll, EPOLL_CTL_ADD, wake, &event);
+    } catch (...) {
+        for (int fd : {listener, epoll, wake}) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+        }
+        throw;
+    }
+}
+
+Server::~Server() {
+    for (auto& [fd, connection] : connections) {
+        ::close(fd);
+    }
+    ::close(listener);
+    ::close(epoll);
+    ::close(wake);
+    ::unlink(options.socket_path.c_str());
+}
+
+void Server::stop() {
+    // write() is async-signal-safe; nothing else here runs.
+    std::uint64_t one = 1;
+    [[maybe_unused]] auto written = ::write(wake, &one, sizeof one);
+}
+
+void Server::run() {
+    epoll_event events[kMaxEvents];
+    while (!stopping) {
+        int count = ::epoll_wait(epoll, events, kMaxEvents, -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw_system_error("epoll_wait failed");
+        }
+        ++stats.wakeups;
+
+        // Read from every ready connection first, then answer all their requests in
+        // one batch, then send.
+        ready.clear();
+        for (int i = 0; i < count; ++i) {
+            if (events[i].data.ptr == &listener) {
+                accept_connections();
+                continue;
+            }
+            if (events[i].data.ptr == &wake) {
+                stopping = true;
+                continue;
+            }
+            auto* connection = static_cast<Connection*>(events[i].data.ptr);
+            if ((events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) != 0) {
+                read_input(*connection);
+            }
+            ready.push_back(connection);
+        }
+        for (Connection* connection : ready) {
+            serve_requests(*connection);
+        }
+        for (Connection* connection : ready) {
+            flush(*connection);
+        }
+    }
+}
+
+void Server::accept_connections() {
+    for (;;) {
+        int fd = ::accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            // EAGAIN: accepted everything pending. Anything else (a client that gave
+            // up, out of descriptors) must not take the server down.
+            return;
+        }
+        Connection& connection = connections.try_emplace(fd, Connection{fd}).first->second;
+        ++stats.connections;
+        watch(connection, EPOLLIN | EPOLLRDHUP);
+    }
+}
+
+void Server::read_input(Connection& connection) {
+    // Level-triggered: whatever is left after this read is reported again.
+    const std::size_t size = connection.input.size();
+    connection.input.resize(size + kReadBytes);
+    ssize_t received = ::read(connection.fd, connection.input.data() + size, kReadBytes);
+    connection.input.resize(size + static_cast<std::size_t>(std::max<ssize_t>(received, 0)));
+    if (received == 0 || (received < 0 && errno != EAGAIN && errno != EINTR)) {
+        connection.peer_closed = true;
+    }
+}
+
+void Server::serve_requests(Connection& connection) {
+    std::string_view input = connection.input;
+    std::size_t consumed = 0;
+    while (consumed < input.size()) {
+        std::string_view rest = input.substr(consumed);
+        if (rest.front() == kFramedMarker) {
+            std::uint32_t length = 0;
+            if (rest.size() < 1 + sizeof length) {
+                break;
+            }
+            std::memcpy(&length, rest.data() + 1, sizeof length);
+            if (length > kMaxRequestBytes) {
+                connection.failed = true;
+                break;
+            }
+            if (rest.size() < 1 + sizeof length + length) {
+                break;
+            }
+            answer(connection, rest.substr(1 + sizeof length, length), true);
+            consumed += 1 + sizeof length + length;
+        } else {
+            std::size_t newline = rest.find('\n');
+            if (newline == std::string_view::npos) {
+                connection.failed = rest.size() > kMaxRequestBytes;
+                break;
+            }
+            std::string_view line = rest.substr(0, newline);
+            if (!line.empty() && line.back() == '\r') {
+                line.remove_suffix(1);
+            }
+            answer(connection, line, false);
+            consumed += newline + 1;
+        }
+    }
+    connection.input.erase(0, consumed);
+}
+
+void Server::answer(Connection& connection, std::string_view request, bool framed) {
+    ++stats.requests;
+    response.clear();
+    if (Result<ExactValue> result = cache.try_evaluate_exact(request)) {
+        append_result(response, *result);
+    } else {
+        ++stats.errors;
+        response = "Error: ";
+        response += describe(result.error());
+    }
+    if (framed) {
+        auto length = static_cast<std::uint32_t>(response.size());
+        connection.output += kFramedMarker;
+        connection.output.append(reinterpret_cast<const char*>(&length), sizeof length);
+        connection.output += response;
+    } else {
+        connection.output += response;
+        connection.output += '\n';
+    }
+}
+
+void Server::flush(Connection& connection) {
+    while (connection.written < connection.output.size()) {
+        ssize_t sent = ::send(connection.fd, connection.output.data() + connection.written,
+                              connection.output.size() - connection.written, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN) {
+                connection.failed = true;
+            }
+            break;
+        }
+        connection.written += static_cast<std::size_t>(sent);
+    }
+    const std::size_t pending = connection.output.size() - connection.written;
+    if (pending == 0) {
+        connection.output.clear();
+        connection.written = 0;
+    }
+    if (connection.failed || (connection.peer_closed && pending == 0)) {
+        close_connection(connection);
+        return;
+    }
+    // Keep reading unless the client is far behind on its answers; watch for room to
+    // write only while answers are waiting. Never empty: a closed peer with nothing
+    // pending was closed above.
+    std::uint32_t events = pending > kMaxPendingOutput ? 0u : std::uint32_t{EPOLLIN | EPOLLRDHUP};
+    if (pending != 0) {
+        events |= EPOLLOUT;
+    }
+    if (connection.peer_closed) {
+        events &= ~std::uint32_t{EPOLLIN | EPOLLRDHUP};
+    }
+    watch(connection, events);
+}
+
+void Server::watch(Connection& connection, std::uint32_t events) {
+    if (events == connection.events) {
+        return;
+    }
+    epoll_event event{};
+    event.events = events;
+    event.data.ptr = &connection;
+    ::epoll_ctl(epoll, connection.events == 0 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, connection.fd, &event);
+    connection.events = events;
+}
+
+void Server::close_connection(Connection& connection) {
+    // Closing the descriptor also removes it from the epoll set.
+    int fd = connection.fd;
+    ::close(fd);
+    connections.erase(fd);
+}
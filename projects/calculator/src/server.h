@@ -0,0 +1,97 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "expression_cache.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+struct ServerOptions {
+    std::string socket_path;
+    std::size_t cache_bytes = 64u << 20;   // see ExpressionCache
+};
+
+struct ServerStats {
+    std::uint64_t connections = 0;   // accepted so far
+    std::uint64_t requests = 0;
+    std::uint64_t errors = 0;        // requests answered with "Error: ..."
+    std::uint64_t wakeups = 0;       // epoll_wait returns that had work
+};
+
+// Length-prefixed requests and responses start with this byte (see Server).
+inline constexpr char kFramedMarker = '\0';
+// Longest request accepted; a connection sending a longer one is closed.
+inline constexpr std::size_t kMaxRequestBytes = 1u << 20;
+
+// RAII: A calculator server on a UNIX domain socket, listening from construction and
+// removing the socket on destruction.
+//
+// Requests come in either of two framings, freely mixed on one connection:
+//   newline-delimited  the expression, then '\n'; answered with one line
+//   length-prefixed    kFramedMarker, the expression's length as a little-endian
+//                      uint32, then the expression; answered in the same framing
+// An answer is the result in shortest round-trip form or "Error: <message>", the
+// message naming the error and its offset in the request (see describe()). Clients
+// may pipeline: send many requests without waiting, and the answers come back in
+// request order.
+//
+// One thread serves every connection through epoll. Each wakeup reads everything the
+// ready connections have sent, evaluates all complete requests as one batch, and
+// writes each connection's answers with one send. Parsed expressions stay resident
+// in an ExpressionCache, so a repeated expression costs a hash lookup and an
+// evaluation. A client that stops reading its answers is not read from until it
+// catches up.
+class Server {
+public:
+    // Throws std::runtime_error if the socket cannot be created. An existing socket
+    // file at the path is replaced.
+    explicit Server(ServerOptions options);
+    ~Server();
+
+    Server(const Server&) = delete;
+    Server& operator=(const Server&) = delete;
+
+    // Serves until stop() is called.
+    void run();
+    // Makes run() return after its current wakeup. Safe from any thread and from a
+    // signal handler.
+    void stop();
+
+    [[nodiscard]] const ServerStats& get_stats() const { return stats; }
+    [[nodiscard]] const CacheStats& get_cache_stats() const { return cache.get_stats(); }
+private:
+    struct Connection {
+        int fd = -1;
+        std::string input = {};
+        std::string output = {};
+        std::size_t written = 0;     // bytes of `output` already sent
+        std::uint32_t events = 0;    // what epoll currently watches for; 0 before it is added
+        bool peer_closed = false;
+        bool failed = false;
+    };
+
+    void accept_connections();
+    void read_input(Connection& connection);
+    void serve_requests(Connection& connection);
+    void answer(Connection& connection, std::string_view request, bool framed);
+    void flush(Connection& connection);
+    void watch(Connection& connection, std::uint32_t events);
+    void close_connection(Connection& connection);
+
+    ServerOptions options;
+    int listener = -1;
+    int epoll = -1;
+    int wake = -1;   // eventfd written by stop()
+    bool stopping = false;
+    ExpressionCache cache;
+    ServerStats stats;
+    std::unordered_map<int, Connection> connections;
+    std::vector<Connection*> ready;
+    std::string response;
+};
+
+#endif // SERVER_H
@@ -0,0 +1,266 @@
+#include "sheet.h"
+#include "optimizer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+
+namespace {
+
+// Frontiers smaller than this are evaluated on the calling thread: waking the pool
+// costs more than a few thousand small formulas. Also the pool's grain.
+constexpr std::size_t kParallelFrontier = 4096;
+
+// Per-thread scratch for evaluating one cell.
+thread_local VirtualMachine vm;
+thread_local std::vector<double> bindings;
+
+template <typename T>
+void append_bytes(std::string& out, const T& value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof value);
+}
+
+} // namespace
+
+Sheet::Sheet(unsigned threads) : pool(threads) {}
+
+CellId Sheet::cell(std::string_view name) {
+    if (auto it = ids.find(name); it != ids.end()) {
+        return it->second;
+    }
+    if (cells.size() >= std::numeric_limits<CellId>::max()) {
+        throw std::runtime_error("Too many cells");
+    }
+    const auto id = static_cast<CellId>(cells.size());
+    names.emplace_back(name);
+    ids.emplace(names.back(), id);
+    cells.emplace_back();
+    values.push_back(0.0);
+    stamps.push_back(0);
+    pending.push_back(0);
+    return id;
+}
+
+std::optional<CellId> Sheet::find(std::string_view name) const {
+    if (auto it = ids.find(name); it != ids.end()) {
+        return it->second;
+    }
+    return std::nullopt;
+}
+
+void Sheet::set_value(CellId id, double value) {
+    unlink(id);
+    cells[id].program.reset();
+    cells[id].references.clear();
+    cells[id].error.reset();
+    values[id] = value;
+    mark_dirty(id);
+}
+
+void Sheet::set_formula(CellId id, std::string_view formula) {
+    OptimizerStats stats;
+    const Ast tree = simplify(parse_tree(formula), stats);
+    // Cells the formula names but the sheet lacks are created only once it is accepted,
+    // so a rejected formula leaves no trace. A new cell has no dependents yet, so only
+    // the existing ones can close a cycle.
+    std::vector<CellId> references;
+    references.reserve(tree.get_variables().size());
+    std::size_t missing = 0;
+    for (const std::string& variable : tree.get_variables()) {
+        if (std::optional<CellId> existing = find(variable)) {
+            references.push_back(*existing);
+        } else {
+            ++missing;
+        }
+    }
+    if (reaches(id, references)) {
+        throw std::runtime_error("Circular reference: '" + names[id] + "' would depend on itself");
+    }
+    if (missing > std::numeric_limits<CellId>::max() - cells.size()) {
+        throw std::runtime_error("Too many cells");
+    }
+
+    std::shared_ptr<const Program> program = intern(compile(tree));
+    references.clear();
+    for (const std::string& variable : tree.get_variables()) {
+        references.push_back(cell(variable));
+    }
+    unlink(id);
+    for (CellId reference : references) {
+        cells[reference].dependents.push_back(id);
+    }
+    cells[id].program = std::move(program);
+    cells[id].references = std::move(references);
+    mark_dirty(id);
+}
+
+std::shared_ptr<const Program> Sheet::intern(Program program) {
+    // The key spells out every field (not the raw structs, whose padding is garbage).
+    std::string key;
+    append_bytes(key, program.num_variables);
+    append_bytes(key, program.num_registers);
+    append_bytes(key, program.result);
+    for (double constant : program.constants) {
+        append_bytes(key, constant);
+    }
+    for (const Instruction& ins : program.code) {
+        append_bytes(key, ins.op);
+        append_bytes(key, ins.builtin);
+        append_bytes(key, ins.dst);
+        append_bytes(key, ins.lhs);
+        append_bytes(key, ins.rhs);
+    }
+    auto [it, inserted] = programs.try_emplace(std::move(key));
+    if (inserted) {
+        it->second = std::make_shared<const Program>(std::move(program));
+    }
+    return it->second;
+}
+
+// Removes `id` from the dependents of every cell it currently references.
+void Sheet::unlink(CellId id) {
+    for (CellId reference : cells[id].references) {
+        std::vector<CellId>& dependents = cells[reference].dependents;
+        auto it = std::find(dependents.begin(), dependents.end(), id);
+        *it = dependents.back();
+        dependents.pop_back();
+    }
+}
+
+void Sheet::mark_dirty(CellId id) {
+    dirty.push_back(id);
+}
+
+// True if any of `targets` is `from` or depends on it: making `from` read them would
+// close a cycle.
+bool Sheet::reaches(CellId from, const std::vector<CellId>& targets) {
+    const std::uint64_t target = ++epoch;
+    for (CellId id : targets) {
+        stamps[id] = target;
+    }
+    if (stamps[from] == target) {
+        return true;
+    }
+    ++epoch;
+    std::vector<CellId> stack = {from};
+    stamps[from] = epoch;
+    while (!stack.empty()) {
+        CellId id = stack.back();
+        stack.pop_back();
+        for (CellId dependent : cells[id].dependents) {
+            if (stamps[dependent] == target) {
+                return true;
+            }
+            if (stamps[dependent] != epoch) {
+                stamps[dependent] = epoch;
+                stack.push_back(dependent);
+            }
+        }
+    }
+    return false;
+}
+
+std::size_t Sheet::recalculate() {
+    // Everything downstream of a dirty cell, in discovery order.
+    ++epoch;
+    std::vector<CellId> affected;
+    for (CellId id : dirty) {
+        if (stamps[id] != epoch) {
+            stamps[id] = epoch;
+            affected.push_back(id);
+        }
+    }
+    dirty.clear();
+    for (std::size_t i = 0; i < affected.size(); ++i) {
+        for (CellId dependent : cells[affected[i]].dependents) {
+            if (stamps[dependent] != epoch) {
+                stamps[dependent] = epoch;
+                affected.push_back(dependent);
+            }
+        }
+    }
+
+    // Kahn's algorithm, one frontier at a time: a cell is ready once every input it
+    // has inside the affected set has been evaluated.
+    std::vector<CellId> frontier;
+    for (CellId id : affected) {
+        std::uint32_t inputs = 0;
+        for (CellId reference : cells[id].references) {
+            inputs += stamps[reference] == epoch;
+        }
+        pending[id] = inputs;
+        if (inputs == 0) {
+            frontier.push_back(id);
+        }
+    }
+
+    std::size_t evaluated = 0;
+    std::vector<CellId> next;
+    std::mutex next_mutex;
+    while (!frontier.empty()) {
+        evaluated += frontier.size();
+        next.clear();
+        if (frontier.size() < kParallelFrontier || pool.size() == 1) {
+            for (CellId id : frontier) {
+                evaluate(id);
+                for (CellId dependent : cells[id].dependents) {
+                    if (stamps[dependent] == epoch && --pending[dependent] == 0) {
+                        next.push_back(dependent);
+                    }
+                }
+            }
+        } else {
+            pool.parallel_for(frontier.size(), kParallelFrontier, [&](std::size_t begin, std::size_t end) {
+                std::vector<CellId> ready;
+                for (std::size_t i = begin; i < end; ++i) {
+                    evaluate(frontier[i]);
+                    for (CellId dependent : cells[frontier[i]].dependents) {
+                        if (stamps[dependent] == epoch &&
+                            std::atomic_ref<std::uint32_t>(pending[dependent]).fetch_sub(1) == 1) {
+                            ready.push_back(dependent);
+                        }
+                    }
+                }
+                std::lock_guard lock(next_mutex);
+                next.insert(next.end(), ready.begin(), ready.end());
+            });
+        }
+        frontier.swap(next);
+    }
+    return evaluated;
+}
+
+std::size_t Sheet::recalculate_all() {
+    dirty.resize(cells.size());
+    for (CellId id = 0; id < cells.size(); ++id) {
+        dirty[id] = id;
+    }
+    return recalculate();
+}
+
+// Runs on pool threads: writes only this cell's value and error, and reads only
+// cells of earlier frontiers.
+void Sheet::evaluate(CellId id) {
+    Cell& cell = cells[id];
+    if (!cell.program) {
+        return;
+    }
+    bindings.clear();
+    for (CellId reference : cell.references) {
+        if (cells[reference].error) {
+            cell.error = cells[reference].error;
+            values[id] = std::numeric_limits<double>::quiet_NaN();
+            return;
+        }
+        bindings.push_back(values[reference]);
+    }
+    try {
+        values[id] = vm.run(*cell.program, bindings);
+        cell.error.reset();
+    } catch (const std::exception& e) {
+        cell.error = std::make_shared<const std::string>(e.what());
+        values[id] = std::numeric_limits<double>::quiet_NaN();
+    }
+}
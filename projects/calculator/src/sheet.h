@@ -0,0 +1,95 @@
+#ifndef SHEET_H
+#define SHEET_H
+
+#include "bytecode.h"
+#include "thread_pool.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+using CellId = std::uint32_t;
+
+// A spreadsheet: named cells holding either a number or a formula over other cells,
+// such as "price * (1 + tax)". A formula's variables are the names of the cells it
+// reads; a cell that was never set reads as 0.
+//
+// Values persist between recalculations. Setting a cell marks it dirty, and
+// recalculate() re-evaluates only the dirty cells and the cells that depend on them,
+// directly or not: each once, after every cell it reads (topological order). Cells
+// whose inputs are all up to date form a frontier; a wide frontier is evaluated in
+// parallel on the sheet's thread pool.
+//
+// A cell whose formula fails (division by zero, say) holds that error instead of a
+// value, and so does every cell that reads it. Formulas that would make a cell depend
+// on itself are rejected when they are set.
+//
+// Formulas are compiled to bytecode and interned by shape: formulas that differ only
+// in which cells they reference ("A1 + B1 * 2", "A2 + B2 * 2") share one Program, so
+// a sheet of a million cells built from a few patterns holds a few Programs.
+//
+// Not thread-safe; one thread drives the sheet and recalculate() fans out itself.
+class Sheet {
+public:
+    // `threads` sizes the pool used by recalculate(); 0 means one per hardware thread.
+    explicit Sheet(unsigned threads = 0);
+
+    // Id of the cell called `name`, creating an empty one if there is none yet.
+    CellId cell(std::string_view name);
+    [[nodiscard]] std::optional<CellId> find(std::string_view name) const;
+    [[nodiscard]] const std::string& name(CellId id) const { return names[id]; }
+    [[nodiscard]] std::size_t size() const { return cells.size(); }
+
+    // Makes `id` an input holding `value`.
+    void set_value(CellId id, double value);
+    // Gives `id` a formula. Cells it references are created if needed. Throws
+    // std::runtime_error, leaving the sheet unchanged (no cells created), if the
+    // formula does not parse or would create a circular reference.
+    void set_formula(CellId id, std::string_view formula);
+
+    // Brings every dirty cell and its dependents up to date. Returns the number of
+    // cells evaluated.
+    std::size_t recalculate();
+    // Re-evaluates every cell, dirty or not.
+    std::size_t recalculate_all();
+
+    // As of the last recalculation: NaN and a message for a cell in error.
+    [[nodiscard]] double value(CellId id) const { return values[id]; }
+    [[nodiscard]] const std::string* error(CellId id) const { return cells[id].error.get(); }
+private:
+    struct Cell {
+        std::shared_ptr<const Program> program; // null for inputs
+        std::vector<CellId> references;         // program variable slot i reads references[i]
+        std::vector<CellId> dependents;         // cells whose formula references this one
+        std::shared_ptr<const std::string> error;
+    };
+
+    std::shared_ptr<const Program> intern(Program program);
+    void unlink(CellId id);
+    void mark_dirty(CellId id);
+    [[nodiscard]] bool reaches(CellId from, const std::vector<CellId>& targets);
+    void evaluate(CellId id);
+
+    std::vector<Cell> cells;
+    std::vector<double> values;
+    std::deque<std::string> names; // a deque, so the strings never move
+    std::unordered_map<std::string_view, CellId> ids; // keys view `names`
+    std::unordered_map<std::string, std::shared_ptr<const Program>> programs;
+    std::vector<CellId> dirty;
+
+    // Per-recalculation scratch, indexed by cell. A cell belongs to the current pass
+    // when its stamp equals `epoch`, so nothing is cleared between passes.
+    std::vector<std::uint64_t> stamps;
+    std::vector<std::uint32_t> pending; // inputs of the cell not yet evaluated this pass
+    std::uint64_t epoch = 0;
+
+    ThreadPool pool;
+};
+
+#endif // SHEET_H
@@ -0,0 +1,542 @@
+#ifndef STATIC_EXPRESSION_H
+#define STATIC_EXPRESSION_H
+
+#include "expression.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+// Formulas fixed at build time, parsed and folded by the compiler instead of by
+// parse_expression() at run time:
+//
+//   constexpr double rate = calc::eval<"2 + 3 * (4 - 1)">();     // 11, a constant
+//   calc::Formula<"price * qty * (1 + tax)"> total;
+//   double t = total.evaluate(bindings);                         // straight-line code
+//
+// Same grammar, precedence, built-ins and error codes as parse_tree(), and the same
+// results as parse_expression(...).evaluate(), bit for bit: constant subtrees fold
+// as simplify() folds them (exact int64 where the integer path would be), whole-number
+// expressions run on the exact integer path, and everything else on double. A formula
+// that does not parse, or divides a constant by zero, fails to compile.
+//
+// The compiler itself folds only what is rounded exactly: + - * /, negation and
+// integer powers. Calls and other powers of constants are left to run time, where they
+// go through the same C library functions as the runtime evaluators. eval<>() has to
+// fold them too, which needs a compiler that evaluates <cmath> in constant expressions
+// (GCC does); it rounds exp, log, sin, cos and pow correctly, which the C library does
+// not promise, so for those an eval<>() result may differ in the last bit.
+namespace calc {
+
+// A string literal as a template argument: calc::eval<"1 + 2">().
+template <std::size_t N>
+struct FixedString {
+    char chars[N] = {};
+
+    constexpr FixedString(const char (&text)[N]) { std::copy_n(text, N, chars); }
+    [[nodiscard]] constexpr std::string_view view() const { return {chars, N - 1}; }
+};
+
+namespace detail {
+
+// One node of a parsed formula. Constant subtrees are already folded into Number and
+// Integer nodes; their former children stay behind, unreachable.
+struct StaticNode {
+    NodeKind kind = NodeKind::Number;
+    char op = 0;                 // Operation
+    bool is_constant = false;    // a constant whose operation is left to run time
+    double value = 0.0;          // Number; Integer: `integer` as a double
+    std::int64_t integer = 0;    // Integer
+    std::uint32_t left = 0;      // Operation, Negate, Call
+    std::uint32_t right = 0;     // Operation, Call (a copy of left for unary calls)
+    std::uint32_t slot = 0;      // Variable: index into the bindings; Call: built-in id
+};
+
+// Every node and variable comes from at least one token, and every token from at
+// least one character, so `capacity` source characters bound all three.
+template <std::size_t capacity>
+struct StaticTree {
+    std::array<StaticNode, capacity> nodes{};
+    std::array<std::string_view, capacity> variables{};
+    std::uint32_t num_nodes = 0;
+    std::uint32_t num_variables = 0;
+    std::uint32_t root = 0;
+    Error error;
+};
+
+// Called where a compile-time parse cannot go on: not constexpr, so it stops
+// compilation with its name in the diagnostic.
+inline void decimal_literal_needs_a_runtime_parse() {
+    throw std::runtime_error("decimal literal needs a runtime parse");
+}
+
+inline constexpr double kPowersOfTen[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                          1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+// The decimal number at the start of `text`, as std::from_chars reads it (digits, an
+// optional fraction and an optional exponent), into `value`; returns its length.
+// `exact` is false unless the significant digits fit in 53 bits and scale by a power of
+// ten that is itself exact (Clinger's fast path): then it takes one IEEE operation, so
+// it is correctly rounded, as from_chars is.
+constexpr std::size_t read_decimal(std::string_view text, double& value, bool& exact) {
+    auto is_digit = [](char c) { return c >= '0' && c <= '9'; };
+    std::size_t i = 0;
+    std::uint64_t mantissa = 0;
+    int exponent = 0;
+    int significant = 0;
+    bool dropped = false;  // a nonzero digit beyond the 19 kept
+    auto take = [&](char c, bool fraction) {
+        if (significant < 19) {
+            mantissa = mantissa * 10 + static_cast<std::uint64_t>(c - '0');
+            significant += mantissa != 0;
+            exponent -= fraction;
+        } else {
+            dropped |= c != '0';
+            exponent += !fraction;
+        }
+    };
+    for (; i < text.size() && is_digit(text[i]); ++i) {
+        take(text[i], false);
+    }
+    if (i < text.size() && text[i] == '.') {
+        for (++i; i < text.size() && is_digit(text[i]); ++i) {
+            take(text[i], true);
+        }
+    }
+    if (i + 1 < text.size() && (text[i] == 'e' || text[i] == 'E')) {
+        std::size_t j = i + 1;
+        bool negative = text[j] == '-';
+        j += text[j] == '-' || text[j] == '+';
+        if (j < text.size() && is_digit(text[j])) {
+            int written = 0;
+            for (; j < text.size() && is_digit(text[j]); ++j) {
+                written = std::min(written * 10 + (text[j] - '0'), 100000);
+            }
+            exponent += negative ? -written : written;
+            i = j;
+        }
+    }
+
+    while (mantissa != 0 && mantissa % 10 == 0) {
+        mantissa /= 10;
+        ++exponent;
+    }
+    constexpr std::uint64_t kExactMantissa = std::uint64_t{1} << 53;
+    value = 0.0;
+    exact = !dropped;
+    if (mantissa == 0) {
+        return i;
+    }
+    // Digits moved into the mantissa while it stays exact, for exponents past 1e22.
+    while (exponent > 22 && mantissa * 10 <= kExactMantissa) {
+        mantissa *= 10;
+        --exponent;
+    }
+    if (mantissa > kExactMantissa || exponent < -22 || exponent > 22) {
+        exact = false;
+        return i;
+    }
+    const auto scaled = static_cast<double>(mantissa);
+    value = exponent < 0 ? scaled / kPowersOfTen[-exponent] : scaled * kPowersOfTen[exponent];
+    return i;
+}
+
+// tokenize(), in constant expressions. Returns the number of tokens.
+template <std::size_t capacity>
+constexpr std::size_t tokenize(std::string_view source, std::array<Token, capacity>& tokens) {
+    auto is_digit = [](char c) { return c >= '0' && c <= '9'; };
+    auto is_identifier_char = [&](char c) {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || is_digit(c);
+    };
+    std::size_t count = 0;
+    for (std::size_t p = 0; p < source.size();) {
+        const char c = source[p];
+        const auto offset = static_cast<std::uint32_t>(p);
+        if (c == ' ' || (c >= '\t' && c <= '\r')) {
+            ++p;
+        } else if (is_digit(c) || (c == '.' && p + 1 < source.size() && is_digit(source[p + 1]))) {
+            double value = 0.0;
+            bool exact = false;
+            const std::size_t length = read_decimal(source.substr(p), value, exact);
+            Token token{value, offset, static_cast<std::uint32_t>(length), TokenKind::Number, 0};
+            const std::string_view digits = source.substr(p, length);
+            if (std::all_of(digits.begin(), digits.end(), is_digit)) {
+                std::uint64_t integer = 0;
+                token.is_integer = true;
+                for (char d : digits) {
+                    token.is_integer &= integer <= (std::uint64_t{INT64_MAX} - (d - '0')) / 10;
+                    integer = integer * 10 + static_cast<std::uint64_t>(d - '0');
+                }
+                token.integer = token.is_integer ? static_cast<std::int64_t>(integer) : 0;
+            }
+            if (token.is_integer) {
+                token.value = static_cast<double>(token.integer);
+            } else if (!exact) {
+                decimal_literal_needs_a_runtime_parse();
+            }
+            tokens[count++] = token;
+            p += length;
+        } else if (is_identifier_char(c) && !is_digit(c)) {
+            std::size_t end = p;
+            while (end < source.size() && is_identifier_char(source[end])) {
+                ++end;
+            }
+            tokens[count++] = {0.0, offset, static_cast<std::uint32_t>(end - p), TokenKind::Identifier, 0};
+            p = end;
+        } else {
+            TokenKind kind = TokenKind::Invalid;
+            switch (c) {
+                case '+': case '-': case '*': case '/': case '^': kind = TokenKind::Operator; break;
+                case '(': kind = TokenKind::LeftParen; break;
+                case ')': kind = TokenKind::RightParen; break;
+                case ',': kind = TokenKind::Comma; break;
+                default: break;
+            }
+            tokens[count++] = {0.0, offset, 1, kind, c};
+            ++p;
+        }
+    }
+    return count;
+}
+
+// The runtime PrattParser (see expression.cpp), step for step, building a StaticTree
+// and folding constants as simplify() does while it goes.
+template <std::size_t capacity>
+class StaticParser {
+public:
+    constexpr explicit StaticParser(std::string_view source) : source(source) {
+        num_tokens = detail::tokenize(source, tokens);
+    }
+
+    constexpr StaticTree<capacity> parse() {
+        std::uint32_t root = 0;
+        if (parse_expression(0, 0, root)) {
+            if (pos < num_tokens) {
+                fail_at(tokens[pos], ErrorCode::UnexpectedToken);
+            } else {
+                tree.root = root;
+            }
+        }
+        return tree;
+    }
+private:
+    static constexpr OperatorPrecedence get_precedence{};
+    static constexpr int kPrefixBindingPower = 2 * get_precedence('^') - 1;
+
+    static constexpr int left_binding_power(char op) { return 2 * get_precedence(op); }
+    static constexpr int right_binding_power(char op) {
+        return get_precedence.is_right_associative(op) ? left_binding_power(op) - 1 : left_binding_power(op) + 1;
+    }
+
+    constexpr bool parse_expression(int min_binding_power, int depth, std::uint32_t& out) {
+        if (depth > kMaxNestingDepth) {
+            return fail(ErrorCode::NestingTooDeep, offset_here());
+        }
+        if (!parse_prefix(depth, out)) {
+            return false;
+        }
+        while (pos < num_tokens && tokens[pos].kind == TokenKind::Operator) {
+            const Token& token = tokens[pos];
+            if (left_binding_power(token.op) <= min_binding_power) {
+                break;
+            }
+            ++pos;
+            std::uint32_t right = 0;
+            if (!parse_expression(right_binding_power(token.op), depth + 1, right)) {
+                return false;
+            }
+            out = add_operation(token.op, out, right);
+        }
+        return true;
+    }
+
+    constexpr bool parse_prefix(int depth, std::uint32_t& out) {
+        if (pos >= num_tokens) {
+            return fail(ErrorCode::ExpectedOperand, offset_here());
+        }
+        const Token& token = tokens[pos++];
+        switch (token.kind) {
+            case TokenKind::Number:
+                out = token.is_integer ? add_integer(token.integer) : add({NodeKind::Number, 0, false, token.value});
+                return true;
+            case TokenKind::Identifier:
+                if (pos < num_tokens && tokens[pos].kind == TokenKind::LeftParen) {
+                    return parse_call(token, depth, out);
+                }
+                out = add_variable(token.text(source));
+                return true;
+            case TokenKind::LeftParen:
+                if (!parse_expression(0, depth + 1, out)) {
+                    return false;
+                }
+                return expect(TokenKind::RightParen, ErrorCode::ExpectedClosingParen);
+            case TokenKind::Operator:
+                if (token.op == '-' || token.op == '+') {
+                    if (!parse_expression(kPrefixBindingPower, depth + 1, out)) {
+                        return false;
+                    }
+                    if (token.op == '-') {
+                        out = add_negate(out);
+                    }
+                    return true;
+                }
+                return fail(ErrorCode::ExpectedOperand, token.offset);
+            default:
+                return fail_at(token, ErrorCode::ExpectedOperand);
+        }
+    }
+
+    constexpr bool parse_call(const Token& name, int depth, std::uint32_t& out) {
+        const int builtin = find_builtin(name.text(source));
+        if (builtin < 0) {
+            return fail(ErrorCode::UnknownFunction, name.offset);
+        }
+        ++pos;
+        std::uint32_t args[2] = {};
+        int count = 0;
+        if (pos < num_tokens && tokens[pos].kind == TokenKind::RightParen) {
+            ++pos;
+        } else {
+            do {
+                std::uint32_t arg = 0;
+                if (!parse_expression(0, depth + 1, arg)) {
+                    return false;
+                }
+                if (count < 2) {
+                    args[count] = arg;
+                }
+                ++count;
+            } while (accept(TokenKind::Comma));
+            if (!expect(TokenKind::RightParen, ErrorCode::ExpectedClosingParen)) {
+                return false;
+            }
+        }
+        if (count != get_builtin(static_cast<std::uint32_t>(builtin)).arity) {
+            return fail(ErrorCode::WrongArgumentCount, name.offset);
+        }
+        // Never folded here: the C library computes calls at run time, as it does for
+        // parse_expression().
+        out = add({NodeKind::Call, 0, is_folded(args[0]) && is_folded(args[count == 2 ? 1 : 0]), 0.0, 0, args[0],
+                   count == 2 ? args[1] : args[0], static_cast<std::uint32_t>(builtin)});
+        return true;
+    }
+
+    // Node construction, folding like Simplifier::fold_node() (see optimizer.cpp).
+    constexpr std::uint32_t add(const StaticNode& node) {
+        tree.nodes[tree.num_nodes] = node;
+        return tree.num_nodes++;
+    }
+    constexpr std::uint32_t add_integer(std::int64_t integer) {
+        return add({NodeKind::Integer, 0, false, static_cast<double>(integer), integer});
+    }
+    constexpr std::uint32_t add_variable(std::string_view name) {
+        std::uint32_t slot = 0;
+        while (slot < tree.num_variables && tree.variables[slot] != name) {
+            ++slot;
+        }
+        if (slot == tree.num_variables) {
+            tree.variables[tree.num_variables++] = name;
+        }
+        return add({NodeKind::Variable, 0, false, 0.0, 0, 0, 0, slot});
+    }
+    constexpr std::uint32_t add_negate(std::uint32_t operand) {
+        const StaticNode& x = tree.nodes[operand];
+        std::int64_t exact = 0;
+        if (x.kind == NodeKind::Integer && negate_integer(x.integer, exact)) {
+            return add_integer(exact);
+        }
+        if (x.kind == NodeKind::Integer || x.kind == NodeKind::Number) {
+            return add({NodeKind::Number, 0, false, -x.value});
+        }
+        return add({NodeKind::Negate, 0, x.is_constant, 0.0, 0, operand, operand});
+    }
+    constexpr std::uint32_t add_operation(char op, std::uint32_t left, std::uint32_t right) {
+        const StaticNode& l = tree.nodes[left];
+        const StaticNode& r = tree.nodes[right];
+        const bool divides_by_zero = op == '/' && is_folded(right) && r.value == 0.0;
+        if (is_folded(left) && is_folded(right) && !divides_by_zero) {
+            std::int64_t exact = 0;
+            if (l.kind == NodeKind::Integer && r.kind == NodeKind::Integer &&
+                apply_integer_operator(op, l.integer, r.integer, exact)) {
+                return add_integer(exact);
+            }
+            if (op != '^') {
+                return add({NodeKind::Number, 0, false, apply_operator(op, l.value, r.value)});
+            }
+        }
+        const bool is_constant = (is_folded(left) || l.is_constant) && (is_folded(right) || r.is_constant);
+        return add({NodeKind::Operation, op, is_constant, 0.0, 0, left, right});
+    }
+
+    [[nodiscard]] constexpr bool is_folded(std::uint32_t index) const {
+        return tree.nodes[index].kind == NodeKind::Number || tree.nodes[index].kind == NodeKind::Integer;
+    }
+
+    constexpr bool accept(TokenKind kind) {
+        if (pos < num_tokens && tokens[pos].kind == kind) {
+            ++pos;
+            return true;
+        }
+        return false;
+    }
+
+    constexpr bool expect(TokenKind kind, ErrorCode code) {
+        return accept(kind) || fail(code, offset_here());
+    }
+
+    constexpr bool fail_at(const Token& token, ErrorCode code) {
+        if (token.kind == TokenKind::Invalid) {
+            const char c = source[token.offset];
+            code = (c >= '0' && c <= '9') || c == '.' ? ErrorCode::InvalidNumber : ErrorCode::UnexpectedCharacter;
+        }
+        return fail(code, token.offset);
+    }
+
+    [[nodiscard]] constexpr std::uint32_t offset_here() const {
+        return pos < num_tokens ? tokens[pos].offset : static_cast<std::uint32_t>(source.size());
+    }
+
+    constexpr bool fail(ErrorCode code, std::uint32_t offset) {
+        tree.error = {code, offset};
+        return false;
+    }
+
+    std::string_view source;
+    std::array<Token, capacity> tokens{};
+    std::size_t num_tokens = 0;
+    std::size_t pos = 0;
+    StaticTree<capacity> tree;
+};
+
+// to_integer() from bytecode.cpp: exactly an int64, and not -0.
+constexpr bool to_integer(double value, std::int64_t& out) {
+    if (!(value >= -0x1p63 && value < 0x1p63)) {
+        return false;
+    }
+    out = static_cast<std::int64_t>(value);
+    return static_cast<double>(out) == value && !(out == 0 && std::bit_cast<std::uint64_t>(value) >> 63);
+}
+
+template <FixedString source>
+inline constexpr StaticTree<sizeof source.chars> parsed = StaticParser<sizeof source.chars>(source.view()).parse();
+
+} // namespace detail
+
+// The error parse_tree() reports for `source`, or none: lets a build check that a
+// formula is rejected, and how.
+template <FixedString source>
+[[nodiscard]] consteval Error parse_error() {
+    return detail::parsed<source>.error;
+}
+
+// A formula compiled into straight-line code: one function per node, each inlined
+// into its parent, with constants already folded. Evaluation does no parsing,
+// dispatch or allocation, and records no phase statistics.
+template <FixedString source>
+class Formula {
+    static constexpr const detail::StaticTree<sizeof source.chars>& tree = detail::parsed<source>;
+    static_assert(!tree.error, "formula does not parse; calc::parse_error<\"...\">() says why");
+public:
+    // Slot of a variable, in order of first appearance, as CompiledExpression::slot().
+    // Fails to compile if the formula does not mention `name`.
+    [[nodiscard]] static consteval std::uint32_t slot(std::string_view name) {
+        for (std::uint32_t i = 0; i < tree.num_variables; ++i) {
+            if (tree.variables[i] == name) {
+                return i;
+            }
+        }
+        throw std::invalid_argument("formula does not mention this variable");
+    }
+    [[nodiscard]] static constexpr std::size_t num_slots() { return tree.num_variables; }
+    [[nodiscard]] static constexpr std::span<const std::string_view> get_variables() {
+        return {tree.variables.data(), tree.num_variables};
+    }
+
+    // `bindings[i]` is the value of slot i. Throws as CompiledExpression::evaluate().
+    [[nodiscard]] static constexpr double evaluate(std::span<const double> bindings = {}) {
+        if (bindings.size() < tree.num_variables) {
+            throw std::runtime_error("Unbound variable '" + std::string(tree.variables[bindings.size()]) + "'");
+        }
+        if constexpr (is_integer(tree.root)) {
+            std::int64_t integers[tree.num_variables + 1] = {};
+            bool whole = true;
+            for (std::size_t i = 0; i < tree.num_variables; ++i) {
+                whole = whole && detail::to_integer(bindings[i], integers[i]);
+            }
+            std::int64_t exact = 0;
+            if (whole && integer_value<tree.root>(integers, exact)) {
+                return static_cast<double>(exact);
+            }
+        }
+        return value<tree.root>(bindings.data());
+    }
+private:
+    // Whether the subtree would get an IntegerProgram (see compile_integer()): no
+    // decimal constant, no call, and no power that simplify() would fold in double.
+    static constexpr bool is_integer(std::uint32_t index) {
+        const detail::StaticNode& node = tree.nodes[index];
+        switch (node.kind) {
+            case NodeKind::Integer: case NodeKind::Variable: return true;
+            case NodeKind::Negate: return is_integer(node.left);
+            case NodeKind::Operation: return !node.is_constant && is_integer(node.left) && is_integer(node.right);
+            default: return false;
+        }
+    }
+
+    // The double path: what the VM, closures and JIT compute.
+    template <std::uint32_t index>
+    static constexpr double value(const double* bindings) {
+        constexpr detail::StaticNode node = tree.nodes[index];
+        if constexpr (node.kind == NodeKind::Number || node.kind == NodeKind::Integer) {
+            return node.value;
+        } else if constexpr (node.kind == NodeKind::Variable) {
+            return bindings[node.slot];
+        } else if constexpr (node.kind == NodeKind::Negate) {
+            return -value<node.left>(bindings);
+        } else if constexpr (node.kind == NodeKind::Call) {
+            const double left = value<node.left>(bindings);
+            return get_builtin(node.slot).scalar(left, node.right == node.left ? left : value<node.right>(bindings));
+        } else {
+            const double left = value<node.left>(bindings);
+            return apply_operator(node.op, left, value<node.right>(bindings));
+        }
+    }
+
+    // The exact path: what IntegerMachine computes. False where it gives up.
+    template <std::uint32_t index>
+    static constexpr bool integer_value(const std::int64_t* bindings, std::int64_t& out) {
+        constexpr detail::StaticNode node = tree.nodes[index];
+        if constexpr (node.kind == NodeKind::Integer) {
+            out = node.integer;
+            return true;
+        } else if constexpr (node.kind == NodeKind::Variable) {
+            out = bindings[node.slot];
+            return true;
+        } else if constexpr (node.kind == NodeKind::Negate) {
+            std::int64_t operand = 0;
+            return integer_value<node.left>(bindings, operand) && negate_integer(operand, out);
+        } else {
+            std::int64_t left = 0;
+            std::int64_t right = 0;
+            return integer_value<node.left>(bindings, left) && integer_value<node.right>(bindings, right) &&
+                   (node.op != '/' || right != 0) && apply_integer_operator(node.op, left, right, out);
+        }
+    }
+};
+
+// The value of a formula without variables, computed by the compiler.
+template <FixedString source>
+[[nodiscard]] consteval double eval() {
+    static_assert(Formula<source>::num_slots() == 0, "calc::eval<>() takes no variables; use calc::Formula");
+    return Formula<source>::evaluate();
+}
+
+} // namespace calc
+
+#endif // STATIC_EXPRESSION_H
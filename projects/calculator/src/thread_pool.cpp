@@ -0,0 +1,92 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned threads) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    workers.reserve(threads - 1);
+    for (unsigned i = 1; i < threads; ++i) {
+        workers.emplace_back([this] { work(); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    // The jthreads join as `workers` is destroyed.
+}
+
+void ThreadPool::parallel_for(std::size_t count, std::size_t grain,
+                              const std::function<void(std::size_t, std::size_t)>& body) {
+    grain = std::max<std::size_t>(grain, 1);
+    if (workers.empty() || count <= grain) {
+        for (std::size_t begin = 0; begin < count; begin += grain) {
+            body(begin, std::min(count, begin + grain));
+        }
+        return;
+    }
+
+    {
+        std::lock_guard lock(mutex);
+        this->body = &body;
+        this->count = count;
+        this->grain = grain;
+        next = 0;
+        failed = false;
+        error = nullptr;
+        busy = static_cast<unsigned>(workers.size());
+        ++generation;
+    }
+    wake.notify_all();
+    run_ranges();
+
+    std::unique_lock lock(mutex);
+    done.wait(lock, [this] { return busy == 0; });
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+void ThreadPool::work() {
+    std::uint64_t seen = 0;
+    for (;;) {
+        {
+            std::unique_lock lock(mutex);
+            wake.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) {
+                return;
+            }
+            seen = generation;
+        }
+        run_ranges();
+        {
+            std::lock_guard lock(mutex);
+            if (--busy == 0) {
+                done.notify_one();
+            }
+        }
+    }
+}
+
+void ThreadPool::run_ranges() {
+    for (;;) {
+        std::size_t begin = next.fetch_add(grain);
+        if (begin >= count || failed) {
+            return;
+        }
+        try {
+            (*body)(begin, std::min(count, begin + grain));
+        } catch (...) {
+            std::lock_guard lock(mutex);
+            if (!error) {
+                error = std::current_exception();
+            }
+            failed = true;
+        }
+    }
+}
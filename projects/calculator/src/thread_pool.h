@@ -0,0 +1,55 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// RAII: A fixed set of worker threads, started on construction and joined on
+// destruction. Work is handed out as parallel loops; between loops the workers sleep.
+class ThreadPool {
+public:
+    // `threads` includes the calling thread, which takes part in every loop; 0 means
+    // one per hardware thread. A pool of one runs everything on the caller.
+    explicit ThreadPool(unsigned threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    [[nodiscard]] unsigned size() const { return static_cast<unsigned>(workers.size()) + 1; }
+
+    // Calls body(begin, end) for consecutive ranges of `grain` items covering
+    // [0, count), spread over every thread of the pool, and returns once all calls
+    // have finished. If a call throws, ranges not yet started are skipped and the
+    // first exception is rethrown here. One loop at a time: not reentrant.
+    void parallel_for(std::size_t count, std::size_t grain,
+                      const std::function<void(std::size_t, std::size_t)>& body);
+private:
+    void work();
+    void run_ranges();
+
+    std::vector<std::jthread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    std::uint64_t generation = 0;
+    unsigned busy = 0;
+    bool stopping = false;
+
+    // The current loop; written under `mutex` before the workers are woken.
+    const std::function<void(std::size_t, std::size_t)>* body = nullptr;
+    std::size_t count = 0;
+    std::size_t grain = 1;
+    std::atomic<std::size_t> next{0};
+    std::atomic<bool> failed{false};
+    std::exception_ptr error;
+};
+
+#endif // THREAD_POOL_H